@@ -0,0 +1,17 @@
+#include "ImGuiDrawSnapshot.hpp"
+
+
+ImGuiDrawSnapshot::ImGuiDrawSnapshot(const ImDrawData& source)
+  : drawData{source}
+{
+  // ImGui reuses its own draw lists for the next frame, so they are cloned
+  drawData.CmdLists.clear();
+  for (const ImDrawList* list : source.CmdLists)
+    drawData.CmdLists.push_back(list->CloneOutput());
+}
+
+ImGuiDrawSnapshot::~ImGuiDrawSnapshot()
+{
+  for (ImDrawList* list : drawData.CmdLists)
+    IM_DELETE(list);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <imgui.h>
+
+
+/**
+ * Owns a copy of the draw lists of a finished ImGui frame, so that it can be
+ * rendered on a different thread while the next frame is already being built.
+ */
+class ImGuiDrawSnapshot
+{
+public:
+  explicit ImGuiDrawSnapshot(const ImDrawData& source);
+  ~ImGuiDrawSnapshot();
+
+  ImGuiDrawSnapshot(const ImGuiDrawSnapshot&) = delete;
+  ImGuiDrawSnapshot& operator=(const ImGuiDrawSnapshot&) = delete;
+
+  ImDrawData* get() { return &drawData; }
+
+private:
+  ImDrawData drawData;
+};
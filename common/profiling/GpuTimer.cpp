@@ -0,0 +1,181 @@
+#include "GpuTimer.hpp"
+
+#include <limits>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/OneShotCmdMgr.hpp>
+#include <etna/Assert.hpp>
+
+#include "TraceRecorder.hpp"
+
+
+GpuTimer::Scope::Scope(GpuTimer* a_timer, vk::CommandBuffer cmd_buf, std::uint32_t a_index)
+  : timer{a_timer}
+  , cmdBuf{cmd_buf}
+  , index{a_index}
+{
+}
+
+GpuTimer::Scope::~Scope()
+{
+  timer->endScope(cmdBuf, index);
+}
+
+GpuTimer::GpuTimer(std::uint32_t max_scopes)
+  : maxScopes{max_scopes}
+{
+  auto& ctx = etna::get_context();
+
+  timestampPeriod = ctx.getPhysicalDevice().getProperties().limits.timestampPeriod;
+
+  slots.resize(ctx.getMainWorkCount().multiBufferingCount());
+  for (auto& slot : slots)
+  {
+    slot.queryPool = etna::unwrap_vk_result(ctx.getDevice().createQueryPoolUnique(
+      vk::QueryPoolCreateInfo{
+        .queryType = vk::QueryType::eTimestamp,
+        .queryCount = 2 * maxScopes,
+      }));
+    slot.names.reserve(maxScopes);
+    slot.depths.reserve(maxScopes);
+  }
+
+  queryData.resize(2 * maxScopes);
+
+  calibrate();
+}
+
+void GpuTimer::calibrate()
+{
+  auto& ctx = etna::get_context();
+
+  // NOTE: VK_EXT_calibrated_timestamps would do this precisely, but it's not
+  // available everywhere and has to be requested when the device is created.
+  // Instead, a timestamp is written by a tiny submit and assumed to be taken
+  // halfway between the submit and the wait, the shortest of a few tries wins.
+  auto queryPool = etna::unwrap_vk_result(ctx.getDevice().createQueryPoolUnique(
+    vk::QueryPoolCreateInfo{
+      .queryType = vk::QueryType::eTimestamp,
+      .queryCount = 1,
+    }));
+  auto cmdMgr = ctx.createOneShotCmdMgr();
+
+  std::uint64_t bestWindow = std::numeric_limits<std::uint64_t>::max();
+  for (int i = 0; i < 5; ++i)
+  {
+    auto cmdBuf = cmdMgr->start();
+    ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
+    cmdBuf.resetQueryPool(queryPool.get(), 0, 1);
+    cmdBuf.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, queryPool.get(), 0);
+    ETNA_CHECK_VK_RESULT(cmdBuf.end());
+
+    const std::uint64_t before = TraceRecorder::now();
+    cmdMgr->submitAndWait(std::move(cmdBuf));
+    const std::uint64_t after = TraceRecorder::now();
+
+    std::uint64_t ticks = 0;
+    ETNA_CHECK_VK_RESULT(ctx.getDevice().getQueryPoolResults(
+      queryPool.get(),
+      0,
+      1,
+      sizeof(ticks),
+      &ticks,
+      sizeof(ticks),
+      vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait));
+
+    if (after - before < bestWindow)
+    {
+      bestWindow = after - before;
+      calibrationGpuTicks = ticks;
+      calibrationCpuNs = before + (after - before) / 2;
+    }
+  }
+}
+
+std::uint64_t GpuTimer::toCpuNanoseconds(std::uint64_t gpu_ticks) const
+{
+  const double deltaNs =
+    (static_cast<double>(gpu_ticks) - static_cast<double>(calibrationGpuTicks)) * timestampPeriod;
+  return calibrationCpuNs + static_cast<std::int64_t>(deltaNs);
+}
+
+void GpuTimer::beginFrame(vk::CommandBuffer cmd_buf)
+{
+  auto& slot = slots[etna::get_context().getMainWorkCount().currentResource()];
+
+  // The fence for this slot was already waited upon, so the results are ready
+  readBack(slot);
+
+  slot.names.clear();
+  slot.depths.clear();
+  cmd_buf.resetQueryPool(slot.queryPool.get(), 0, 2 * maxScopes);
+
+  currentSlot = &slot;
+  currentDepth = 0;
+}
+
+GpuTimer::Scope GpuTimer::scope(vk::CommandBuffer cmd_buf, std::string_view name)
+{
+  ETNA_VERIFYF(currentSlot != nullptr, "GpuTimer::beginFrame was not called!");
+  ETNA_VERIFYF(
+    currentSlot->names.size() < maxScopes, "Too many GPU timer scopes, max is {}", maxScopes);
+
+  const auto index = static_cast<std::uint32_t>(currentSlot->names.size());
+  currentSlot->names.emplace_back(name);
+  currentSlot->depths.push_back(currentDepth++);
+
+  cmd_buf.writeTimestamp2(
+    vk::PipelineStageFlagBits2::eAllCommands, currentSlot->queryPool.get(), 2 * index);
+
+  return Scope(this, cmd_buf, index);
+}
+
+void GpuTimer::endScope(vk::CommandBuffer cmd_buf, std::uint32_t index)
+{
+  --currentDepth;
+  cmd_buf.writeTimestamp2(
+    vk::PipelineStageFlagBits2::eAllCommands, currentSlot->queryPool.get(), 2 * index + 1);
+}
+
+void GpuTimer::readBack(FrameSlot& slot)
+{
+  if (slot.names.empty())
+    return;
+
+  const auto queryCount = static_cast<std::uint32_t>(2 * slot.names.size());
+  const vk::Result result = etna::get_context().getDevice().getQueryPoolResults(
+    slot.queryPool.get(),
+    0,
+    queryCount,
+    queryCount * sizeof(std::uint64_t),
+    queryData.data(),
+    sizeof(std::uint64_t),
+    vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+  ETNA_CHECK_VK_RESULT(result);
+
+  auto& recorder = TraceRecorder::get();
+
+  lastTimings.clear();
+  for (std::size_t i = 0; i < slot.names.size(); ++i)
+  {
+    const std::uint64_t endNs = toCpuNanoseconds(queryData[2 * i + 1]);
+    recorder.record(
+      slot.names[i], TraceRecorder::Track::Gpu, toCpuNanoseconds(queryData[2 * i]), endNs);
+
+    const std::uint64_t ticks = queryData[2 * i + 1] - queryData[2 * i];
+    lastTimings.push_back(Timing{
+      .name = slot.names[i],
+      .milliseconds = static_cast<float>(static_cast<double>(ticks) * timestampPeriod * 1e-6),
+      .depth = slot.depths[i],
+      .endNs = endNs,
+    });
+  }
+}
+
+std::optional<float> GpuTimer::getTiming(std::string_view name) const
+{
+  for (const auto& timing : lastTimings)
+    if (timing.name == name)
+      return timing.milliseconds;
+  return std::nullopt;
+}
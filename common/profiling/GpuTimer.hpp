@@ -0,0 +1,91 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+
+
+/**
+ * Measures GPU execution time of passes using timestamp queries.
+ * Unlike Tracy GPU zones, the results are available to the application
+ * itself, so they can be displayed in the GUI or used to make decisions.
+ * Results are read back once the frame's fence is waited upon, so
+ * they lag behind by the amount of frames in flight. They are also
+ * forwarded to the TraceRecorder, converted to the CPU clock.
+ */
+class GpuTimer
+{
+public:
+  struct Timing
+  {
+    std::string name;
+    float milliseconds;
+    // Nesting level of the scope, 0 for top-level scopes
+    std::uint32_t depth;
+    // When the GPU finished the scope, in TraceRecorder::now() time
+    std::uint64_t endNs;
+  };
+
+  class Scope
+  {
+  public:
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+    Scope(Scope&&) = delete;
+    Scope& operator=(Scope&&) = delete;
+
+    ~Scope();
+
+  private:
+    friend class GpuTimer;
+    Scope(GpuTimer* timer, vk::CommandBuffer cmd_buf, std::uint32_t index);
+
+    GpuTimer* timer;
+    vk::CommandBuffer cmdBuf;
+    std::uint32_t index;
+  };
+
+  explicit GpuTimer(std::uint32_t max_scopes = 64);
+
+  // Must be called at the start of every frame, after the frame's command buffer was
+  // acquired, i.e. after the fence of the previous usage of this frame slot was waited upon.
+  void beginFrame(vk::CommandBuffer cmd_buf);
+
+  // Scopes can be nested. Not allowed inside of a render pass instance if the
+  // scope is opened outside of it.
+  [[nodiscard]] Scope scope(vk::CommandBuffer cmd_buf, std::string_view name);
+
+  // Timings of the latest frame that was completed by the GPU, in recording order
+  std::span<const Timing> getTimings() const { return lastTimings; }
+  std::optional<float> getTiming(std::string_view name) const;
+
+private:
+  struct FrameSlot
+  {
+    vk::UniqueQueryPool queryPool;
+    std::vector<std::string> names;
+    std::vector<std::uint32_t> depths;
+  };
+
+  void endScope(vk::CommandBuffer cmd_buf, std::uint32_t index);
+  void readBack(FrameSlot& slot);
+  // Finds a pair of GPU and CPU timestamps that correspond to the same moment
+  void calibrate();
+  std::uint64_t toCpuNanoseconds(std::uint64_t gpu_ticks) const;
+
+private:
+  std::uint32_t maxScopes;
+  float timestampPeriod;
+  std::uint64_t calibrationGpuTicks = 0;
+  std::uint64_t calibrationCpuNs = 0;
+  std::vector<FrameSlot> slots;
+  FrameSlot* currentSlot = nullptr;
+  std::uint32_t currentDepth = 0;
+
+  std::vector<std::uint64_t> queryData;
+  std::vector<Timing> lastTimings;
+};
@@ -0,0 +1,174 @@
+#include "TraceRecorder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+
+TraceRecorder& TraceRecorder::get()
+{
+  static TraceRecorder recorder;
+  return recorder;
+}
+
+std::uint64_t TraceRecorder::now()
+{
+  return static_cast<std::uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch())
+      .count());
+}
+
+void TraceRecorder::record(
+  std::string_view name, Track track, std::uint64_t begin_ns, std::uint64_t end_ns)
+{
+  static thread_local const std::uint32_t threadId =
+    nextThreadId.fetch_add(1, std::memory_order_relaxed);
+
+  const std::uint64_t index = eventIndex.fetch_add(1, std::memory_order_relaxed);
+  auto& event = (*events)[index % EVENT_CAPACITY];
+
+  // A seqlock: odd values mean the event is being written, so readers skip it
+  event.sequence.store(2 * index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  event.beginNs = begin_ns;
+  event.endNs = end_ns;
+  event.threadId = threadId;
+  event.track = track;
+  const std::size_t length = std::min(name.size(), MAX_NAME_LENGTH);
+  std::memcpy(event.name, name.data(), length);
+  event.name[length] = '\0';
+
+  event.sequence.store(2 * index + 2, std::memory_order_release);
+}
+
+void TraceRecorder::markFrame()
+{
+  const std::uint64_t frame = frameIndex.load(std::memory_order_relaxed);
+  frameStarts[frame % FRAME_CAPACITY].store(now(), std::memory_order_relaxed);
+  frameIndex.store(frame + 1, std::memory_order_release);
+}
+
+bool TraceRecorder::dumpFrames(const std::filesystem::path& path, std::uint32_t frame_count) const
+{
+  const std::uint64_t frame = frameIndex.load(std::memory_order_acquire);
+  const std::uint64_t count =
+    std::min<std::uint64_t>({frame_count, frame, FRAME_CAPACITY});
+  const std::uint64_t fromNs =
+    count == 0 ? 0 : frameStarts[(frame - count) % FRAME_CAPACITY].load(std::memory_order_relaxed);
+  return dump(path, fromNs);
+}
+
+bool TraceRecorder::dumpSeconds(const std::filesystem::path& path, float seconds) const
+{
+  const auto window = static_cast<std::uint64_t>(static_cast<double>(seconds) * 1e9);
+  const std::uint64_t currentNs = now();
+  return dump(path, currentNs > window ? currentNs - window : 0);
+}
+
+// Names come from code, but better safe than sorry
+static std::string escape_json(const char* str)
+{
+  std::string result;
+  for (; *str != '\0'; ++str)
+  {
+    if (*str == '"' || *str == '\\')
+      result.push_back('\\');
+    if (static_cast<unsigned char>(*str) >= 0x20)
+      result.push_back(*str);
+  }
+  return result;
+}
+
+bool TraceRecorder::dump(const std::filesystem::path& path, std::uint64_t from_ns) const
+{
+  struct Copy
+  {
+    std::uint64_t beginNs;
+    std::uint64_t endNs;
+    std::uint32_t threadId;
+    Track track;
+    char name[MAX_NAME_LENGTH + 1];
+  };
+
+  const std::uint64_t last = eventIndex.load(std::memory_order_acquire);
+  const std::uint64_t first = last > EVENT_CAPACITY ? last - EVENT_CAPACITY : 0;
+
+  std::vector<Copy> copies;
+  copies.reserve(last - first);
+  for (std::uint64_t index = first; index < last; ++index)
+  {
+    const auto& event = (*events)[index % EVENT_CAPACITY];
+    const std::uint64_t expected = 2 * index + 2;
+    if (event.sequence.load(std::memory_order_acquire) != expected)
+      continue;
+
+    Copy copy{
+      .beginNs = event.beginNs,
+      .endNs = event.endNs,
+      .threadId = event.threadId,
+      .track = event.track,
+      .name = {},
+    };
+    std::memcpy(copy.name, event.name, sizeof(copy.name));
+
+    // The event might have been overwritten while we were copying it
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (event.sequence.load(std::memory_order_relaxed) != expected)
+      continue;
+
+    if (copy.beginNs >= from_ns)
+      copies.push_back(copy);
+  }
+
+  std::sort(copies.begin(), copies.end(), [](const Copy& a, const Copy& b) {
+    return a.beginNs < b.beginNs;
+  });
+
+  const std::uint64_t originNs = copies.empty() ? from_ns : copies.front().beginNs;
+  const auto toUs = [originNs](std::uint64_t ns) {
+    return static_cast<double>(static_cast<std::int64_t>(ns - originNs)) * 1e-3;
+  };
+
+  std::ofstream file(path, std::ios::trunc);
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  file << R"({"ph":"M","pid":0,"name":"process_name","args":{"name":"CPU"}},)" << '\n';
+  file << R"({"ph":"M","pid":1,"name":"process_name","args":{"name":"GPU"}})";
+
+  const std::uint64_t frame = frameIndex.load(std::memory_order_acquire);
+  for (std::uint64_t i = frame > FRAME_CAPACITY ? frame - FRAME_CAPACITY : 0; i < frame; ++i)
+  {
+    const std::uint64_t startNs = frameStarts[i % FRAME_CAPACITY].load(std::memory_order_relaxed);
+    if (startNs >= originNs)
+      file << fmt::format(
+        ",\n{{\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":0,\"ts\":{:.3f},\"name\":\"Frame {}\"}}",
+        toUs(startNs),
+        i);
+  }
+
+  for (const auto& copy : copies)
+    file << fmt::format(
+      ",\n{{\"ph\":\"X\",\"pid\":{},\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f},\"name\":\"{}\"}}",
+      copy.track == Track::Gpu ? 1 : 0,
+      copy.threadId,
+      toUs(copy.beginNs),
+      static_cast<double>(copy.endNs - copy.beginNs) * 1e-3,
+      escape_json(copy.name));
+
+  file << "\n]}\n";
+
+  if (!file)
+  {
+    spdlog::error("Trace: failed to write '{}'", path.string());
+    return false;
+  }
+
+  spdlog::info("Trace: {} events written to '{}'", copies.size(), path.string());
+  return true;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+
+#include <tracy/Tracy.hpp>
+
+
+/**
+ * Offline counterpart to Tracy. CPU zones and GPU timings are continuously
+ * recorded into an in-memory ring, and the latest frames or seconds of it
+ * can be written into a Chrome trace JSON file, which both chrome://tracing
+ * and ui.perfetto.dev can open. Useful on machines where a Tracy client
+ * can't connect. Recording is lock-free and can happen from any thread,
+ * dumping is supposed to happen from a single thread.
+ */
+class TraceRecorder
+{
+public:
+  enum class Track : std::uint8_t
+  {
+    Cpu,
+    Gpu,
+  };
+
+  // RAII helper for CPU zones, use the TRACE_ZONE macros instead of this directly
+  class Zone
+  {
+  public:
+    explicit Zone(const char* zone_name)
+      : name{zone_name}
+      , begin{now()}
+    {
+    }
+
+    Zone(const Zone&) = delete;
+    Zone& operator=(const Zone&) = delete;
+
+    ~Zone() { get().record(name, Track::Cpu, begin, now()); }
+
+  private:
+    const char* name;
+    std::uint64_t begin;
+  };
+
+  static TraceRecorder& get();
+
+  // Nanoseconds of the clock that all events are recorded in
+  static std::uint64_t now();
+
+  // Names longer than MAX_NAME_LENGTH get truncated
+  void record(std::string_view name, Track track, std::uint64_t begin_ns, std::uint64_t end_ns);
+  void markFrame();
+
+  std::uint64_t getFrameIndex() const { return frameIndex.load(std::memory_order_relaxed); }
+
+  // Events that are older than what the ring holds are silently lost
+  bool dumpFrames(const std::filesystem::path& path, std::uint32_t frame_count) const;
+  bool dumpSeconds(const std::filesystem::path& path, float seconds) const;
+
+  static constexpr std::size_t MAX_NAME_LENGTH = 47;
+  static constexpr std::size_t EVENT_CAPACITY = 1 << 16;
+  static constexpr std::size_t FRAME_CAPACITY = 1 << 10;
+
+private:
+  TraceRecorder() = default;
+
+  struct Event
+  {
+    // Event number 'n' is complete once this is equal to 2 * n + 2
+    std::atomic<std::uint64_t> sequence{0};
+    std::uint64_t beginNs;
+    std::uint64_t endNs;
+    std::uint32_t threadId;
+    Track track;
+    char name[MAX_NAME_LENGTH + 1];
+  };
+
+  bool dump(const std::filesystem::path& path, std::uint64_t from_ns) const;
+
+private:
+  std::unique_ptr<std::array<Event, EVENT_CAPACITY>> events =
+    std::make_unique<std::array<Event, EVENT_CAPACITY>>();
+  std::atomic<std::uint64_t> eventIndex{0};
+
+  std::array<std::atomic<std::uint64_t>, FRAME_CAPACITY> frameStarts{};
+  std::atomic<std::uint64_t> frameIndex{0};
+
+  std::atomic<std::uint32_t> nextThreadId{0};
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+// Drop-in replacements for ZoneScoped and ZoneScopedN that also record into the TraceRecorder
+#define TRACE_ZONE                                                                                 \
+  ZoneScoped;                                                                                      \
+  const TraceRecorder::Zone TRACE_CONCAT(traceZone, __LINE__) { __func__ }
+#define TRACE_ZONE_N(zone_name)                                                                    \
+  ZoneScopedN(zone_name);                                                                          \
+  const TraceRecorder::Zone TRACE_CONCAT(traceZone, __LINE__) { zone_name }
@@ -0,0 +1,456 @@
+#include "RenderGraph.hpp"
+
+#include <algorithm>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/Assert.hpp>
+#include <etna/Etna.hpp>
+
+
+RenderGraph::ImageUsage RenderGraph::colorAttachment()
+{
+  return ImageUsage{
+    .stages = vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+    .access =
+      vk::AccessFlagBits2::eColorAttachmentRead | vk::AccessFlagBits2::eColorAttachmentWrite,
+    .layout = vk::ImageLayout::eColorAttachmentOptimal,
+    .aspect = vk::ImageAspectFlagBits::eColor,
+  };
+}
+
+RenderGraph::ImageUsage RenderGraph::depthAttachment()
+{
+  return ImageUsage{
+    .stages = vk::PipelineStageFlagBits2::eEarlyFragmentTests |
+      vk::PipelineStageFlagBits2::eLateFragmentTests,
+    .access = vk::AccessFlagBits2::eDepthStencilAttachmentRead |
+      vk::AccessFlagBits2::eDepthStencilAttachmentWrite,
+    .layout = vk::ImageLayout::eDepthAttachmentOptimal,
+    .aspect = vk::ImageAspectFlagBits::eDepth,
+  };
+}
+
+RenderGraph::ImageUsage RenderGraph::sampled(
+  vk::PipelineStageFlags2 stages, vk::ImageAspectFlags aspect)
+{
+  return ImageUsage{
+    .stages = stages,
+    .access = vk::AccessFlagBits2::eShaderSampledRead,
+    .layout = vk::ImageLayout::eShaderReadOnlyOptimal,
+    .aspect = aspect,
+  };
+}
+
+RenderGraph::ImageUsage RenderGraph::storageImage(vk::PipelineStageFlags2 stages, bool write)
+{
+  return ImageUsage{
+    .stages = stages,
+    .access = write
+      ? vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite
+      : vk::AccessFlagBits2::eShaderStorageRead,
+    .layout = vk::ImageLayout::eGeneral,
+    .aspect = vk::ImageAspectFlagBits::eColor,
+  };
+}
+
+RenderGraph::BufferUsage RenderGraph::storageBuffer(vk::PipelineStageFlags2 stages, bool write)
+{
+  return BufferUsage{
+    .stages = stages,
+    .access = write
+      ? vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite
+      : vk::AccessFlagBits2::eShaderStorageRead,
+  };
+}
+
+RenderGraph::PassBuilder::PassBuilder(RenderGraph& a_graph, std::uint32_t a_pass)
+  : graph{a_graph}
+  , pass{a_pass}
+{
+}
+
+RenderGraph::ImageHandle RenderGraph::PassBuilder::createImage(
+  std::string name, const ImageDesc& desc, const ImageUsage& usage)
+{
+  const ImageHandle handle{static_cast<std::uint32_t>(graph.images.size())};
+  graph.images.push_back(ImageResource{
+    .name = std::move(name),
+    .transient = true,
+    .desc = desc,
+  });
+  write(handle, usage);
+  return handle;
+}
+
+RenderGraph::BufferHandle RenderGraph::PassBuilder::createBuffer(
+  std::string name, const BufferDesc& desc, const BufferUsage& usage)
+{
+  const BufferHandle handle{static_cast<std::uint32_t>(graph.buffers.size())};
+  graph.buffers.push_back(BufferResource{
+    .name = std::move(name),
+    .transient = true,
+    .desc = desc,
+  });
+  write(handle, usage);
+  return handle;
+}
+
+void RenderGraph::PassBuilder::read(ImageHandle image, const ImageUsage& usage)
+{
+  ETNA_VERIFY(image.index < graph.images.size());
+  graph.passes[pass].imageAccesses.push_back(
+    ImageAccess{.image = image.index, .usage = usage, .write = false});
+}
+
+void RenderGraph::PassBuilder::write(ImageHandle image, const ImageUsage& usage)
+{
+  ETNA_VERIFY(image.index < graph.images.size());
+  graph.passes[pass].imageAccesses.push_back(
+    ImageAccess{.image = image.index, .usage = usage, .write = true});
+}
+
+void RenderGraph::PassBuilder::read(BufferHandle buffer, const BufferUsage& usage)
+{
+  ETNA_VERIFY(buffer.index < graph.buffers.size());
+  graph.passes[pass].bufferAccesses.push_back(
+    BufferAccess{.buffer = buffer.index, .usage = usage, .write = false});
+}
+
+void RenderGraph::PassBuilder::write(BufferHandle buffer, const BufferUsage& usage)
+{
+  ETNA_VERIFY(buffer.index < graph.buffers.size());
+  graph.passes[pass].bufferAccesses.push_back(
+    BufferAccess{.buffer = buffer.index, .usage = usage, .write = true});
+}
+
+void RenderGraph::PassBuilder::hasSideEffects()
+{
+  graph.passes[pass].sideEffects = true;
+}
+
+RenderGraph::ImageHandle RenderGraph::importImage(std::string name, const etna::Image& image)
+{
+  images.push_back(ImageResource{
+    .name = std::move(name),
+    .importedImage = image.get(),
+    .etnaImage = &image,
+  });
+  return {static_cast<std::uint32_t>(images.size() - 1)};
+}
+
+RenderGraph::ImageHandle RenderGraph::importImage(std::string name, vk::Image image)
+{
+  images.push_back(ImageResource{
+    .name = std::move(name),
+    .importedImage = image,
+  });
+  return {static_cast<std::uint32_t>(images.size() - 1)};
+}
+
+RenderGraph::BufferHandle RenderGraph::importBuffer(std::string name, const etna::Buffer& buffer)
+{
+  buffers.push_back(BufferResource{
+    .name = std::move(name),
+    .importedBuffer = &buffer,
+  });
+  return {static_cast<std::uint32_t>(buffers.size() - 1)};
+}
+
+void RenderGraph::addPass(std::string name, const SetupFunction& setup, ExecuteFunction execute)
+{
+  passes.push_back(Pass{
+    .name = std::move(name),
+    .execute = std::move(execute),
+  });
+
+  PassBuilder builder(*this, static_cast<std::uint32_t>(passes.size() - 1));
+  setup(builder);
+}
+
+const etna::Image& RenderGraph::getImage(ImageHandle image) const
+{
+  const auto& resource = images[image.index];
+  if (resource.transient)
+  {
+    ETNA_VERIFYF(
+      imagePlacement[image.index] != ~0u, "Image '{}' is not used by any pass", resource.name);
+    return imagePool[imagePlacement[image.index]].image;
+  }
+
+  ETNA_VERIFYF(
+    resource.etnaImage != nullptr,
+    "Image '{}' was imported as a raw Vulkan image",
+    resource.name);
+  return *resource.etnaImage;
+}
+
+vk::Image RenderGraph::getVkImage(ImageHandle image) const
+{
+  const auto& resource = images[image.index];
+  return resource.transient ? getImage(image).get() : resource.importedImage;
+}
+
+const etna::Buffer& RenderGraph::getBuffer(BufferHandle buffer) const
+{
+  const auto& resource = buffers[buffer.index];
+  if (!resource.transient)
+    return *resource.importedBuffer;
+
+  ETNA_VERIFYF(
+    bufferPlacement[buffer.index] != ~0u, "Buffer '{}' is not used by any pass", resource.name);
+  return bufferPool[bufferPlacement[buffer.index]].buffer;
+}
+
+RenderGraph::BufferState& RenderGraph::getBufferState(std::uint32_t buffer)
+{
+  return buffers[buffer].transient ? bufferPool[bufferPlacement[buffer]].state
+                                   : buffers[buffer].importedState;
+}
+
+void RenderGraph::cullPasses()
+{
+  // Walking backwards, a pass is needed if it has side effects or
+  // writes something that a needed pass after it reads.
+  std::vector<bool> neededImages(images.size(), false);
+  std::vector<bool> neededBuffers(buffers.size(), false);
+
+  for (auto it = passes.rbegin(); it != passes.rend(); ++it)
+  {
+    auto& pass = *it;
+
+    pass.alive = pass.sideEffects;
+    for (const auto& access : pass.imageAccesses)
+      pass.alive = pass.alive || (access.write && neededImages[access.image]);
+    for (const auto& access : pass.bufferAccesses)
+      pass.alive = pass.alive || (access.write && neededBuffers[access.buffer]);
+
+    if (!pass.alive)
+      continue;
+
+    for (const auto& access : pass.imageAccesses)
+      if (!access.write)
+        neededImages[access.image] = true;
+    for (const auto& access : pass.bufferAccesses)
+      if (!access.write)
+        neededBuffers[access.buffer] = true;
+  }
+}
+
+void RenderGraph::computeLifetimes()
+{
+  for (std::uint32_t i = 0; i < passes.size(); ++i)
+  {
+    if (!passes[i].alive)
+      continue;
+
+    for (const auto& access : passes[i].imageAccesses)
+    {
+      auto& image = images[access.image];
+      image.firstPass = std::min(image.firstPass, i);
+      image.lastPass = std::max(image.lastPass, i);
+    }
+    for (const auto& access : passes[i].bufferAccesses)
+    {
+      auto& buffer = buffers[access.buffer];
+      buffer.firstPass = std::min(buffer.firstPass, i);
+      buffer.lastPass = std::max(buffer.lastPass, i);
+    }
+  }
+}
+
+void RenderGraph::allocateTransients()
+{
+  auto& ctx = etna::get_context();
+
+  for (auto& entry : imagePool)
+    entry.usedThisFrame = false;
+  for (auto& entry : bufferPool)
+    entry.usedThisFrame = false;
+
+  // Resources are placed in the order they come alive, so a pool entry
+  // is free for a resource once the previous occupant's last pass is behind.
+  std::vector<std::uint32_t> order(images.size());
+  for (std::uint32_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::ranges::sort(order, {}, [this](std::uint32_t i) { return images[i].firstPass; });
+
+  imagePlacement.assign(images.size(), ~0u);
+  for (const auto i : order)
+  {
+    const auto& image = images[i];
+    if (!image.transient || image.firstPass == ~0u)
+      continue;
+
+    ++stats.transientImageCount;
+
+    auto it = std::ranges::find_if(imagePool, [&image](const PooledImage& entry) {
+      return entry.desc == image.desc &&
+        (!entry.usedThisFrame || entry.busyUntilPass < image.firstPass);
+    });
+    if (it == imagePool.end())
+    {
+      imagePool.push_back(PooledImage{
+        .desc = image.desc,
+        .image = ctx.createImage(etna::Image::CreateInfo{
+          .extent = vk::Extent3D{image.desc.extent.width, image.desc.extent.height, 1},
+          .name = image.name,
+          .format = image.desc.format,
+          .imageUsage = image.desc.usage,
+        }),
+      });
+      it = std::prev(imagePool.end());
+    }
+
+    it->usedThisFrame = true;
+    it->busyUntilPass = image.lastPass;
+    it->lastUsedFrame = frameIndex;
+    imagePlacement[i] = static_cast<std::uint32_t>(it - imagePool.begin());
+  }
+
+  order.resize(buffers.size());
+  for (std::uint32_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::ranges::sort(order, {}, [this](std::uint32_t i) { return buffers[i].firstPass; });
+
+  bufferPlacement.assign(buffers.size(), ~0u);
+  for (const auto i : order)
+  {
+    const auto& buffer = buffers[i];
+    if (!buffer.transient || buffer.firstPass == ~0u)
+      continue;
+
+    ++stats.transientBufferCount;
+
+    auto it = std::ranges::find_if(bufferPool, [&buffer](const PooledBuffer& entry) {
+      return entry.desc.usage == buffer.desc.usage && entry.desc.size >= buffer.desc.size &&
+        (!entry.usedThisFrame || entry.busyUntilPass < buffer.firstPass);
+    });
+    if (it == bufferPool.end())
+    {
+      bufferPool.push_back(PooledBuffer{
+        .desc = buffer.desc,
+        .buffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+          .size = buffer.desc.size,
+          .bufferUsage = buffer.desc.usage,
+          .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+          .name = buffer.name,
+        }),
+      });
+      it = std::prev(bufferPool.end());
+    }
+
+    it->usedThisFrame = true;
+    it->busyUntilPass = buffer.lastPass;
+    it->lastUsedFrame = frameIndex;
+    bufferPlacement[i] = static_cast<std::uint32_t>(it - bufferPool.begin());
+  }
+
+  stats.physicalImageCount = static_cast<std::uint32_t>(
+    std::ranges::count_if(imagePool, [](const PooledImage& entry) { return entry.usedThisFrame; }));
+  stats.physicalBufferCount = static_cast<std::uint32_t>(std::ranges::count_if(
+    bufferPool, [](const PooledBuffer& entry) { return entry.usedThisFrame; }));
+}
+
+void RenderGraph::recordBarriers(vk::CommandBuffer cmd_buf, const Pass& pass)
+{
+  // etna tracks image states itself, it only has to be told what the pass needs
+  for (const auto& access : pass.imageAccesses)
+    etna::set_state(
+      cmd_buf,
+      getVkImage({access.image}),
+      access.usage.stages,
+      access.usage.access,
+      access.usage.layout,
+      access.usage.aspect);
+
+  // All buffer hazards of the pass are merged into a single global memory barrier
+  vk::MemoryBarrier2 bufferBarrier{};
+  for (const auto& access : pass.bufferAccesses)
+  {
+    auto& state = getBufferState(access.buffer);
+    const auto& usage = access.usage;
+
+    if (access.write)
+    {
+      if (state.lastWrite.stages || state.reads.stages)
+      {
+        bufferBarrier.srcStageMask |= state.lastWrite.stages | state.reads.stages;
+        bufferBarrier.srcAccessMask |= state.lastWrite.access;
+        bufferBarrier.dstStageMask |= usage.stages;
+        bufferBarrier.dstAccessMask |= usage.access;
+      }
+      state.lastWrite = usage;
+      state.reads = {};
+      continue;
+    }
+
+    const bool alreadyVisible = (state.reads.stages & usage.stages) == usage.stages &&
+      (state.reads.access & usage.access) == usage.access;
+    if (state.lastWrite.stages && !alreadyVisible)
+    {
+      bufferBarrier.srcStageMask |= state.lastWrite.stages;
+      bufferBarrier.srcAccessMask |= state.lastWrite.access;
+      bufferBarrier.dstStageMask |= usage.stages;
+      bufferBarrier.dstAccessMask |= usage.access;
+    }
+    state.reads.stages |= usage.stages;
+    state.reads.access |= usage.access;
+  }
+
+  if (bufferBarrier.srcStageMask)
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &bufferBarrier,
+    });
+
+  etna::flush_barriers(cmd_buf);
+}
+
+void RenderGraph::execute(vk::CommandBuffer cmd_buf)
+{
+  stats = {};
+
+  cullPasses();
+  computeLifetimes();
+  allocateTransients();
+
+  for (const auto& pass : passes)
+  {
+    if (!pass.alive)
+    {
+      stats.culledPasses.push_back(pass.name);
+      continue;
+    }
+
+    ++stats.passCount;
+    recordBarriers(cmd_buf, pass);
+    pass.execute(cmd_buf, *this);
+  }
+
+  releaseUnusedPoolEntries();
+  reset();
+  ++frameIndex;
+}
+
+void RenderGraph::releaseUnusedPoolEntries()
+{
+  // Frames still in flight might be using an entry even if the current one doesn't
+  const std::uint64_t keepFrames =
+    etna::get_context().getMainWorkCount().multiBufferingCount() + 1;
+
+  std::erase_if(imagePool, [this, keepFrames](const PooledImage& entry) {
+    return entry.lastUsedFrame + keepFrames < frameIndex;
+  });
+  std::erase_if(bufferPool, [this, keepFrames](const PooledBuffer& entry) {
+    return entry.lastUsedFrame + keepFrames < frameIndex;
+  });
+}
+
+void RenderGraph::reset()
+{
+  passes.clear();
+  images.clear();
+  buffers.clear();
+  imagePlacement.clear();
+  bufferPlacement.clear();
+}
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Image.hpp>
+#include <etna/Buffer.hpp>
+
+
+/**
+ * Frame graph: passes declare which images and buffers they read and write,
+ * and the graph takes care of the rest.
+ *  - Barriers and layout transitions of a pass are issued as a single batch before it.
+ *  - Passes whose results are never consumed by a pass with side effects are culled.
+ *  - Transient resources live only within the frame and are taken from a pool. Resources
+ *    with identical descriptions whose lifetimes don't overlap share the same memory.
+ * The graph is rebuilt every frame, only the pool persists between frames.
+ * Passes are executed in the order they were added. Execute functions are only
+ * called from execute(), so they may reference locals of the function that builds
+ * the graph, as long as that same function executes it.
+ */
+class RenderGraph
+{
+public:
+  struct ImageHandle
+  {
+    std::uint32_t index = ~0u;
+  };
+
+  struct BufferHandle
+  {
+    std::uint32_t index = ~0u;
+  };
+
+  struct ImageDesc
+  {
+    vk::Extent2D extent;
+    vk::Format format;
+    vk::ImageUsageFlags usage;
+
+    bool operator==(const ImageDesc&) const = default;
+  };
+
+  struct BufferDesc
+  {
+    vk::DeviceSize size;
+    vk::BufferUsageFlags usage;
+  };
+
+  struct ImageUsage
+  {
+    vk::PipelineStageFlags2 stages;
+    vk::AccessFlags2 access;
+    vk::ImageLayout layout;
+    vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor;
+  };
+
+  struct BufferUsage
+  {
+    vk::PipelineStageFlags2 stages;
+    vk::AccessFlags2 access;
+  };
+
+  static ImageUsage colorAttachment();
+  static ImageUsage depthAttachment();
+  static ImageUsage sampled(
+    vk::PipelineStageFlags2 stages, vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor);
+  static ImageUsage storageImage(vk::PipelineStageFlags2 stages, bool write);
+  static BufferUsage storageBuffer(vk::PipelineStageFlags2 stages, bool write);
+
+  class PassBuilder
+  {
+  public:
+    // The image only exists while it's used by this and later passes of the current frame.
+    // Contents are undefined until the pass writes them.
+    ImageHandle createImage(std::string name, const ImageDesc& desc, const ImageUsage& usage);
+    BufferHandle createBuffer(std::string name, const BufferDesc& desc, const BufferUsage& usage);
+
+    void read(ImageHandle image, const ImageUsage& usage);
+    void write(ImageHandle image, const ImageUsage& usage);
+    void read(BufferHandle buffer, const BufferUsage& usage);
+    void write(BufferHandle buffer, const BufferUsage& usage);
+
+    // Passes with side effects (presenting, reading data back to the CPU) are never culled
+    void hasSideEffects();
+
+  private:
+    friend class RenderGraph;
+    PassBuilder(RenderGraph& graph, std::uint32_t pass);
+
+    RenderGraph& graph;
+    std::uint32_t pass;
+  };
+
+  using SetupFunction = std::function<void(PassBuilder&)>;
+  using ExecuteFunction = std::function<void(vk::CommandBuffer, const RenderGraph&)>;
+
+  struct Stats
+  {
+    std::uint32_t passCount = 0;
+    std::vector<std::string> culledPasses;
+    std::uint32_t transientImageCount = 0;
+    std::uint32_t physicalImageCount = 0;
+    std::uint32_t transientBufferCount = 0;
+    std::uint32_t physicalBufferCount = 0;
+  };
+
+  RenderGraph() = default;
+  RenderGraph(const RenderGraph&) = delete;
+  RenderGraph& operator=(const RenderGraph&) = delete;
+
+  // Imported resources outlive the frame, the graph only synchronizes access to them
+  ImageHandle importImage(std::string name, const etna::Image& image);
+  ImageHandle importImage(std::string name, vk::Image image);
+  BufferHandle importBuffer(std::string name, const etna::Buffer& buffer);
+
+  // The setup function is called immediately
+  void addPass(std::string name, const SetupFunction& setup, ExecuteFunction execute);
+
+  // Records all passes that survived culling and resets the graph for the next frame
+  void execute(vk::CommandBuffer cmd_buf);
+
+  // Only valid inside of the execute functions of passes
+  const etna::Image& getImage(ImageHandle image) const;
+  vk::Image getVkImage(ImageHandle image) const;
+  const etna::Buffer& getBuffer(BufferHandle buffer) const;
+
+  // Of the last executed frame
+  const Stats& getStats() const { return stats; }
+
+private:
+  struct ImageAccess
+  {
+    std::uint32_t image;
+    ImageUsage usage;
+    bool write;
+  };
+
+  struct BufferAccess
+  {
+    std::uint32_t buffer;
+    BufferUsage usage;
+    bool write;
+  };
+
+  struct Pass
+  {
+    std::string name;
+    ExecuteFunction execute;
+    std::vector<ImageAccess> imageAccesses;
+    std::vector<BufferAccess> bufferAccesses;
+    bool sideEffects = false;
+    bool alive = false;
+  };
+
+  struct ImageResource
+  {
+    std::string name;
+    bool transient = false;
+    ImageDesc desc{};
+    vk::Image importedImage{};
+    const etna::Image* etnaImage = nullptr;
+    // Live pass range, filled during compilation
+    std::uint32_t firstPass = ~0u;
+    std::uint32_t lastPass = 0;
+  };
+
+  // Buffers are not tracked by etna, so the graph remembers the previous access itself
+  struct BufferState
+  {
+    // Empty stages mean no write happened yet
+    BufferUsage lastWrite{};
+    // All reads since the last write
+    BufferUsage reads{};
+  };
+
+  struct BufferResource
+  {
+    std::string name;
+    bool transient = false;
+    BufferDesc desc{};
+    const etna::Buffer* importedBuffer = nullptr;
+    std::uint32_t firstPass = ~0u;
+    std::uint32_t lastPass = 0;
+    // Accesses from before the frame are synchronized by the owner of an imported buffer
+    BufferState importedState{};
+  };
+
+  struct PooledImage
+  {
+    ImageDesc desc;
+    etna::Image image;
+    std::uint64_t lastUsedFrame = 0;
+    // Within the current frame, the last pass of the latest resource placed into the image
+    std::uint32_t busyUntilPass = 0;
+    bool usedThisFrame = false;
+  };
+
+  struct PooledBuffer
+  {
+    BufferDesc desc;
+    etna::Buffer buffer;
+    std::uint64_t lastUsedFrame = 0;
+    std::uint32_t busyUntilPass = 0;
+    bool usedThisFrame = false;
+    // Persists between frames and resources placed into the buffer
+    BufferState state{};
+  };
+
+  BufferState& getBufferState(std::uint32_t buffer);
+
+  void cullPasses();
+  void computeLifetimes();
+  void allocateTransients();
+  void recordBarriers(vk::CommandBuffer cmd_buf, const Pass& pass);
+  void reset();
+  void releaseUnusedPoolEntries();
+
+private:
+  std::vector<Pass> passes;
+  std::vector<ImageResource> images;
+  std::vector<BufferResource> buffers;
+
+  std::vector<PooledImage> imagePool;
+  std::vector<PooledBuffer> bufferPool;
+  // Index into the pool for every transient resource of the current frame
+  std::vector<std::uint32_t> imagePlacement;
+  std::vector<std::uint32_t> bufferPlacement;
+
+  std::uint64_t frameIndex = 0;
+  Stats stats;
+};
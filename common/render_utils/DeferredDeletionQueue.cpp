@@ -0,0 +1,16 @@
+#include "DeferredDeletionQueue.hpp"
+
+#include <etna/GlobalContext.hpp>
+
+
+void DeferredDeletionQueue::beginFrame()
+{
+  ++frameIndex;
+
+  // Same margin as the frame graph's resource pool
+  const std::uint64_t keepFrames =
+    etna::get_context().getMainWorkCount().multiBufferingCount() + 1;
+
+  while (!entries.empty() && entries.front().retiredFrame + keepFrames < frameIndex)
+    entries.pop_front();
+}
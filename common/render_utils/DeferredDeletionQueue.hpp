@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+
+/**
+ * Keeps objects that were replaced while the GPU might still be using them,
+ * e.g. pipelines for a previous swapchain format, alive until every frame that was in
+ * flight at the time of replacement is done. Nothing has to wait for the device to idle.
+ */
+class DeferredDeletionQueue
+{
+public:
+  template <class T>
+  void retire(T&& object)
+  {
+    entries.push_back(Entry{
+      .retiredFrame = frameIndex,
+      .object = std::make_shared<std::decay_t<T>>(std::forward<T>(object)),
+    });
+  }
+
+  // Must be called at the start of every frame, after the fence of the
+  // previous usage of this frame slot was waited upon.
+  void beginFrame();
+
+private:
+  struct Entry
+  {
+    std::uint64_t retiredFrame;
+    // Type-erased, the deleter of the actual type is captured on creation
+    std::shared_ptr<void> object;
+  };
+
+  std::deque<Entry> entries;
+  std::uint64_t frameIndex = 0;
+};
@@ -0,0 +1,86 @@
+#include "DeviceProbe.hpp"
+
+#include <algorithm>
+
+#include <etna/Assert.hpp>
+#include <spdlog/spdlog.h>
+
+
+static int device_type_rank(vk::PhysicalDeviceType type)
+{
+  switch (type)
+  {
+  case vk::PhysicalDeviceType::eDiscreteGpu:
+    return 2;
+  case vk::PhysicalDeviceType::eIntegratedGpu:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+bool DeviceProbe::hasExtension(std::string_view name) const
+{
+  return std::find(extensions.begin(), extensions.end(), name) != extensions.end();
+}
+
+DeviceProbe DeviceProbe::probe(
+  std::span<const char* const> required_extensions, std::optional<std::uint32_t> index_override)
+{
+  // Etna has not loaded Vulkan yet, and reloads it for its own instance later on
+  VULKAN_HPP_DEFAULT_DISPATCHER.init();
+
+  const vk::ApplicationInfo appInfo{
+    .pApplicationName = "DeviceProbe",
+    .apiVersion = VK_API_VERSION_1_3,
+  };
+  auto instance =
+    etna::unwrap_vk_result(vk::createInstanceUnique(vk::InstanceCreateInfo{
+      .pApplicationInfo = &appInfo,
+    }));
+  VULKAN_HPP_DEFAULT_DISPATCHER.init(instance.get());
+
+  const auto devices = etna::unwrap_vk_result(instance->enumeratePhysicalDevices());
+
+  std::optional<DeviceProbe> best;
+  int bestRank = -1;
+  for (std::uint32_t i = 0; i < devices.size(); ++i)
+  {
+    if (index_override && *index_override != i)
+      continue;
+
+    const auto& device = devices[i];
+
+    DeviceProbe candidate;
+    candidate.physicalDeviceIndex = i;
+    for (const auto& ext : etna::unwrap_vk_result(device.enumerateDeviceExtensionProperties()))
+      candidate.extensions.emplace_back(ext.extensionName.data());
+
+    const bool hasRequired =
+      std::all_of(required_extensions.begin(), required_extensions.end(), [&](const char* ext) {
+        return candidate.hasExtension(ext);
+      });
+    if (!hasRequired)
+      continue;
+
+    const auto properties = device.getProperties();
+    candidate.deviceName = properties.deviceName.data();
+
+    const auto features =
+      device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+    candidate.features = features.get<vk::PhysicalDeviceFeatures2>().features;
+    candidate.features12 = features.get<vk::PhysicalDeviceVulkan12Features>();
+    candidate.features12.pNext = nullptr;
+
+    const int rank = device_type_rank(properties.deviceType);
+    if (rank > bestRank)
+    {
+      best = std::move(candidate);
+      bestRank = rank;
+    }
+  }
+
+  ETNA_VERIFYF(best, "No suitable Vulkan device found!");
+  spdlog::info("Using '{}'", best->deviceName);
+  return std::move(*best);
+}
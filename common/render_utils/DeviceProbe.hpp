@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+
+
+/**
+ * Picks a physical device and queries what it supports before etna creates the
+ * logical device. Device creation fails if any of the requested features is missing,
+ * so optional ones have to be checked up front. Pass the index on to etna, so that
+ * it uses the same device.
+ */
+struct DeviceProbe
+{
+  std::uint32_t physicalDeviceIndex = 0;
+  std::string deviceName;
+  vk::PhysicalDeviceFeatures features{};
+  vk::PhysicalDeviceVulkan12Features features12{};
+  std::vector<std::string> extensions;
+
+  bool hasExtension(std::string_view name) const;
+
+  // Devices without all of the required extensions are skipped. Discrete GPUs are
+  // preferred over integrated ones, and those over everything else, e.g. CPU implementations.
+  static DeviceProbe probe(
+    std::span<const char* const> required_extensions,
+    std::optional<std::uint32_t> index_override = std::nullopt);
+};
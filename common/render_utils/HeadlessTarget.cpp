@@ -0,0 +1,224 @@
+#include "HeadlessTarget.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include <etna/Assert.hpp>
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <etna/Profiling.hpp>
+#include <spdlog/spdlog.h>
+#include <stb_image_write.h>
+
+
+namespace
+{
+
+std::uint32_t find_readback_memory_type(std::uint32_t type_bits)
+{
+  const auto props = etna::get_context().getPhysicalDevice().getMemoryProperties();
+
+  const vk::MemoryPropertyFlags required =
+    vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+  // Cached memory makes reading on the CPU way faster, but is not available everywhere
+  const vk::MemoryPropertyFlags cached = required | vk::MemoryPropertyFlagBits::eHostCached;
+  for (vk::MemoryPropertyFlags flags : {cached, required})
+    for (std::uint32_t i = 0; i < props.memoryTypeCount; ++i)
+      if ((type_bits & (1u << i)) != 0 && (props.memoryTypes[i].propertyFlags & flags) == flags)
+        return i;
+
+  ETNA_VERIFYF(false, "No host coherent memory to read frame captures back with");
+  return 0;
+}
+
+} // namespace
+
+std::optional<std::uint32_t> parse_uint(const char* str)
+{
+  std::uint32_t value = 0;
+  const char* end = str + std::strlen(str);
+  auto [ptr, ec] = std::from_chars(str, end, value);
+  if (ec != std::errc{} || ptr != end)
+    return std::nullopt;
+  return value;
+}
+
+std::optional<HeadlessOptions> HeadlessOptions::parse(int argc, char** argv)
+{
+  HeadlessOptions options;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!options.parseArgument(argc, argv, i))
+    {
+      spdlog::error("Unknown or incomplete argument '{}'", argv[i]);
+      return std::nullopt;
+    }
+  }
+
+  if (!options.validate())
+    return std::nullopt;
+
+  return options;
+}
+
+bool HeadlessOptions::parseArgument(int argc, char** argv, int& i)
+{
+  const std::string_view arg = argv[i];
+  const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+  if (arg == "--headless")
+    enabled = true;
+  else if (arg == "--frames" && value != nullptr && parse_uint(value))
+  {
+    frameCount = *parse_uint(value);
+    ++i;
+  }
+  else if (arg == "--capture" && value != nullptr && parse_uint(value))
+  {
+    captureFrames.push_back(*parse_uint(value));
+    ++i;
+  }
+  else if (arg == "--output" && value != nullptr)
+  {
+    outputDir = value;
+    ++i;
+  }
+  else
+    return false;
+
+  return true;
+}
+
+bool HeadlessOptions::validate() const
+{
+  if (!enabled && !captureFrames.empty())
+  {
+    spdlog::error("Frames can only be captured in headless mode");
+    return false;
+  }
+  return true;
+}
+
+std::optional<std::filesystem::path> HeadlessOptions::capturePath(std::uint32_t frame) const
+{
+  if (std::find(captureFrames.begin(), captureFrames.end(), frame) == captureFrames.end())
+    return std::nullopt;
+  return outputDir / ("frame_" + std::to_string(frame) + ".png");
+}
+
+HeadlessTarget::HeadlessTarget(vk::Extent2D target_extent)
+  : extent{target_extent}
+{
+  auto& ctx = etna::get_context();
+
+  image = ctx.createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{extent.width, extent.height, 1},
+    .name = "headless_target",
+    .format = FORMAT,
+    .imageUsage = vk::ImageUsageFlagBits::eColorAttachment |
+      vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc,
+  });
+
+  // The very first frame has no previous one, so it waits for this one instead
+  startSemaphore =
+    etna::unwrap_vk_result(ctx.getDevice().createSemaphoreUnique(vk::SemaphoreCreateInfo{}));
+  const vk::Semaphore semaphore = startSemaphore.get();
+  ETNA_CHECK_VK_RESULT(ctx.getQueue().submit(
+    {vk::SubmitInfo{.signalSemaphoreCount = 1, .pSignalSemaphores = &semaphore}}));
+  previousFrameDone = semaphore;
+}
+
+void HeadlessTarget::captureNextFrame(std::filesystem::path path)
+{
+  if (!captureBuffer)
+  {
+    auto device = etna::get_context().getDevice();
+
+    captureBuffer = etna::unwrap_vk_result(device.createBufferUnique(vk::BufferCreateInfo{
+      .size = vk::DeviceSize{extent.width} * extent.height * 4,
+      .usage = vk::BufferUsageFlagBits::eTransferDst,
+      .sharingMode = vk::SharingMode::eExclusive,
+    }));
+
+    const auto requirements = device.getBufferMemoryRequirements(captureBuffer.get());
+    captureMemory = etna::unwrap_vk_result(device.allocateMemoryUnique(vk::MemoryAllocateInfo{
+      .allocationSize = requirements.size,
+      .memoryTypeIndex = find_readback_memory_type(requirements.memoryTypeBits),
+    }));
+    ETNA_CHECK_VK_RESULT(device.bindBufferMemory(captureBuffer.get(), captureMemory.get(), 0));
+  }
+
+  capturePath = std::move(path);
+}
+
+void HeadlessTarget::recordCapture(vk::CommandBuffer cmd_buf)
+{
+  if (!capturePath)
+    return;
+
+  etna::set_state(
+    cmd_buf,
+    image.get(),
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferRead,
+    vk::ImageLayout::eTransferSrcOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+
+  cmd_buf.copyImageToBuffer(
+    image.get(),
+    vk::ImageLayout::eTransferSrcOptimal,
+    captureBuffer.get(),
+    {vk::BufferImageCopy{
+      .imageSubresource = {.aspectMask = vk::ImageAspectFlagBits::eColor, .layerCount = 1},
+      .imageExtent = vk::Extent3D{extent.width, extent.height, 1},
+    }});
+
+  // Coherent memory needs no invalidation, but the copy still has to be made available
+  const vk::MemoryBarrier2 toHost{
+    .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+    .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &toHost,
+  });
+}
+
+void HeadlessTarget::submit(etna::PerFrameCmdMgr& cmd_mgr, vk::CommandBuffer cmd_buf)
+{
+  previousFrameDone = cmd_mgr.submit(std::move(cmd_buf), previousFrameDone);
+
+  if (capturePath)
+    writeCapture();
+}
+
+void HeadlessTarget::writeCapture()
+{
+  ZoneScoped;
+
+  auto device = etna::get_context().getDevice();
+
+  // Captures are rare, so simply waiting for the frame is fine
+  ETNA_CHECK_VK_RESULT(device.waitIdle());
+
+  const void* pixels =
+    etna::unwrap_vk_result(device.mapMemory(captureMemory.get(), 0, VK_WHOLE_SIZE));
+  const int width = static_cast<int>(extent.width);
+  const int height = static_cast<int>(extent.height);
+  const bool written =
+    stbi_write_png(capturePath->string().c_str(), width, height, 4, pixels, width * 4) != 0;
+  device.unmapMemory(captureMemory.get());
+
+  if (written)
+    spdlog::info("Captured a frame into '{}'", capturePath->string());
+  else
+    spdlog::error("Failed to write a frame capture into '{}'", capturePath->string());
+
+  capturePath.reset();
+}
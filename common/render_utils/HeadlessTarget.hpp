@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+#include <etna/Image.hpp>
+#include <etna/PerFrameCmdMgr.hpp>
+#include <etna/Vulkan.hpp>
+
+
+// Empty unless the whole string is a non-negative number, for parsing command lines
+std::optional<std::uint32_t> parse_uint(const char* str);
+
+// Command line options of headless rendering, shared by all apps that support it
+struct HeadlessOptions
+{
+  // Renders offscreen without a window or a swapchain, e.g. on CI machines
+  bool enabled = false;
+  // The app exits after rendering this many frames
+  std::uint32_t frameCount = 100;
+  // These frames are written into outputDir as PNG files
+  std::vector<std::uint32_t> captureFrames;
+  std::filesystem::path outputDir = ".";
+
+  // Parses "--headless [--frames N] [--capture FRAME]... [--output DIR]", empty on errors
+  static std::optional<HeadlessOptions> parse(int argc, char** argv);
+
+  // For apps with options of their own. Consumes argv[i] and its value if it is one of
+  // the above, leaving i at the last consumed argument. Returns false if it is not.
+  bool parseArgument(int argc, char** argv, int& i);
+  // Logs and returns false if the options contradict each other
+  bool validate() const;
+
+  // Empty unless the frame is to be captured
+  std::optional<std::filesystem::path> capturePath(std::uint32_t frame) const;
+};
+
+/**
+ * Stands in for etna::Window when rendering without a window or a swapchain.
+ * Frames are rendered into an offscreen image, which supports the same usages
+ * as a swapchain image, and any of them can be written into a PNG file.
+ */
+class HeadlessTarget
+{
+public:
+  // An sRGB format, just like the swapchain, so that captures look the same as the window
+  static constexpr vk::Format FORMAT = vk::Format::eR8G8B8A8Srgb;
+
+  explicit HeadlessTarget(vk::Extent2D extent);
+
+  HeadlessTarget(const HeadlessTarget&) = delete;
+  HeadlessTarget& operator=(const HeadlessTarget&) = delete;
+
+  const etna::Image& getImage() const { return image; }
+
+  // Writes the next submitted frame into a PNG file
+  void captureNextFrame(std::filesystem::path path);
+
+  // Must be recorded last, once everything was rendered into the image
+  void recordCapture(vk::CommandBuffer cmd_buf);
+
+  // Etna's per-frame semaphores have to be waited upon, so every frame waits for
+  // the previous one. Waits for the frame and writes the capture if one was requested.
+  void submit(etna::PerFrameCmdMgr& cmd_mgr, vk::CommandBuffer cmd_buf);
+
+private:
+  void writeCapture();
+
+private:
+  vk::Extent2D extent;
+  etna::Image image;
+
+  vk::UniqueSemaphore startSemaphore;
+  vk::Semaphore previousFrameDone;
+
+  std::optional<std::filesystem::path> capturePath;
+  // Host coherent, so that nothing has to be invalidated before reading it back.
+  // Allocated manually, as etna buffers don't let us choose the memory type.
+  vk::UniqueBuffer captureBuffer;
+  vk::UniqueDeviceMemory captureMemory;
+};
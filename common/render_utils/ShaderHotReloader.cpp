@@ -0,0 +1,81 @@
+#include "ShaderHotReloader.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <utility>
+
+#include <etna/Profiling.hpp>
+#include <spdlog/spdlog.h>
+
+
+ShaderHotReloader::ShaderHotReloader(CreateInfo create_info)
+  : info{std::move(create_info)}
+  , worker{[this](std::stop_token stop) { run(stop); }}
+{
+}
+
+void ShaderHotReloader::requestRebuild()
+{
+  {
+    std::lock_guard lock{mutex};
+    rebuildRequested = true;
+  }
+  wakeUp.notify_one();
+}
+
+void ShaderHotReloader::run(std::stop_token stop)
+{
+  auto lastSeen = latestWriteTime();
+  while (!stop.stop_requested())
+  {
+    bool requested;
+    {
+      std::unique_lock lock{mutex};
+      wakeUp.wait_for(lock, stop, info.pollInterval, [this] { return rebuildRequested; });
+      requested = std::exchange(rebuildRequested, false);
+    }
+
+    if (stop.stop_requested())
+      break;
+
+    // Sampled before building, so edits made during the build trigger another one
+    const auto latest = latestWriteTime();
+    if (!requested && latest <= lastSeen)
+      continue;
+    lastSeen = latest;
+
+    ZoneScopedN("compileShaders");
+    building = true;
+    spdlog::info("Recompiling shaders in the background...");
+    const int retval = std::system(info.buildCommand.c_str());
+    building = false;
+
+    if (retval != 0)
+      spdlog::warn("Shader recompilation returned a non-zero return code!");
+    else
+      buildFinished = true;
+  }
+}
+
+std::filesystem::file_time_type ShaderHotReloader::latestWriteTime() const
+{
+  auto latest = std::filesystem::file_time_type::min();
+
+  // Files may be replaced by editors while we iterate, so errors are simply skipped
+  for (const auto& dir : info.watchedDirectories)
+  {
+    std::error_code ec;
+    std::filesystem::recursive_directory_iterator it(dir, ec);
+    for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+    {
+      std::error_code fileEc;
+      if (!it->is_regular_file(fileEc) || it->path().extension() == ".spv")
+        continue;
+      const auto time = it->last_write_time(fileEc);
+      if (!fileEc)
+        latest = std::max(latest, time);
+    }
+  }
+
+  return latest;
+}
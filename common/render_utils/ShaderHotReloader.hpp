@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/**
+ * Watches shader sources and recompiles them on a background thread, so
+ * that rendering goes on while the compiler runs. The render thread only
+ * has to pick the new binaries up at a frame boundary once a build is done.
+ * Includes are watched as long as they live in one of the watched directories.
+ */
+class ShaderHotReloader
+{
+public:
+  struct CreateInfo
+  {
+    std::vector<std::filesystem::path> watchedDirectories;
+    // Compiles the shaders, is run on the background thread
+    std::string buildCommand;
+    std::chrono::milliseconds pollInterval{500};
+  };
+
+  explicit ShaderHotReloader(CreateInfo info);
+
+  // Rebuilds shaders even if nothing has changed on disk
+  void requestRebuild();
+
+  // Returns true once per successful build, the caller should reload shaders right away
+  bool consumeFinishedBuild() { return buildFinished.exchange(false); }
+
+  bool isBuilding() const { return building; }
+
+private:
+  void run(std::stop_token stop);
+  std::filesystem::file_time_type latestWriteTime() const;
+
+private:
+  CreateInfo info;
+
+  std::mutex mutex;
+  std::condition_variable_any wakeUp;
+  bool rebuildRequested = false;
+
+  std::atomic<bool> building = false;
+  std::atomic<bool> buildFinished = false;
+
+  // Declared last, so that the thread starts after everything else is initialized
+  // and is joined before anything else is destroyed
+  std::jthread worker;
+};
@@ -0,0 +1,192 @@
+#include "ShaderPermutations.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+#include <etna/Assert.hpp>
+#include <etna/Etna.hpp>
+#include <etna/Profiling.hpp>
+
+
+namespace
+{
+
+constexpr std::uint32_t SPIRV_MAGIC = 0x07230203;
+constexpr std::size_t SPIRV_HEADER_WORDS = 5;
+
+constexpr std::uint32_t OP_SPEC_CONSTANT_TRUE = 48;
+constexpr std::uint32_t OP_SPEC_CONSTANT_FALSE = 49;
+constexpr std::uint32_t OP_SPEC_CONSTANT = 50;
+constexpr std::uint32_t OP_DECORATE = 71;
+constexpr std::uint32_t DECORATION_SPEC_ID = 1;
+
+std::vector<std::uint32_t> read_spirv(const std::filesystem::path& path)
+{
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  ETNA_VERIFYF(file, "Failed to open shader '{}'", path.string());
+
+  const auto size = static_cast<std::size_t>(file.tellg());
+  ETNA_VERIFYF(size % sizeof(std::uint32_t) == 0, "'{}' is not a SPIR-V binary", path.string());
+
+  std::vector<std::uint32_t> words(size / sizeof(std::uint32_t));
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(words.data()), static_cast<std::streamsize>(size));
+  ETNA_VERIFYF(
+    file && words.size() > SPIRV_HEADER_WORDS && words[0] == SPIRV_MAGIC,
+    "'{}' is not a SPIR-V binary",
+    path.string());
+
+  return words;
+}
+
+void patch_spec_constants(
+  std::vector<std::uint32_t>& spirv, std::span<const ShaderPermutations::Constant> constants)
+{
+  // Maps result IDs to constant_id. Annotations always precede
+  // the constants in a module, so a single pass is enough.
+  std::unordered_map<std::uint32_t, std::uint32_t> specIds;
+
+  for (std::size_t i = SPIRV_HEADER_WORDS; i < spirv.size();)
+  {
+    const std::uint32_t wordCount = spirv[i] >> 16;
+    const std::uint32_t opcode = spirv[i] & 0xFFFF;
+    ETNA_VERIFYF(wordCount > 0 && i + wordCount <= spirv.size(), "Malformed SPIR-V");
+
+    if (opcode == OP_DECORATE && wordCount >= 4 && spirv[i + 2] == DECORATION_SPEC_ID)
+      specIds[spirv[i + 1]] = spirv[i + 3];
+
+    const bool isSpecConstant = opcode == OP_SPEC_CONSTANT_TRUE ||
+      opcode == OP_SPEC_CONSTANT_FALSE || opcode == OP_SPEC_CONSTANT;
+    if (isSpecConstant && wordCount >= 3)
+    {
+      const auto specId = specIds.find(spirv[i + 2]);
+      const auto constant = specId == specIds.end()
+        ? constants.end()
+        : std::find_if(constants.begin(), constants.end(), [&specId](const auto& c) {
+            return c.id == specId->second;
+          });
+
+      if (constant != constants.end() && opcode == OP_SPEC_CONSTANT)
+      {
+        ETNA_VERIFYF(wordCount == 4, "64-bit specialization constants are not supported");
+        spirv[i + 3] = constant->value;
+      }
+      else if (constant != constants.end())
+      {
+        // Booleans carry their value in the opcode
+        const std::uint32_t newOpcode =
+          constant->value != 0 ? OP_SPEC_CONSTANT_TRUE : OP_SPEC_CONSTANT_FALSE;
+        spirv[i] = (wordCount << 16) | newOpcode;
+      }
+    }
+
+    i += wordCount;
+  }
+}
+
+void create_etna_program(const std::string& name, const std::vector<std::filesystem::path>& paths)
+{
+  // etna::create_program takes a braced list of shaders, so the stage count has to be spelled out
+  ETNA_VERIFYF(
+    paths.size() >= 1 && paths.size() <= 3, "Unsupported stage count in program '{}'", name);
+  if (paths.size() == 1)
+    etna::create_program(name.c_str(), {paths[0]});
+  else if (paths.size() == 2)
+    etna::create_program(name.c_str(), {paths[0], paths[1]});
+  else
+    etna::create_program(name.c_str(), {paths[0], paths[1], paths[2]});
+}
+
+std::string make_program_name(
+  std::string_view name, std::span<const ShaderPermutations::Constant> constants)
+{
+  std::string programName{name};
+  programName += '<';
+  for (std::size_t i = 0; i < constants.size(); ++i)
+  {
+    if (i > 0)
+      programName += ',';
+    programName += std::to_string(constants[i].id) + '=' + std::to_string(constants[i].value);
+  }
+  programName += '>';
+  return programName;
+}
+
+} // namespace
+
+void ShaderPermutations::addProgram(
+  std::string name, std::vector<std::filesystem::path> shader_paths)
+{
+  ETNA_VERIFYF(!programs.contains(name), "Program '{}' is already registered", name);
+  programs.emplace(std::move(name), Program{std::move(shader_paths), {}});
+}
+
+const std::string& ShaderPermutations::getProgram(
+  std::string_view name, std::span<const Constant> constants)
+{
+  auto programIt = programs.find(std::string{name});
+  ETNA_VERIFYF(programIt != programs.end(), "Program '{}' is not registered", name);
+  auto& program = programIt->second;
+
+  std::vector<Constant> sorted(constants.begin(), constants.end());
+  std::sort(sorted.begin(), sorted.end(), [](const Constant& a, const Constant& b) {
+    return a.id < b.id;
+  });
+
+  // There are only a handful of permutations per program
+  for (const auto& permutation : program.permutations)
+    if (permutation.constants == sorted)
+      return permutation.programName;
+
+  ZoneScoped;
+
+  auto programName = make_program_name(name, sorted);
+
+  auto& permutation = program.permutations.emplace_back(Permutation{
+    .constants = std::move(sorted),
+    .programName = std::move(programName),
+    .shaderPaths = {},
+  });
+
+  const auto index = program.permutations.size() - 1;
+  for (const auto& path : program.shaderPaths)
+  {
+    auto patchedPath = path;
+    patchedPath.replace_extension(
+      "." + programIt->first + "." + std::to_string(index) + path.extension().string());
+    permutation.shaderPaths.push_back(std::move(patchedPath));
+  }
+
+  writePermutation(program, permutation);
+  create_etna_program(permutation.programName, permutation.shaderPaths);
+
+  return permutation.programName;
+}
+
+void ShaderPermutations::reload()
+{
+  ZoneScoped;
+
+  // Etna reloads every program from the paths it was created with, i.e. the patched copies
+  for (const auto& entry : programs)
+    for (const auto& permutation : entry.second.permutations)
+      writePermutation(entry.second, permutation);
+  etna::reload_shaders();
+}
+
+void ShaderPermutations::writePermutation(
+  const Program& program, const Permutation& permutation)
+{
+  // Shaders without specialization constants are copied as is, which keeps reloading simple
+  for (std::size_t i = 0; i < program.shaderPaths.size(); ++i)
+  {
+    auto spirv = read_spirv(program.shaderPaths[i]);
+    patch_spec_constants(spirv, permutation.constants);
+
+    std::ofstream file(permutation.shaderPaths[i], std::ios::binary | std::ios::trunc);
+    file.write(
+      reinterpret_cast<const char*>(spirv.data()),
+      static_cast<std::streamsize>(spirv.size() * sizeof(std::uint32_t)));
+    ETNA_VERIFYF(file, "Failed to write '{}'", permutation.shaderPaths[i].string());
+  }
+}
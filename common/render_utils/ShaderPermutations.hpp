@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+ * Creates permutations of shader programs that differ in the values of their
+ * specialization constants. Etna neither accepts VkSpecializationInfo nor gives
+ * access to the shader stages of its pipelines, so instead the default values
+ * of the constants are patched right in the SPIR-V, and every permutation is
+ * registered as a separate etna program. Drivers fold specialization constants
+ * like regular ones, so options that are fixed per frame cost no branches.
+ * Permutations are created on first use, only the ones actually used are ever compiled.
+ * Programs without any constants can be registered too, so that they get reloaded the same way.
+ */
+class ShaderPermutations
+{
+public:
+  struct Constant
+  {
+    // constant_id from the GLSL source
+    std::uint32_t id;
+    // Booleans are 0 or 1, floats have to be bit-casted
+    std::uint32_t value;
+
+    bool operator==(const Constant&) const = default;
+  };
+
+  // Shader paths point to SPIR-V binaries, just like for etna::create_program
+  void addProgram(std::string name, std::vector<std::filesystem::path> shader_paths);
+
+  bool hasProgram(std::string_view name) const { return programs.contains(std::string{name}); }
+
+  // Name of the etna program with the constants baked in, which can be used as a key
+  // to look up pipelines. Constants that aren't mentioned keep their default values.
+  const std::string& getProgram(std::string_view name, std::span<const Constant> constants);
+  const std::string& getProgram(std::string_view name) { return getProgram(name, {}); }
+
+  // Patches freshly compiled binaries and reloads all etna programs and pipelines in place.
+  // Names stay the same, but nothing may be in flight on the GPU.
+  void reload();
+
+private:
+  struct Permutation
+  {
+    std::vector<Constant> constants;
+    std::string programName;
+    std::vector<std::filesystem::path> shaderPaths;
+  };
+
+  struct Program
+  {
+    std::vector<std::filesystem::path> shaderPaths;
+    // Names of permutations are handed out by reference, so they must not move
+    std::deque<Permutation> permutations;
+  };
+
+  void writePermutation(const Program& program, const Permutation& permutation);
+
+private:
+  std::unordered_map<std::string, Program> programs;
+};
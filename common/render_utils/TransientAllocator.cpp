@@ -0,0 +1,67 @@
+#include "TransientAllocator.hpp"
+
+#include <algorithm>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/Assert.hpp>
+
+
+static vk::DeviceSize align_up(vk::DeviceSize value, vk::DeviceSize alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+TransientAllocator::TransientAllocator(CreateInfo info)
+  : sizePerFrame{info.sizePerFrame}
+{
+  auto& ctx = etna::get_context();
+
+  const auto& limits = ctx.getPhysicalDevice().getProperties().limits;
+  minAlignment = std::max(
+    {limits.minUniformBufferOffsetAlignment,
+     limits.minStorageBufferOffsetAlignment,
+     vk::DeviceSize{16}});
+
+  // Every region has to start at an aligned offset as well
+  sizePerFrame = align_up(sizePerFrame, minAlignment);
+
+  buffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizePerFrame * ctx.getMainWorkCount().multiBufferingCount(),
+    .bufferUsage = info.bufferUsage,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+    .name = info.name,
+  });
+  buffer.map();
+}
+
+void TransientAllocator::beginFrame()
+{
+  regionBegin = sizePerFrame * etna::get_context().getMainWorkCount().currentResource();
+  cursor = regionBegin;
+  frameStarted = true;
+}
+
+TransientAllocator::Allocation TransientAllocator::allocate(
+  vk::DeviceSize size, vk::DeviceSize alignment)
+{
+  ETNA_VERIFYF(frameStarted, "TransientAllocator::beginFrame was not called!");
+
+  // Empty bindings are not allowed, so even empty allocations take some space
+  const vk::DeviceSize offset = align_up(cursor, std::max(alignment, minAlignment));
+  const vk::DeviceSize alignedSize = align_up(std::max(size, vk::DeviceSize{1}), minAlignment);
+  ETNA_VERIFYF(
+    offset + alignedSize <= regionBegin + sizePerFrame,
+    "Transient memory exhausted, {} of {} bytes are used this frame, {} more were requested",
+    cursor - regionBegin,
+    sizePerFrame,
+    size);
+
+  cursor = offset + alignedSize;
+
+  return Allocation{
+    .buffer = &buffer,
+    .offset = offset,
+    .size = alignedSize,
+    .data = buffer.data() + offset,
+  };
+}
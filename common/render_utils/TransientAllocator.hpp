@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstring>
+#include <span>
+#include <type_traits>
+
+#include <etna/Buffer.hpp>
+
+
+/**
+ * Linear allocator for data that only lives for a single frame: uniforms, instance
+ * arrays, light lists, indirect arguments and so on. A single persistently mapped
+ * buffer is split into one region per frame in flight, allocations are bumped
+ * from the region of the current frame, and the whole region is recycled when
+ * the frame slot comes around again, i.e. once its fence was waited upon.
+ * Nothing is ever written to memory the GPU might still be reading.
+ */
+class TransientAllocator
+{
+public:
+  struct CreateInfo
+  {
+    vk::DeviceSize sizePerFrame;
+    vk::BufferUsageFlags bufferUsage;
+    const char* name;
+  };
+
+  struct Allocation
+  {
+    const etna::Buffer* buffer = nullptr;
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize size = 0;
+    std::byte* data = nullptr;
+
+    etna::BufferBinding genBinding() const { return buffer->genBinding(offset, size); }
+  };
+
+  explicit TransientAllocator(CreateInfo info);
+
+  // Must be called at the start of every frame, after the fence of the
+  // previous usage of this frame slot was waited upon.
+  void beginFrame();
+
+  // Offset is aligned to both the requested alignment and to what
+  // uniform and storage buffer bindings require.
+  Allocation allocate(vk::DeviceSize size, vk::DeviceSize alignment = 1);
+
+  template <class T>
+    requires std::is_trivially_copyable_v<T>
+  Allocation upload(std::span<const T> data)
+  {
+    auto allocation = allocate(data.size_bytes(), alignof(T));
+    if (!data.empty())
+      std::memcpy(allocation.data, data.data(), data.size_bytes());
+    return allocation;
+  }
+
+  template <class T>
+    requires std::is_trivially_copyable_v<T>
+  Allocation upload(const T& value)
+  {
+    return upload(std::span<const T>{&value, 1});
+  }
+
+  // Bytes allocated during the current frame
+  vk::DeviceSize getUsedSize() const { return cursor - regionBegin; }
+  vk::DeviceSize getSizePerFrame() const { return sizePerFrame; }
+
+private:
+  etna::Buffer buffer;
+  vk::DeviceSize sizePerFrame;
+  vk::DeviceSize minAlignment;
+
+  vk::DeviceSize regionBegin = 0;
+  vk::DeviceSize cursor = 0;
+  bool frameStarted = false;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+
+// Axis aligned bounding box. Default-constructed boxes are empty.
+struct BoundingBox
+{
+  glm::vec3 min{std::numeric_limits<float>::max()};
+  glm::vec3 max{std::numeric_limits<float>::lowest()};
+
+  bool empty() const { return min.x > max.x; }
+
+  void extend(glm::vec3 point)
+  {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+  }
+
+  glm::vec3 corner(int idx) const
+  {
+    return {
+      (idx & 1) != 0 ? max.x : min.x,
+      (idx & 2) != 0 ? max.y : min.y,
+      (idx & 4) != 0 ? max.z : min.z,
+    };
+  }
+
+  BoundingBox transformed(const glm::mat4x4& tm) const
+  {
+    BoundingBox result;
+    if (empty())
+      return result;
+    for (int i = 0; i < 8; ++i)
+      result.extend(glm::vec3(tm * glm::vec4(corner(i), 1.0f)));
+    return result;
+  }
+
+  // Conservative test against the frustum of a projection with [0, 1] depth range.
+  // Works for perspective projections as well, unlike checking transformed bounds.
+  bool outsideFrustum(const glm::mat4x4& view_proj) const
+  {
+    if (empty())
+      return true;
+
+    std::array<glm::vec4, 8> clip;
+    for (int i = 0; i < 8; ++i)
+      clip[i] = view_proj * glm::vec4(corner(i), 1.0f);
+
+    const auto allOutside = [&clip](auto outside) {
+      for (const auto& point : clip)
+        if (!outside(point))
+          return false;
+      return true;
+    };
+
+    return allOutside([](glm::vec4 p) { return p.x > p.w; }) ||
+      allOutside([](glm::vec4 p) { return p.x < -p.w; }) ||
+      allOutside([](glm::vec4 p) { return p.y > p.w; }) ||
+      allOutside([](glm::vec4 p) { return p.y < -p.w; }) ||
+      allOutside([](glm::vec4 p) { return p.z > p.w; }) ||
+      allOutside([](glm::vec4 p) { return p.z < 0.0f; });
+  }
+};
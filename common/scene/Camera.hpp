@@ -44,4 +44,10 @@ struct Camera
   {
     return glm::perspectiveLH_ZO(-glm::radians(fov), aspect, zNear, zFar);
   }
+
+  // Shifts the whole image by jitter_ndc, used to sample different points within pixels
+  glm::mat4x4 projTm(float aspect, glm::vec2 jitter_ndc) const
+  {
+    return translate(glm::identity<glm::mat4>(), glm::vec3(jitter_ndc, 0.0f)) * projTm(aspect);
+  }
 };
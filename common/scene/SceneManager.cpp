@@ -174,6 +174,7 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
       }
     }
     result.vertices.reserve(vertexBytes / sizeof(Vertex));
+    result.positions.reserve(vertexBytes / sizeof(Vertex));
     result.indices.reserve(indexBytes / sizeof(std::uint32_t));
   }
 
@@ -310,6 +311,8 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
 
 
         vtx.positionAndNormal = glm::vec4(pos, std::bit_cast<float>(encode_normal(normal)));
+        result.positions.push_back(pos);
+        result.meshes.back().bounds.extend(pos);
         vtx.texCoordAndTangentAndPadding =
           glm::vec4(texcoord, std::bit_cast<float>(encode_normal(tangent)), 0);
 
@@ -351,23 +354,35 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
 }
 
 void SceneManager::uploadData(
-  std::span<const Vertex> vertices, std::span<const std::uint32_t> indices)
+  std::span<const Vertex> vertices,
+  std::span<const glm::vec3> positions,
+  std::span<const std::uint32_t> indices)
 {
   unifiedVbuf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
     .size = vertices.size_bytes(),
-    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst |
+      vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
     .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
     .name = "unifiedVbuf",
   });
 
+  unifiedPosVbuf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+    .size = positions.size_bytes(),
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "unifiedPosVbuf",
+  });
+
   unifiedIbuf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
     .size = indices.size_bytes(),
-    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst |
+      vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
     .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
     .name = "unifiedIbuf",
   });
 
   transferHelper.uploadBuffer<Vertex>(*oneShotCommands, unifiedVbuf, 0, vertices);
+  transferHelper.uploadBuffer<glm::vec3>(*oneShotCommands, unifiedPosVbuf, 0, positions);
   transferHelper.uploadBuffer<std::uint32_t>(*oneShotCommands, unifiedIbuf, 0, indices);
 }
 
@@ -387,13 +402,27 @@ void SceneManager::selectScene(std::filesystem::path path)
   auto [instMats, instMeshes] = processInstances(model);
   instanceMatrices = std::move(instMats);
   instanceMeshes = std::move(instMeshes);
+  instanceIsDynamic.assign(instanceMatrices.size(), false);
+  ++staticGeometryVersion;
 
-  auto [verts, inds, relems, meshs] = processMeshes(model);
+  auto [verts, poss, inds, relems, meshs] = processMeshes(model);
 
   renderElements = std::move(relems);
   meshes = std::move(meshs);
 
-  uploadData(verts, inds);
+  uploadData(verts, poss, inds);
+}
+
+void SceneManager::setInstanceMatrix(std::size_t instance_idx, const glm::mat4x4& matrix)
+{
+  instanceMatrices[instance_idx] = matrix;
+
+  // The instance was a part of the static scene until now
+  if (!instanceIsDynamic[instance_idx])
+  {
+    instanceIsDynamic[instance_idx] = true;
+    ++staticGeometryVersion;
+  }
 }
 
 etna::VertexByteStreamFormatDescription SceneManager::getVertexFormatDescription()
@@ -411,3 +440,15 @@ etna::VertexByteStreamFormatDescription SceneManager::getVertexFormatDescription
       },
     }};
 }
+
+etna::VertexByteStreamFormatDescription SceneManager::getPositionFormatDescription()
+{
+  return etna::VertexByteStreamFormatDescription{
+    .stride = sizeof(glm::vec3),
+    .attributes = {
+      etna::VertexByteStreamFormatDescription::Attribute{
+        .format = vk::Format::eR32G32B32Sfloat,
+        .offset = 0,
+      },
+    }};
+}
@@ -8,6 +8,8 @@
 #include <etna/BlockingTransferHelper.hpp>
 #include <etna/VertexInput.hpp>
 
+#include "scene/BoundingBox.hpp"
+
 
 // A single render element (relem) corresponds to a single draw call
 // of a certain pipeline with specific bindings (including material data)
@@ -27,6 +29,8 @@ struct Mesh
 {
   std::uint32_t firstRelem;
   std::uint32_t relemCount;
+  // In the mesh's local space, i.e. without the instance transform
+  BoundingBox bounds = {};
 };
 
 class SceneManager
@@ -41,16 +45,44 @@ public:
   std::span<const glm::mat4x4> getInstanceMatrices() { return instanceMatrices; }
   std::span<const std::uint32_t> getInstanceMeshes() { return instanceMeshes; }
 
+  // Instances that were moved after the scene was loaded are considered dynamic
+  // and must not be baked into any cached data, e.g. cached shadow maps.
+  void setInstanceMatrix(std::size_t instance_idx, const glm::mat4x4& matrix);
+  bool isInstanceDynamic(std::size_t instance_idx) const
+  {
+    return instanceIsDynamic[instance_idx];
+  }
+
+  // Changes every time the static part of the scene changes,
+  // so that caches depending on it know when to invalidate.
+  std::uint64_t getStaticGeometryVersion() const { return staticGeometryVersion; }
+
   // Every mesh is a collection of relems
   std::span<const Mesh> getMeshes() { return meshes; }
 
+  BoundingBox getInstanceBounds(std::size_t instance_idx) const
+  {
+    return meshes[instanceMeshes[instance_idx]].bounds.transformed(instanceMatrices[instance_idx]);
+  }
+
   // Every relem is a single draw call
   std::span<const RenderElement> getRenderElements() { return renderElements; }
 
   vk::Buffer getVertexBuffer() { return unifiedVbuf.get(); }
   vk::Buffer getIndexBuffer() { return unifiedIbuf.get(); }
 
+  // Same buffers as above, for shaders that fetch vertices manually, e.g. to
+  // reconstruct triangles from a visibility buffer. Vertices are laid out as
+  // two vec4s, see Vertex below.
+  const etna::Buffer& getVertexStorageBuffer() const { return unifiedVbuf; }
+  const etna::Buffer& getIndexStorageBuffer() const { return unifiedIbuf; }
+
+  // Tightly packed positions of the same vertices as in the vertex buffer, intended for
+  // depth-only passes which don't need any other attributes. Uses the same indexing.
+  vk::Buffer getPositionBuffer() { return unifiedPosVbuf.get(); }
+
   etna::VertexByteStreamFormatDescription getVertexFormatDescription();
+  etna::VertexByteStreamFormatDescription getPositionFormatDescription();
 
 private:
   std::optional<tinygltf::Model> loadModel(std::filesystem::path path);
@@ -76,12 +108,16 @@ private:
   struct ProcessedMeshes
   {
     std::vector<Vertex> vertices;
+    std::vector<glm::vec3> positions;
     std::vector<std::uint32_t> indices;
     std::vector<RenderElement> relems;
     std::vector<Mesh> meshes;
   };
   ProcessedMeshes processMeshes(const tinygltf::Model& model) const;
-  void uploadData(std::span<const Vertex> vertices, std::span<const std::uint32_t>);
+  void uploadData(
+    std::span<const Vertex> vertices,
+    std::span<const glm::vec3> positions,
+    std::span<const std::uint32_t>);
 
 private:
   tinygltf::TinyGLTF loader;
@@ -92,7 +128,10 @@ private:
   std::vector<Mesh> meshes;
   std::vector<glm::mat4x4> instanceMatrices;
   std::vector<std::uint32_t> instanceMeshes;
+  std::vector<bool> instanceIsDynamic;
+  std::uint64_t staticGeometryVersion = 0;
 
   etna::Buffer unifiedVbuf;
+  etna::Buffer unifiedPosVbuf;
   etna::Buffer unifiedIbuf;
 };
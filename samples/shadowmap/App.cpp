@@ -1,44 +1,85 @@
 #include "App.hpp"
 
+#include <chrono>
+#include <thread>
+
 #include <tracy/Tracy.hpp>
 
 #include "gui/ImGuiRenderer.hpp"
+#include "profiling/TraceRecorder.hpp"
+
 
+static std::uint64_t pack_resolution(glm::uvec2 res)
+{
+  return (std::uint64_t{res.x} << 32) | res.y;
+}
 
-App::App()
+static glm::uvec2 unpack_resolution(std::uint64_t packed)
+{
+  return {static_cast<std::uint32_t>(packed >> 32), static_cast<std::uint32_t>(packed)};
+}
+
+App::App(AppOptions app_options)
+  : options{std::move(app_options)}
 {
   glm::uvec2 initialRes = {1280, 720};
-  mainWindow = windowing.createWindow(OsWindow::CreateInfo{
-    .resolution = initialRes,
-    .resizeable = true,
-    .refreshCb =
-      [this]() {
-        // NOTE: this is only called when the window is being resized.
-        drawFrame();
-        FrameMark;
-      },
-    .resizeCb =
-      [this](glm::uvec2 res) {
-        if (res.x == 0 || res.y == 0)
-          return;
-
-        renderer->recreateSwapchain(res);
-      },
-  });
-
-  renderer.reset(new Renderer(initialRes));
-
-  auto instExts = windowing.getRequiredVulkanInstanceExtensions();
-  renderer->initVulkan(instExts);
-
-  auto surface = mainWindow->createVkSurface(etna::get_context().getInstance());
-
-  renderer->initFrameDelivery(
-    std::move(surface), [window = mainWindow.get()]() { return window->getResolution(); });
-
-  // TODO: this is bad design, this initialization is dependent on the current ImGui context, but we
-  // pass it implicitly here instead of explicitly. Beware if trying to do something tricky.
-  ImGuiRenderer::enableImGuiForWindow(mainWindow->native());
+
+  if (options.headless.enabled)
+  {
+    renderer.reset(new Renderer(initialRes));
+    renderer->initVulkan({}, true);
+    renderer->initHeadlessFrameDelivery();
+  }
+  else
+  {
+    windowing = std::make_unique<OsWindowingManager>();
+    mainWindow = windowing->createWindow(OsWindow::CreateInfo{
+      .resolution = initialRes,
+      .resizeable = true,
+      .refreshCb =
+        [this]() {
+          // NOTE: this is only called when the window is being resized.
+          auto packet = makeFramePacket(static_cast<float>(windowing->getTime()));
+          if (!framePackets)
+          {
+            drawFrame(packet);
+            FrameMark;
+            return;
+          }
+          // The render thread might be busy, and blocking inside of
+          // a windowing callback is asking for trouble, so skip the frame
+          framePackets->tryPush(packet);
+        },
+      .resizeCb =
+        [this](glm::uvec2 res) {
+          windowResolution.store(pack_resolution(res));
+          // The render thread picks new resolutions up by itself
+          if (res.x == 0 || res.y == 0 || framePackets)
+            return;
+
+          renderer->recreateSwapchain(res);
+        },
+    });
+
+    renderer.reset(new Renderer(initialRes));
+
+    auto instExts = windowing->getRequiredVulkanInstanceExtensions();
+    renderer->initVulkan(instExts);
+
+    auto surface = mainWindow->createVkSurface(etna::get_context().getInstance());
+
+    // Might be called from the render thread, which must not touch the window
+    windowResolution.store(pack_resolution(mainWindow->getResolution()));
+    renderer->initFrameDelivery(std::move(surface), [this]() {
+      return unpack_resolution(windowResolution.load());
+    });
+
+    // TODO: this is bad design, this initialization is dependent on the current ImGui context, but
+    // we pass it implicitly here instead of explicitly. Beware if trying to do something tricky.
+    ImGuiRenderer::enableImGuiForWindow(mainWindow->native());
+  }
+
+  renderer->setFramePacing(options.framePacing);
 
   shadowCam.lookAt({-8, 10, 8}, {0, 0, 0}, {0, 1, 0});
   mainCam.lookAt({0, 10, 10}, {0, 0, 0}, {0, 1, 0});
@@ -46,28 +87,158 @@ App::App()
   renderer->loadScene(GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/low_poly_dark_town/scene.gltf");
 }
 
-void App::run()
+int App::run()
+{
+  if (options.benchmark)
+    return runBenchmark();
+
+  if (options.headless.enabled)
+    runHeadless();
+  else if (options.pipelineDepth == 0)
+    runSingleThreaded();
+  else
+    runPipelined();
+
+  return 0;
+}
+
+void App::runSingleThreaded()
 {
-  double lastTime = windowing.getTime();
+  double lastTime = windowing->getTime();
   while (!mainWindow->isBeingClosed())
   {
-    const double currTime = windowing.getTime();
+    renderer->waitBeforeInput();
+
+    const double currTime = windowing->getTime();
     const float diffTime = static_cast<float>(currTime - lastTime);
     lastTime = currTime;
 
-    windowing.poll();
+    windowing->poll();
+    windowResolution.store(pack_resolution(mainWindow->getResolution()));
 
     processInput(diffTime);
 
-    drawFrame();
+    drawFrame(makeFramePacket(static_cast<float>(currTime)));
 
     FrameMark;
   }
 }
 
+void App::runPipelined()
+{
+  framePackets = std::make_unique<SpscQueue<FramePacket>>(options.pipelineDepth);
+
+  std::jthread renderThread([this]() { renderLoop(); });
+
+  // This thread deals with the OS, input and building the GUI, as GLFW only
+  // works on the main thread. Everything Vulkan related happens on the render thread.
+  double lastTime = windowing->getTime();
+  while (!mainWindow->isBeingClosed())
+  {
+    const double currTime = windowing->getTime();
+    const float diffTime = static_cast<float>(currTime - lastTime);
+    lastTime = currTime;
+
+    windowing->poll();
+    windowResolution.store(pack_resolution(mainWindow->getResolution()));
+
+    processInput(diffTime);
+
+    // Blocks while the render thread is pipelineDepth frames behind
+    framePackets->push(makeFramePacket(static_cast<float>(currTime)));
+  }
+
+  // Lets the render thread draw whatever was queued and exit
+  framePackets->close();
+  renderThread.join();
+  framePackets.reset();
+}
+
+void App::renderLoop()
+{
+  glm::uvec2 swapchainRes = unpack_resolution(windowResolution.load());
+  while (auto packet = framePackets->pop())
+  {
+    const glm::uvec2 res = unpack_resolution(windowResolution.load());
+    if (res != swapchainRes && res.x != 0 && res.y != 0)
+    {
+      renderer->recreateSwapchain(res);
+      swapchainRes = res;
+    }
+
+    drawFrame(*packet);
+
+    FrameMark;
+  }
+}
+
+void App::runHeadless()
+{
+  // A fixed time step makes every run render exactly the same images
+  constexpr float frameTime = 1.0f / 60.0f;
+
+  std::filesystem::create_directories(options.headless.outputDir);
+
+  for (std::uint32_t frame = 0; frame < options.headless.frameCount; ++frame)
+  {
+    if (auto path = options.headless.capturePath(frame))
+      renderer->captureNextFrame(std::move(*path));
+
+    drawFrame(makeFramePacket(static_cast<float>(frame) * frameTime));
+
+    FrameMark;
+  }
+}
+
+int App::runBenchmark()
+{
+  Benchmark benchmark(*options.benchmark);
+
+  // Time is fixed-step, so that every run renders the same frames regardless of how fast it is
+  for (std::uint32_t frame = 0; frame < benchmark.getTotalFrameCount(); ++frame)
+  {
+    const auto frameStart = std::chrono::steady_clock::now();
+
+    if (mainWindow)
+    {
+      windowing->poll();
+      if (mainWindow->isBeingClosed())
+      {
+        spdlog::warn("Benchmark interrupted at frame {}", frame);
+        return 1;
+      }
+    }
+
+    renderer->waitBeforeInput();
+    benchmark.placeCameras(frame, mainCam, shadowCam);
+    drawFrame(makeFramePacket(benchmark.getTime(frame)));
+
+    FrameMark;
+
+    const std::chrono::duration<float, std::milli> cpuTime =
+      std::chrono::steady_clock::now() - frameStart;
+    benchmark.recordFrame(frame, cpuTime.count(), renderer->getGpuTimings());
+    if (const auto latency = renderer->getLastFrameLatency())
+      benchmark.recordLatency(frame, latency->inputToSubmitMs, latency->submitToGpuDoneMs);
+  }
+
+  benchmark.writeReport(options.reportFile);
+
+  if (!options.baselineFile.empty() &&
+      !benchmark.compareToBaseline(options.baselineFile, options.regressionThresholdPercent))
+  {
+    spdlog::error(
+      "Performance regressed by more than {}% compared to the baseline",
+      options.regressionThresholdPercent);
+    return 1;
+  }
+
+  return 0;
+}
+
 void App::processInput(float dt)
 {
-  ZoneScoped;
+  TRACE_ZONE;
 
   if (mainWindow->keyboard[KeyboardKey::kEscape] == ButtonState::Falling)
     mainWindow->askToClose();
@@ -80,6 +251,16 @@ void App::processInput(float dt)
   if (mainWindow->keyboard[KeyboardKey::kL] == ButtonState::Falling)
     controlShadowCam = !controlShadowCam;
 
+  renderer->debugInput(mainWindow->keyboard);
+
+  if (mainWindow->keyboard[KeyboardKey::kT] == ButtonState::Falling)
+  {
+    auto& recorder = TraceRecorder::get();
+    recorder.dumpFrames(
+      options.headless.outputDir / ("trace_" + std::to_string(recorder.getFrameIndex()) + ".json"),
+      TRACE_HOTKEY_FRAMES);
+  }
+
   if (mainWindow->mouse[MouseButton::mbRight] == ButtonState::Rising)
     mainWindow->captureMouse = !mainWindow->captureMouse;
 
@@ -88,19 +269,28 @@ void App::processInput(float dt)
   moveCam(camToControl, mainWindow->keyboard, dt);
   if (mainWindow->captureMouse)
     rotateCam(camToControl, mainWindow->mouse, dt);
-
-  renderer->debugInput(mainWindow->keyboard);
 }
 
-void App::drawFrame()
+FramePacket App::makeFramePacket(float current_time)
 {
-  ZoneScoped;
-
-  renderer->update(FramePacket{
+  FramePacket packet{
     .mainCam = mainCam,
     .shadowCam = shadowCam,
-    .currentTime = static_cast<float>(windowing.getTime()),
-  });
+    .currentTime = current_time,
+    .inputTimeNs = TraceRecorder::now(),
+  };
+  renderer->prepareFramePacket(packet);
+  return packet;
+}
+
+void App::drawFrame(const FramePacket& packet)
+{
+  // Before the zone below, so that it belongs to the new frame
+  TraceRecorder::get().markFrame();
+
+  TRACE_ZONE;
+
+  renderer->update(packet);
   renderer->drawFrame();
 }
 
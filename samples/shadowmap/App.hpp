@@ -1,10 +1,41 @@
 #pragma once
 
+#include <atomic>
+#include <filesystem>
+#include <optional>
+
 #include "wsi/OsWindowingManager.hpp"
 #include "scene/Camera.hpp"
+#include "render_utils/HeadlessTarget.hpp"
 
 #include "Renderer.hpp"
+#include "Benchmark.hpp"
+#include "SpscQueue.hpp"
+
+
+struct AppOptions
+{
+  // When benchmarking, --frames is the amount of measured frames instead
+  HeadlessOptions headless;
+
+  // Windowed only. How many frames input handling and GUI building may run ahead of
+  // a separate render thread, so that both overlap. Zero renders on the main thread.
+  std::uint32_t pipelineDepth = 1;
+  // Low latency pacing waits on the thread that samples input, so it implies a depth of zero
+  Renderer::FramePacing framePacing = Renderer::FramePacing::Throughput;
 
+  // Plays a camera path back instead of taking input and measures frame times
+  std::optional<Benchmark::CreateInfo> benchmark;
+  std::filesystem::path reportFile = "benchmark.json";
+  // The run fails if a metric got slower than the baseline by more than the threshold
+  std::filesystem::path baselineFile;
+  float regressionThresholdPercent = 5.0f;
+
+  // The trace of the latest frames is written here on exit, e.g. for ui.perfetto.dev
+  std::filesystem::path traceFile;
+  // Limits the trace to this time window instead of all the frames the recorder holds
+  std::optional<float> traceSeconds;
+};
 
 /**
  * Main class of the application. Contains things that are not strictly
@@ -13,20 +44,37 @@
 class App
 {
 public:
-  App();
+  explicit App(AppOptions options = {});
 
-  void run();
+  // Returns the exit code of the application
+  int run();
 
 private:
+  // Amount of frames written into outputDir when T is pressed
+  static constexpr std::uint32_t TRACE_HOTKEY_FRAMES = 300;
+
+  void runSingleThreaded();
+  void runPipelined();
+  void renderLoop();
+  void runHeadless();
+  int runBenchmark();
   void processInput(float dt);
-  void drawFrame();
+  FramePacket makeFramePacket(float current_time);
+  void drawFrame(const FramePacket& packet);
 
   void moveCam(Camera& cam, const Keyboard& kb, float dt);
   void rotateCam(Camera& cam, const Mouse& ms, float dt);
 
 private:
-  OsWindowingManager windowing;
+  AppOptions options;
+
+  // Both are null in headless mode
+  std::unique_ptr<OsWindowingManager> windowing;
   std::unique_ptr<OsWindow> mainWindow;
+  // Written by the input thread, read by the render thread, packed to stay lock-free
+  std::atomic<std::uint64_t> windowResolution{0};
+  // Only exists while the render thread does
+  std::unique_ptr<SpscQueue<FramePacket>> framePackets;
 
   float camMoveSpeed = 1;
   float camRotateSpeed = 0.1f;
@@ -0,0 +1,168 @@
+#include "AutoExposure.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/DescriptorSet.hpp>
+#include <etna/Profiling.hpp>
+#include <glm/glm.hpp>
+#include <imgui.h>
+
+
+AutoExposure::AutoExposure(ShaderPermutations& shader_permutations)
+  : permutations{shader_permutations}
+{
+  auto& ctx = etna::get_context();
+
+  // Both are zeroed once here, from then on only the GPU touches them
+  histogram = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = EXPOSURE_HISTOGRAM_BINS * sizeof(std::uint32_t),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+    .name = "exposure_histogram",
+  });
+  histogram.map();
+  std::fill_n(reinterpret_cast<std::uint32_t*>(histogram.data()), EXPOSURE_HISTOGRAM_BINS, 0u);
+
+  exposure = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(ExposureState),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+    .name = "exposure",
+  });
+  exposure.map();
+  const ExposureState initialState{.adaptedLuminance = 0.0f, .exposure = 1.0f};
+  std::memcpy(exposure.data(), &initialState, sizeof(initialState));
+}
+
+void AutoExposure::loadShaders()
+{
+  permutations.addProgram(
+    "luminance_histogram", {SHADOWMAP_SHADERS_ROOT "luminance_histogram.comp.spv"});
+  permutations.addProgram("adapt_exposure", {SHADOWMAP_SHADERS_ROOT "adapt_exposure.comp.spv"});
+}
+
+void AutoExposure::setupPipelines(DeferredDeletionQueue& retired)
+{
+  auto& pipelineManager = etna::get_context().getPipelineManager();
+  retired.retire(std::move(histogramPipeline));
+  histogramPipeline = pipelineManager.createComputePipeline(
+    permutations.getProgram("luminance_histogram").c_str(), {});
+  retired.retire(std::move(adaptPipeline));
+  adaptPipeline = pipelineManager.createComputePipeline(
+    permutations.getProgram("adapt_exposure").c_str(), {});
+}
+
+void AutoExposure::buildHistogram(
+  vk::CommandBuffer cmd_buf,
+  const etna::Image& hdr_image,
+  vk::Extent2D extent,
+  const etna::Sampler& sampler)
+{
+  ETNA_PROFILE_GPU(cmd_buf, luminanceHistogram);
+
+  // The previous frame reads the exposure while tonemapping and clears the histogram
+  {
+    const vk::MemoryBarrier2 previousFrame{
+      .srcStageMask =
+        vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader,
+      .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .dstAccessMask =
+        vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &previousFrame,
+    });
+  }
+
+  auto programInfo =
+    etna::get_shader_program(permutations.getProgram("luminance_histogram").c_str());
+  auto set = etna::create_descriptor_set(
+    programInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {etna::Binding{
+       0, hdr_image.genBinding(sampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+     etna::Binding{1, histogram.genBinding()}});
+
+  struct PushConstants
+  {
+    glm::uvec2 extent;
+    float minLogLuminance;
+    float invLogLuminanceRange;
+  } pushConst{
+    {extent.width, extent.height},
+    settings.minLogLuminance,
+    1.0f / (settings.maxLogLuminance - settings.minLogLuminance),
+  };
+
+  const auto layout = histogramPipeline.getVkPipelineLayout();
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, histogramPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, layout, 0, {set.getVkSet()}, {});
+  cmd_buf.pushConstants<PushConstants>(
+    layout, vk::ShaderStageFlagBits::eCompute, 0, {pushConst});
+
+  etna::flush_barriers(cmd_buf);
+
+  constexpr std::uint32_t groupSize = EXPOSURE_HISTOGRAM_GROUP_SIZE;
+  cmd_buf.dispatch(
+    (extent.width + groupSize - 1) / groupSize, (extent.height + groupSize - 1) / groupSize, 1);
+}
+
+void AutoExposure::adapt(vk::CommandBuffer cmd_buf, float delta_time)
+{
+  ETNA_PROFILE_GPU(cmd_buf, adaptExposure);
+
+  auto programInfo = etna::get_shader_program(permutations.getProgram("adapt_exposure").c_str());
+  auto set = etna::create_descriptor_set(
+    programInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {etna::Binding{0, histogram.genBinding()}, etna::Binding{1, exposure.genBinding()}});
+
+  struct PushConstants
+  {
+    float minLogLuminance;
+    float logLuminanceRange;
+    float lowPercentile;
+    float highPercentile;
+    float deltaTime;
+    float adaptationRate;
+  } pushConst{
+    settings.minLogLuminance,
+    settings.maxLogLuminance - settings.minLogLuminance,
+    settings.lowPercentile,
+    settings.highPercentile,
+    delta_time,
+    settings.adaptationRate,
+  };
+
+  const auto layout = adaptPipeline.getVkPipelineLayout();
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, adaptPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, layout, 0, {set.getVkSet()}, {});
+  cmd_buf.pushConstants<PushConstants>(
+    layout, vk::ShaderStageFlagBits::eCompute, 0, {pushConst});
+
+  etna::flush_barriers(cmd_buf);
+
+  cmd_buf.dispatch(1, 1, 1);
+}
+
+void AutoExposure::drawGui(Settings& settings)
+{
+  ImGui::Checkbox("Enabled", &settings.enabled);
+  ImGui::DragFloatRange2(
+    "Log2 luminance range",
+    &settings.minLogLuminance,
+    &settings.maxLogLuminance,
+    0.1f,
+    -20.0f,
+    20.0f);
+  ImGui::DragFloatRange2(
+    "Percentiles", &settings.lowPercentile, &settings.highPercentile, 0.01f, 0.0f, 1.0f);
+  ImGui::SliderFloat("Adaptation rate, 1/s", &settings.adaptationRate, 0.1f, 10.0f);
+  // An empty range would divide by zero in the histogram pass
+  settings.maxLogLuminance = std::max(settings.maxLogLuminance, settings.minLogLuminance + 1.0f);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <etna/Buffer.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/Image.hpp>
+#include <etna/Sampler.hpp>
+
+#include "shaders/AutoExposure.h"
+#include "render_utils/DeferredDeletionQueue.hpp"
+#include "render_utils/ShaderPermutations.hpp"
+
+
+/**
+ * Automatic exposure that never leaves the GPU: a compute pass builds a histogram of the
+ * log luminance of the HDR image, and a single workgroup averages it and adapts the exposure
+ * over time. The tonemapping pass reads the exposure straight from the buffer.
+ */
+class AutoExposure
+{
+public:
+  struct Settings
+  {
+    bool enabled = true;
+    // Log2 of the luminance covered by the histogram, everything outside goes into the end bins
+    float minLogLuminance = -10.0f;
+    float maxLogLuminance = 6.0f;
+    float lowPercentile = 0.5f;
+    float highPercentile = 0.95f;
+    float adaptationRate = 1.5f;
+  };
+
+  explicit AutoExposure(ShaderPermutations& permutations);
+
+  void loadShaders();
+  void setupPipelines(DeferredDeletionQueue& retired);
+
+  bool isEnabled() const { return settings.enabled; }
+
+  // Only the top left extent part of hdr_image is measured
+  void buildHistogram(
+    vk::CommandBuffer cmd_buf,
+    const etna::Image& hdr_image,
+    vk::Extent2D extent,
+    const etna::Sampler& sampler);
+  // Also clears the histogram for the next frame
+  void adapt(vk::CommandBuffer cmd_buf, float delta_time);
+
+  const etna::Buffer& getHistogram() const { return histogram; }
+  // Contains an ExposureState
+  const etna::Buffer& getExposure() const { return exposure; }
+
+  static void drawGui(Settings& settings);
+
+  Settings settings;
+
+private:
+  ShaderPermutations& permutations;
+
+  etna::Buffer histogram;
+  etna::Buffer exposure;
+  etna::ComputePipeline histogramPipeline;
+  etna::ComputePipeline adaptPipeline;
+};
@@ -0,0 +1,233 @@
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+
+#include <glm/gtc/constants.hpp>
+#include <spdlog/spdlog.h>
+#include <etna/Assert.hpp>
+#include <json.hpp>
+
+
+static std::vector<Benchmark::Keyframe> parse_keyframes(const nlohmann::json& keyframes)
+{
+  std::vector<Benchmark::Keyframe> result;
+  for (const auto& keyframe : keyframes)
+  {
+    const auto& pos = keyframe.at("position");
+    const auto& target = keyframe.at("target");
+    result.push_back(Benchmark::Keyframe{
+      .time = keyframe.at("time").get<float>(),
+      .position = {pos.at(0).get<float>(), pos.at(1).get<float>(), pos.at(2).get<float>()},
+      .target = {target.at(0).get<float>(), target.at(1).get<float>(), target.at(2).get<float>()},
+    });
+  }
+
+  ETNA_VERIFYF(!result.empty(), "Camera paths must contain at least one keyframe");
+  ETNA_VERIFYF(
+    std::is_sorted(
+      result.begin(),
+      result.end(),
+      [](const auto& a, const auto& b) { return a.time < b.time; }),
+    "Camera path keyframes must be sorted by time");
+  return result;
+}
+
+// Paths loop, so that they can be shorter than the benchmark itself
+static void place_camera(std::span<const Benchmark::Keyframe> path, float time, Camera& cam)
+{
+  const float duration = path.back().time;
+  if (duration > 0)
+    time = std::fmod(time, duration);
+
+  auto next = std::upper_bound(
+    path.begin(), path.end(), time, [](float t, const auto& key) { return t < key.time; });
+  if (next == path.begin() || next == path.end())
+  {
+    const auto& key = next == path.end() ? path.back() : path.front();
+    cam.lookAt(key.position, key.target, {0, 1, 0});
+    return;
+  }
+
+  const auto& prev = *(next - 1);
+  const float t = (time - prev.time) / (next->time - prev.time);
+  cam.lookAt(
+    glm::mix(prev.position, next->position, t), glm::mix(prev.target, next->target, t), {0, 1, 0});
+}
+
+Benchmark::Benchmark(CreateInfo info)
+  : warmupFrames{info.warmupFrames}
+  , frameCount{info.frameCount}
+{
+  if (info.pathFile.empty())
+  {
+    // Circles around the town once every 10 seconds, dipping down between the houses
+    for (int i = 0; i <= 8; ++i)
+    {
+      const float angle = glm::two_pi<float>() * static_cast<float>(i) / 8.0f;
+      const float height = i % 2 == 0 ? 10.0f : 3.0f;
+      mainCamPath.push_back(Keyframe{
+        .time = 1.25f * static_cast<float>(i),
+        .position = {12.0f * std::cos(angle), height, 12.0f * std::sin(angle)},
+        .target = {0, 0, 0},
+      });
+    }
+    shadowCamPath.push_back(Keyframe{.time = 0, .position = {-8, 10, 8}, .target = {0, 0, 0}});
+  }
+  else
+  {
+    std::ifstream file(info.pathFile);
+    ETNA_VERIFYF(file, "Failed to open camera path '{}'", info.pathFile.string());
+    const auto json = nlohmann::json::parse(file);
+    mainCamPath = parse_keyframes(json.at("mainCam"));
+    shadowCamPath = parse_keyframes(json.at("shadowCam"));
+  }
+
+  cpuFrameMs.reserve(frameCount);
+  gpuFrameMs.reserve(frameCount);
+}
+
+void Benchmark::placeCameras(std::uint32_t frame, Camera& main_cam, Camera& shadow_cam) const
+{
+  place_camera(mainCamPath, getTime(frame), main_cam);
+  place_camera(shadowCamPath, getTime(frame), shadow_cam);
+}
+
+void Benchmark::recordFrame(
+  std::uint32_t frame, float cpu_ms, std::span<const GpuTimer::Timing> gpu)
+{
+  if (frame < warmupFrames)
+    return;
+
+  cpuFrameMs.push_back(cpu_ms);
+  for (const auto& timing : gpu)
+  {
+    if (timing.depth == 0)
+      gpuFrameMs.push_back(timing.milliseconds);
+    else
+      gpuPassMs[timing.name].push_back(timing.milliseconds);
+  }
+}
+
+void Benchmark::recordLatency(
+  std::uint32_t frame, float input_to_submit_ms, float submit_to_gpu_done_ms)
+{
+  if (frame < warmupFrames)
+    return;
+
+  inputToSubmitMs.push_back(input_to_submit_ms);
+  submitToGpuDoneMs.push_back(submit_to_gpu_done_ms);
+}
+
+Benchmark::Stats Benchmark::computeStats(std::vector<float> samples)
+{
+  if (samples.empty())
+    return {};
+
+  std::sort(samples.begin(), samples.end());
+  // Nearest-rank percentiles
+  const auto percentile = [&samples](double p) {
+    const auto rank = static_cast<std::size_t>(std::ceil(p * static_cast<double>(samples.size())));
+    return static_cast<double>(samples[std::clamp<std::size_t>(rank, 1, samples.size()) - 1]);
+  };
+
+  return Stats{
+    .mean = std::accumulate(samples.begin(), samples.end(), 0.0) /
+      static_cast<double>(samples.size()),
+    .p50 = percentile(0.50),
+    .p95 = percentile(0.95),
+    .p99 = percentile(0.99),
+    .max = static_cast<double>(samples.back()),
+  };
+}
+
+std::map<std::string, Benchmark::Stats> Benchmark::computeMetrics() const
+{
+  std::map<std::string, Stats> metrics;
+  metrics["cpuFrameMs"] = computeStats(cpuFrameMs);
+  metrics["gpuFrameMs"] = computeStats(gpuFrameMs);
+  if (!inputToSubmitMs.empty())
+  {
+    metrics["inputToSubmitMs"] = computeStats(inputToSubmitMs);
+    metrics["submitToGpuDoneMs"] = computeStats(submitToGpuDoneMs);
+  }
+  for (const auto& [name, samples] : gpuPassMs)
+    metrics[name] = computeStats(samples);
+  return metrics;
+}
+
+void Benchmark::writeReport(const std::filesystem::path& path) const
+{
+  nlohmann::json report{
+    {"frames", frameCount},
+    {"warmupFrames", warmupFrames},
+    {"metrics", nlohmann::json::object()},
+  };
+
+  for (const auto& [name, stats] : computeMetrics())
+  {
+    report["metrics"][name] = {
+      {"mean", stats.mean},
+      {"p50", stats.p50},
+      {"p95", stats.p95},
+      {"p99", stats.p99},
+      {"max", stats.max},
+    };
+    spdlog::info(
+      "{:>28}: mean {:7.3f} p50 {:7.3f} p95 {:7.3f} p99 {:7.3f} max {:7.3f} ms",
+      name,
+      stats.mean,
+      stats.p50,
+      stats.p95,
+      stats.p99,
+      stats.max);
+  }
+
+  std::ofstream file(path);
+  file << report.dump(2) << '\n';
+  if (!file)
+    spdlog::error("Failed to write benchmark results into '{}'", path.string());
+  else
+    spdlog::info("Benchmark results written into '{}'", path.string());
+}
+
+bool Benchmark::compareToBaseline(
+  const std::filesystem::path& baseline_path, float threshold_percent) const
+{
+  std::ifstream file(baseline_path);
+  if (!file)
+  {
+    spdlog::error("Failed to open the baseline '{}'", baseline_path.string());
+    return false;
+  }
+  const auto baseline = nlohmann::json::parse(file).at("metrics");
+
+  // Medians are compared, as they are the least sensitive to hiccups of the machine
+  bool passed = true;
+  for (const auto& [name, stats] : computeMetrics())
+  {
+    if (!baseline.contains(name))
+    {
+      spdlog::info("{:>28}: not in the baseline", name);
+      continue;
+    }
+
+    const double before = baseline.at(name).at("p50").get<double>();
+    const double change = before > 0 ? (stats.p50 - before) / before * 100.0 : 0.0;
+    const bool regressed = change > threshold_percent;
+    passed = passed && !regressed;
+
+    spdlog::log(
+      regressed ? spdlog::level::warn : spdlog::level::info,
+      "{:>28}: p50 {:7.3f} -> {:7.3f} ms ({:+.1f}%){}",
+      name,
+      before,
+      stats.p50,
+      change,
+      regressed ? " REGRESSION" : "");
+  }
+
+  return passed;
+}
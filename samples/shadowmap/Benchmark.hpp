@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "scene/Camera.hpp"
+#include "profiling/GpuTimer.hpp"
+
+
+/**
+ * Plays a scripted camera path back with a fixed time step and collects frame
+ * time statistics, so that runs can be compared with each other. Results are
+ * written as JSON and can be checked against a baseline produced the same way.
+ */
+class Benchmark
+{
+public:
+  struct Keyframe
+  {
+    float time;
+    glm::vec3 position;
+    glm::vec3 target;
+  };
+
+  struct CreateInfo
+  {
+    // Camera path in JSON, a built-in flythrough is used if empty
+    std::filesystem::path pathFile;
+    // Frames that are rendered before measuring, while caches and pipelines warm up
+    std::uint32_t warmupFrames = 60;
+    std::uint32_t frameCount = 600;
+  };
+
+  explicit Benchmark(CreateInfo info);
+
+  static constexpr float FRAME_TIME = 1.0f / 60.0f;
+
+  std::uint32_t getTotalFrameCount() const { return warmupFrames + frameCount; }
+  float getTime(std::uint32_t frame) const { return static_cast<float>(frame) * FRAME_TIME; }
+
+  void placeCameras(std::uint32_t frame, Camera& main_cam, Camera& shadow_cam) const;
+
+  // GPU timings lag behind by the frames in flight, which does not matter for the distribution
+  void recordFrame(std::uint32_t frame, float cpu_ms, std::span<const GpuTimer::Timing> gpu);
+  void recordLatency(std::uint32_t frame, float input_to_submit_ms, float submit_to_gpu_done_ms);
+
+  void writeReport(const std::filesystem::path& path) const;
+  // Prints the difference to the baseline, returns false if anything got slower than the threshold
+  bool compareToBaseline(const std::filesystem::path& baseline, float threshold_percent) const;
+
+private:
+  struct Stats
+  {
+    double mean = 0;
+    double p50 = 0;
+    double p95 = 0;
+    double p99 = 0;
+    double max = 0;
+  };
+
+  static Stats computeStats(std::vector<float> samples);
+  // Frame times and per-pass GPU timings, keyed by the metric name
+  std::map<std::string, Stats> computeMetrics() const;
+
+private:
+  std::vector<Keyframe> mainCamPath;
+  std::vector<Keyframe> shadowCamPath;
+  std::uint32_t warmupFrames;
+  std::uint32_t frameCount;
+
+  std::vector<float> cpuFrameMs;
+  std::vector<float> gpuFrameMs;
+  std::map<std::string, std::vector<float>> gpuPassMs;
+  std::vector<float> inputToSubmitMs;
+  std::vector<float> submitToGpuDoneMs;
+};
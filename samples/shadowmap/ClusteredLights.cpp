@@ -0,0 +1,127 @@
+#include "ClusteredLights.hpp"
+
+#include <etna/Assert.hpp>
+#include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/Profiling.hpp>
+
+
+ClusteredLights::ClusteredLights(ShaderPermutations& shader_permutations)
+  : permutations{shader_permutations}
+{
+  auto& ctx = etna::get_context();
+
+  clusterGrid = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = CLUSTER_COUNT * sizeof(glm::uvec2),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "cluster_grid",
+  });
+
+  clusterLightIndices = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = MAX_CLUSTER_LIGHT_INDICES * sizeof(std::uint32_t),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "cluster_light_indices",
+  });
+
+  indexCounter = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(std::uint32_t),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "cluster_index_counter",
+  });
+}
+
+void ClusteredLights::loadShaders()
+{
+  permutations.addProgram("cluster_lights", {SHADOWMAP_SHADERS_ROOT "cluster_lights.comp.spv"});
+}
+
+void ClusteredLights::setupPipelines(DeferredDeletionQueue& retired)
+{
+  auto& pipelineManager = etna::get_context().getPipelineManager();
+  retired.retire(std::move(pipeline));
+  pipeline = pipelineManager.createComputePipeline(
+    permutations.getProgram("cluster_lights").c_str(), {});
+}
+
+void ClusteredLights::update(
+  std::span<const LocalLight> lights, TransientAllocator& transient_memory)
+{
+  ETNA_VERIFYF(
+    lights.size() <= MAX_LOCAL_LIGHTS, "Too many local lights, max is {}", MAX_LOCAL_LIGHTS);
+
+  lightBuffer = transient_memory.upload(lights);
+}
+
+void ClusteredLights::cull(
+  vk::CommandBuffer cmd_buf, const TransientAllocator::Allocation& uniforms)
+{
+  ETNA_PROFILE_GPU(cmd_buf, clusterLights);
+
+  // The previous frame might still be shading with the cluster lists
+  {
+    const vk::MemoryBarrier2 previousReads{
+      .srcStageMask =
+        vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader,
+      .srcAccessMask = {},
+      .dstStageMask =
+        vk::PipelineStageFlagBits2::eTransfer | vk::PipelineStageFlagBits2::eComputeShader,
+      .dstAccessMask = {},
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &previousReads,
+    });
+  }
+
+  cmd_buf.fillBuffer(indexCounter.get(), 0, VK_WHOLE_SIZE, 0);
+
+  {
+    const vk::MemoryBarrier2 counterReset{
+      .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .dstAccessMask =
+        vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &counterReset,
+    });
+  }
+
+  auto programInfo = etna::get_shader_program(permutations.getProgram("cluster_lights").c_str());
+  auto set = etna::create_descriptor_set(
+    programInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {etna::Binding{0, uniforms.genBinding()},
+     etna::Binding{1, getLightBuffer().genBinding()},
+     etna::Binding{2, clusterGrid.genBinding()},
+     etna::Binding{3, clusterLightIndices.genBinding()},
+     etna::Binding{4, indexCounter.genBinding()}});
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute, pipeline.getVkPipelineLayout(), 0, {set.getVkSet()}, {});
+
+  etna::flush_barriers(cmd_buf);
+
+  cmd_buf.dispatch(CLUSTER_TILES_X, CLUSTER_TILES_Y, CLUSTER_SLICES);
+
+  {
+    const vk::MemoryBarrier2 toShading{
+      .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+      // The visibility buffer path shades in a compute pass
+      .dstStageMask =
+        vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader,
+      .dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead,
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &toShading,
+    });
+  }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include <etna/Buffer.hpp>
+#include <etna/ComputePipeline.hpp>
+
+#include "shaders/ClusteredLights.h"
+#include "render_utils/TransientAllocator.hpp"
+#include "render_utils/DeferredDeletionQueue.hpp"
+#include "render_utils/ShaderPermutations.hpp"
+
+
+/**
+ * Clustered light culling: the view frustum is split into a grid of froxels,
+ * and a compute pass builds a compact list of lights affecting each of them.
+ * Shading then only loops over the lights of the fragment's cluster, so its cost
+ * depends on how many lights are nearby rather than on the total light count.
+ */
+class ClusteredLights
+{
+public:
+  explicit ClusteredLights(ShaderPermutations& permutations);
+
+  void loadShaders();
+  void setupPipelines(DeferredDeletionQueue& retired);
+
+  // The light buffer of the current frame is allocated from transient_memory
+  void update(std::span<const LocalLight> lights, TransientAllocator& transient_memory);
+
+  // Uniforms are expected to contain the view matrices and the cluster depth range
+  void cull(vk::CommandBuffer cmd_buf, const TransientAllocator::Allocation& uniforms);
+
+  // Light buffer to be used by the current frame
+  const TransientAllocator::Allocation& getLightBuffer() const { return lightBuffer; }
+  const etna::Buffer& getClusterGrid() const { return clusterGrid; }
+  const etna::Buffer& getClusterLightIndices() const { return clusterLightIndices; }
+
+private:
+  ShaderPermutations& permutations;
+
+  TransientAllocator::Allocation lightBuffer;
+  etna::Buffer clusterGrid;
+  etna::Buffer clusterLightIndices;
+  etna::Buffer indexCounter;
+  etna::ComputePipeline pipeline;
+};
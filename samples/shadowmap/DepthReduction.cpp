@@ -0,0 +1,129 @@
+#include "DepthReduction.hpp"
+
+#include <bit>
+#include <cstring>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/Profiling.hpp>
+
+
+static constexpr DepthBounds EMPTY_BOUNDS{
+  .minDepth = ~0u,
+  .maxDepth = 0,
+  .lightSpaceMin = {~0u, ~0u, ~0u},
+  .lightSpaceMax = {0, 0, 0},
+};
+
+static float from_ordered(std::uint32_t bits)
+{
+  return std::bit_cast<float>((bits & 0x80000000u) != 0 ? bits & 0x7FFFFFFFu : ~bits);
+}
+
+DepthReduction::DepthReduction(ShaderPermutations& shader_permutations)
+  : permutations{shader_permutations}
+{
+  auto& ctx = etna::get_context();
+
+  resultBuffers.resize(ctx.getMainWorkCount().multiBufferingCount());
+  for (auto& buffer : resultBuffers)
+  {
+    buffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+      .size = sizeof(DepthBounds),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_TO_CPU,
+      .name = "depth_bounds",
+    });
+    buffer.map();
+    std::memcpy(buffer.data(), &EMPTY_BOUNDS, sizeof(EMPTY_BOUNDS));
+  }
+}
+
+void DepthReduction::loadShaders()
+{
+  permutations.addProgram("depth_reduce", {SHADOWMAP_SHADERS_ROOT "depth_reduce.comp.spv"});
+}
+
+void DepthReduction::setupPipelines(DeferredDeletionQueue& retired)
+{
+  auto& pipelineManager = etna::get_context().getPipelineManager();
+  retired.retire(std::move(pipeline));
+  pipeline = pipelineManager.createComputePipeline(
+    permutations.getProgram("depth_reduce").c_str(), {});
+}
+
+void DepthReduction::readBack()
+{
+  auto& buffer = resultBuffers[etna::get_context().getMainWorkCount().currentResource()];
+
+  DepthBounds result;
+  std::memcpy(&result, buffer.data(), sizeof(result));
+  // Prepare the buffer for the next reduction that uses it
+  std::memcpy(buffer.data(), &EMPTY_BOUNDS, sizeof(EMPTY_BOUNDS));
+
+  if (result.minDepth == EMPTY_BOUNDS.minDepth)
+  {
+    bounds = std::nullopt;
+    return;
+  }
+
+  bounds = Bounds{
+    .minDepth = from_ordered(result.minDepth),
+    .maxDepth = from_ordered(result.maxDepth),
+    .lightSpaceMin =
+      {from_ordered(result.lightSpaceMin[0]),
+       from_ordered(result.lightSpaceMin[1]),
+       from_ordered(result.lightSpaceMin[2])},
+    .lightSpaceMax =
+      {from_ordered(result.lightSpaceMax[0]),
+       from_ordered(result.lightSpaceMax[1]),
+       from_ordered(result.lightSpaceMax[2])},
+  };
+}
+
+void DepthReduction::reduce(
+  vk::CommandBuffer cmd_buf,
+  const etna::Image& depth,
+  const etna::Sampler& sampler,
+  const glm::mat4x4& ndc_to_light_view,
+  glm::uvec2 resolution)
+{
+  ETNA_PROFILE_GPU(cmd_buf, depthReduction);
+
+  auto& buffer = resultBuffers[etna::get_context().getMainWorkCount().currentResource()];
+
+  auto programInfo = etna::get_shader_program(permutations.getProgram("depth_reduce").c_str());
+  auto set = etna::create_descriptor_set(
+    programInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {etna::Binding{0, depth.genBinding(sampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+     etna::Binding{1, buffer.genBinding()}});
+
+  struct PushConstants
+  {
+    glm::mat4x4 ndcToLightView;
+    glm::uvec2 resolution;
+  } pushConst{ndc_to_light_view, resolution};
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute, pipeline.getVkPipelineLayout(), 0, {set.getVkSet()}, {});
+  cmd_buf.pushConstants<PushConstants>(
+    pipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, {pushConst});
+
+  etna::flush_barriers(cmd_buf);
+
+  cmd_buf.dispatch((resolution.x + 15) / 16, (resolution.y + 15) / 16, 1);
+
+  // Make the results visible to the host once the frame's fence is signaled
+  const vk::MemoryBarrier2 toHost{
+    .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+    .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &toHost,
+  });
+}
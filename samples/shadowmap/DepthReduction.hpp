@@ -0,0 +1,58 @@
+#pragma once
+
+#include <optional>
+#include <vector>
+
+#include <etna/Buffer.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/Image.hpp>
+#include <etna/Sampler.hpp>
+#include <glm/glm.hpp>
+
+#include "shaders/DepthBounds.h"
+#include "render_utils/DeferredDeletionQueue.hpp"
+#include "render_utils/ShaderPermutations.hpp"
+
+
+/**
+ * Finds the bounds of all visible samples of the main view on the GPU.
+ * Results are read back without stalling, so they lag behind by the
+ * amount of frames in flight. Used to tightly fit the shadow map to
+ * what is actually visible (sample distribution shadow maps).
+ */
+class DepthReduction
+{
+public:
+  struct Bounds
+  {
+    float minDepth;
+    float maxDepth;
+    glm::vec3 lightSpaceMin;
+    glm::vec3 lightSpaceMax;
+  };
+
+  explicit DepthReduction(ShaderPermutations& permutations);
+
+  void loadShaders();
+  void setupPipelines(DeferredDeletionQueue& retired);
+
+  // Must be called after the fence of the current frame slot was waited upon
+  void readBack();
+
+  // Latest available bounds, empty if nothing was visible
+  const std::optional<Bounds>& getBounds() const { return bounds; }
+
+  void reduce(
+    vk::CommandBuffer cmd_buf,
+    const etna::Image& depth,
+    const etna::Sampler& sampler,
+    const glm::mat4x4& ndc_to_light_view,
+    glm::uvec2 resolution);
+
+private:
+  ShaderPermutations& permutations;
+
+  std::vector<etna::Buffer> resultBuffers;
+  etna::ComputePipeline pipeline;
+  std::optional<Bounds> bounds;
+};
@@ -0,0 +1,63 @@
+#include "DynamicResolution.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <imgui.h>
+
+
+// Covers the frames in flight, so that the effect of a change is measured before the next one
+static constexpr std::uint32_t FRAMES_BETWEEN_CHANGES = 4;
+// Scale changes in steps of this size, so that tiny fluctuations don't cause changes at all
+static constexpr float SCALE_STEP = 1.0f / 32.0f;
+
+void DynamicResolution::update(std::optional<float> gpu_frame_ms)
+{
+  if (!settings.enabled)
+  {
+    scale = 1.0f;
+    filteredFrameMs = 0;
+    return;
+  }
+
+  if (!gpu_frame_ms)
+    return;
+
+  filteredFrameMs =
+    filteredFrameMs == 0 ? *gpu_frame_ms : std::lerp(filteredFrameMs, *gpu_frame_ms, 0.2f);
+
+  if (++framesSinceChange < FRAMES_BETWEEN_CHANGES)
+    return;
+
+  // Cost is roughly proportional to the pixel count, i.e. to the square of the scale.
+  // Going down is urgent and may be fast, going up is done carefully.
+  const float ratio = std::sqrt(settings.targetFrameMs / filteredFrameMs);
+  float newScale = scale;
+  if (filteredFrameMs > settings.targetFrameMs)
+    newScale = scale * std::max(ratio, 0.8f);
+  else if (filteredFrameMs < settings.targetFrameMs * settings.raiseThreshold)
+    newScale = scale * std::min(ratio, 1.05f);
+
+  newScale = std::clamp(std::round(newScale / SCALE_STEP) * SCALE_STEP, settings.minScale, 1.0f);
+  if (newScale != scale)
+  {
+    scale = newScale;
+    framesSinceChange = 0;
+  }
+}
+
+glm::uvec2 DynamicResolution::getRenderResolution(glm::uvec2 max_resolution) const
+{
+  const glm::vec2 scaled = glm::round(glm::vec2(max_resolution) * getScale());
+  return glm::clamp(glm::uvec2(scaled), glm::uvec2(1), max_resolution);
+}
+
+void DynamicResolution::drawGui(Settings& settings, const Stats& stats)
+{
+  ImGui::Checkbox("Enabled", &settings.enabled);
+  ImGui::SliderFloat("Target GPU frame time, ms", &settings.targetFrameMs, 2.0f, 50.0f);
+  ImGui::SliderFloat("Min scale", &settings.minScale, 0.25f, 1.0f);
+  ImGui::SliderFloat("Raise below target fraction", &settings.raiseThreshold, 0.5f, 0.95f);
+  ImGui::Text(
+    "Scale: %.3f, filtered GPU frame time: %.2f ms", stats.scale, stats.filteredFrameMs);
+}
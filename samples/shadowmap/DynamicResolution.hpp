@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+#include <glm/glm.hpp>
+
+
+/**
+ * Picks the resolution of the main view from the measured GPU frame time,
+ * so that heavy frames get cheaper instead of dropping below the refresh
+ * rate. Timings lag behind by the frames in flight, so changes are damped:
+ * nothing happens while the frame time is inside of a band around the
+ * target, and every change is followed by a few frames of rest.
+ */
+class DynamicResolution
+{
+public:
+  struct Settings
+  {
+    bool enabled = false;
+    float targetFrameMs = 1000.0f / 60.0f;
+    float minScale = 0.5f;
+    // The frame time has to drop below this fraction of the target before the scale goes up
+    float raiseThreshold = 0.85f;
+  };
+
+  struct Stats
+  {
+    float scale = 1.0f;
+    float filteredFrameMs = 0;
+  };
+
+  // Feed the GPU time of the latest completed frame once per frame
+  void update(std::optional<float> gpu_frame_ms);
+
+  float getScale() const { return settings.enabled ? scale : 1.0f; }
+  // Never larger than max_resolution, never zero
+  glm::uvec2 getRenderResolution(glm::uvec2 max_resolution) const;
+
+  Stats getStats() const { return Stats{.scale = getScale(), .filteredFrameMs = filteredFrameMs}; }
+
+  static void drawGui(Settings& settings, const Stats& stats);
+
+  Settings settings;
+
+private:
+  float scale = 1.0f;
+  float filteredFrameMs = 0;
+  std::uint32_t framesSinceChange = 0;
+};
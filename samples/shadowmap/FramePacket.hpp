@@ -1,15 +1,27 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
+
+#include <gui/ImGuiDrawSnapshot.hpp>
 #include <scene/Camera.hpp>
 
+#include "RenderSettings.hpp"
+
 
 /**
  * Contains data sent from the gameplay/logic part of the application
- * to the renderer on every frame.
+ * to the renderer on every frame. It is a self-contained snapshot, as the
+ * renderer might be consuming it on a different thread.
  */
 struct FramePacket
 {
   Camera mainCam;
   Camera shadowCam;
   float currentTime = 0;
+  // When input for this frame was sampled, in TraceRecorder::now() time
+  std::uint64_t inputTimeNs = 0;
+  RenderSettings settings;
+  // Built on the thread that polls the window, as GLFW requires. Null without a GUI.
+  std::shared_ptr<ImGuiDrawSnapshot> gui;
 };
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "shaders/UniformParams.h"
+#include "profiling/GpuTimer.hpp"
+#include "render_graph/RenderGraph.hpp"
+
+#include "AutoExposure.hpp"
+#include "DepthReduction.hpp"
+#include "DynamicResolution.hpp"
+#include "ShadowAtlas.hpp"
+#include "ShadowCascades.hpp"
+#include "TemporalUpscaler.hpp"
+#include "Tonemapper.hpp"
+#include "VirtualShadowMap.hpp"
+#include "VisibilityBuffer.hpp"
+
+
+/**
+ * Everything the GUI and the debug hotkeys can change. The GUI is built on the thread that
+ * polls the window, which edits its own copy of this, and every frame gets a copy of it.
+ */
+struct RenderSettings
+{
+  enum class RenderPath
+  {
+    Forward,
+    Deferred,
+    VisibilityBuffer,
+  };
+
+  enum class ShadowTechnique
+  {
+    Single = SHADOW_TECHNIQUE_SINGLE,
+    Cascaded = SHADOW_TECHNIQUE_CASCADED,
+    Virtual = SHADOW_TECHNIQUE_VIRTUAL,
+  };
+
+  glm::vec3 baseColor{0.9f, 0.92f, 1.0f};
+
+  RenderPath renderPath = RenderPath::Forward;
+  // Trades an additional geometry pass for shading every visible pixel exactly once
+  bool useDepthPrepass = false;
+  // Debug option to exercise the dynamic shadow caster path on a static scene
+  int animatedCasterCount = 0;
+  bool drawDebugFSQuad = false;
+
+  DynamicResolution::Settings dynamicResolution;
+  TemporalUpscaler::Settings temporalUpscaler;
+  Tonemapper::Settings tonemapper;
+  AutoExposure::Settings autoExposure;
+
+  int spotLightCount = 0;
+  // Stress test for clustered shading, lights without shadows circling around their base position
+  int localLightCount = 0;
+  bool animateLocalLights = true;
+
+  ShadowTechnique shadowTechnique = ShadowTechnique::Single;
+  // Single only
+  bool cacheStaticShadows = true;
+  bool fitToVisibleSamples = false;
+  bool usePerspectiveShadow = false;
+  // Cascaded only
+  bool debugCascades = false;
+  // Submits every caster once for all cascades instead of once per cascade
+  bool useLayeredCascades = true;
+  ShadowCascades::Settings shadowCascades;
+  // Virtual only
+  VirtualShadowMap::Settings virtualShadowMap;
+};
+
+/**
+ * Optional things the device supports, fixed once the device is created.
+ * Settings that need a missing one are hidden in the GUI and ignored.
+ */
+struct RenderCapabilities
+{
+  // Writing gl_Layer from vertex shaders, used to render all shadow cascades in one pass
+  bool layeredCascades = false;
+  // Compute passes writing the B10G11R11 shaded color image, an extended storage format
+  bool shadedColorStorage = false;
+  // gl_PrimitiveID in fragment shaders, which Vulkan ties to the geometry shader feature
+  bool primitiveId = false;
+
+  bool supports(RenderSettings::RenderPath path) const
+  {
+    switch (path)
+    {
+    case RenderSettings::RenderPath::Deferred:
+      return shadedColorStorage;
+    case RenderSettings::RenderPath::VisibilityBuffer:
+      return shadedColorStorage && primitiveId;
+    default:
+      return true;
+    }
+  }
+};
+
+/**
+ * What the GUI displays about recent frames. Published by the thread drawing frames
+ * once a frame is recorded, and copied by the thread building the GUI.
+ */
+struct RenderStats
+{
+  vk::DeviceSize transientMemoryUsed = 0;
+  vk::DeviceSize transientMemorySize = 0;
+  std::optional<DepthReduction::Bounds> visibleBounds;
+  DynamicResolution::Stats dynamicResolution;
+  ShadowAtlas::Stats spotShadowAtlas;
+  ShadowCascades::Stats shadowCascades;
+  VirtualShadowMap::Stats virtualShadowMap;
+  VisibilityBuffer::Stats visibilityBuffer;
+  RenderGraph::Stats renderGraph;
+  std::vector<GpuTimer::Timing> gpuTimings;
+};
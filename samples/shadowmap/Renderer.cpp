@@ -1,5 +1,8 @@
 #include "Renderer.hpp"
 
+#include <algorithm>
+#include <limits>
+
 #include <etna/GlobalContext.hpp>
 #include <etna/Etna.hpp>
 #include <etna/RenderTargetStates.hpp>
@@ -8,6 +11,8 @@
 #include <imgui.h>
 
 #include <gui/ImGuiRenderer.hpp>
+#include <profiling/TraceRecorder.hpp>
+#include <render_utils/DeviceProbe.hpp>
 
 
 Renderer::Renderer(glm::uvec2 res)
@@ -15,7 +20,7 @@ Renderer::Renderer(glm::uvec2 res)
 {
 }
 
-void Renderer::initVulkan(std::span<const char*> instance_extensions)
+void Renderer::initVulkan(std::span<const char*> instance_extensions, bool headless)
 {
   std::vector<const char*> instanceExtensions;
 
@@ -24,19 +29,47 @@ void Renderer::initVulkan(std::span<const char*> instance_extensions)
 
   std::vector<const char*> deviceExtensions;
 
-  deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  // Not even available on some CPU implementations, and not needed without a window
+  if (!headless)
+    deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+  // Replace the override with an index if the preferred GPU is detected incorrectly
+  const auto device = DeviceProbe::probe(deviceExtensions, std::nullopt);
+
+  // Shaders target Vulkan 1.3, where writing gl_Layer from the vertex shader is a core feature.
+  // It renders all shadow cascades at once, but CPU implementations often lack it.
+  capabilities.layeredCascades = device.features12.shaderOutputLayer == VK_TRUE;
+  vk::PhysicalDeviceVulkan12Features features12{
+    .shaderOutputLayer = device.features12.shaderOutputLayer,
+  };
+  // Deferred and visibility buffer compute passes write the B10G11R11 HDR image,
+  // an extended storage image format. The visibility buffer also needs gl_PrimitiveID
+  // in fragment shaders, which requires the geometry shader feature.
+  // Without them only the forward path is available.
+  capabilities.shadedColorStorage = device.features.shaderStorageImageExtendedFormats == VK_TRUE;
+  capabilities.primitiveId = device.features.geometryShader == VK_TRUE;
 
   etna::initialize(etna::InitParams{
     .applicationName = "ShadowmapSample",
     .applicationVersion = VK_MAKE_VERSION(0, 1, 0),
     .instanceExtensions = instanceExtensions,
     .deviceExtensions = deviceExtensions,
-    .features = vk::PhysicalDeviceFeatures2{.features = {}},
-    // Replace with an index if etna detects your preferred GPU incorrectly
-    .physicalDeviceIndexOverride = {},
+    .features = vk::PhysicalDeviceFeatures2{
+      .pNext = &features12,
+      .features =
+        {
+          .geometryShader = device.features.geometryShader,
+          .shaderStorageImageExtendedFormats = device.features.shaderStorageImageExtendedFormats,
+        }},
+    .physicalDeviceIndexOverride = device.physicalDeviceIndex,
     // How much frames we buffer on the GPU without waiting for their completion on the CPU
     .numFramesInFlight = 2,
   });
+
+  auto& ctx = etna::get_context();
+  inFlightFrames.resize(ctx.getMainWorkCount().multiBufferingCount());
+  for (auto& frame : inFlightFrames)
+    frame.done = etna::unwrap_vk_result(ctx.getDevice().createFenceUnique(vk::FenceCreateInfo{}));
 }
 
 void Renderer::initFrameDelivery(vk::UniqueSurfaceKHR a_surface, ResolutionProvider res_provider)
@@ -56,13 +89,37 @@ void Renderer::initFrameDelivery(vk::UniqueSurfaceKHR a_surface, ResolutionProvi
   });
   resolution = {w, h};
 
-  worldRenderer = std::make_unique<WorldRenderer>();
+  initWorldRenderer(window->getCurrentFormat());
+
+  guiRenderer = std::make_unique<ImGuiRenderer>(window->getCurrentFormat());
+
+  shaderReloader = std::make_unique<ShaderHotReloader>(ShaderHotReloader::CreateInfo{
+    .watchedDirectories =
+      {GRAPHICS_COURSE_ROOT "/samples/shadowmap/shaders",
+       GRAPHICS_COURSE_ROOT "/common/render_utils/shaders"},
+    .buildCommand =
+      "cd " GRAPHICS_COURSE_ROOT "/build && "
+      "cmake --build . --target shadowmap_shaders render_utils_shaders",
+  });
+}
+
+void Renderer::initHeadlessFrameDelivery()
+{
+  auto& ctx = etna::get_context();
+
+  commandManager = ctx.createPerFrameCmdMgr();
+  headlessTarget = std::make_unique<HeadlessTarget>(vk::Extent2D{resolution.x, resolution.y});
+
+  initWorldRenderer(HeadlessTarget::FORMAT);
+}
+
+void Renderer::initWorldRenderer(vk::Format target_format)
+{
+  worldRenderer = std::make_unique<WorldRenderer>(capabilities);
 
   worldRenderer->allocateResources(resolution);
   worldRenderer->loadShaders();
-  worldRenderer->setupPipelines(window->getCurrentFormat());
-
-  guiRenderer = std::make_unique<ImGuiRenderer>(window->getCurrentFormat());
+  worldRenderer->setupPipelines(target_format);
 }
 
 void Renderer::recreateSwapchain(glm::uvec2 res)
@@ -80,7 +137,7 @@ void Renderer::recreateSwapchain(glm::uvec2 res)
   // Most resources depend on the current resolution, so we recreate them.
   worldRenderer->allocateResources(resolution);
 
-  // Format of the swapchain CAN change on android
+  // Format of the swapchain CAN change on android, if it didn't, this is a no-op
   worldRenderer->setupPipelines(window->getCurrentFormat());
 }
 
@@ -91,39 +148,68 @@ void Renderer::loadScene(std::filesystem::path path)
 
 void Renderer::debugInput(const Keyboard& kb)
 {
-  worldRenderer->debugInput(kb);
+  WorldRenderer::debugInput(settings, kb);
 
+  // Shaders are also rebuilt automatically whenever their sources change
   if (kb[KeyboardKey::kB] == ButtonState::Falling)
+    shaderReloader->requestRebuild();
+}
+
+void Renderer::reloadShadersIfReady()
+{
+  if (!shaderReloader || !shaderReloader->consumeFinishedBuild())
+    return;
+
+  TRACE_ZONE;
+
+  // Compilation already happened in the background. Programs and pipelines are recreated
+  // in place, so only the frames that were already submitted have to finish first.
+  for (auto& frame : inFlightFrames)
+    waitForFrame(frame);
+  worldRenderer->reloadShaders();
+  spdlog::info("Successfully reloaded shaders!");
+}
+
+void Renderer::prepareFramePacket(FramePacket& packet)
+{
+  if (guiRenderer)
   {
-    const int retval = std::system("cd " GRAPHICS_COURSE_ROOT "/build"
-                                   " && cmake --build . --target shadowmap_shaders");
-    if (retval != 0)
-      spdlog::warn("Shader recompilation returned a non-zero return code!");
-    else
+    TRACE_ZONE_N("drawGui");
+    guiRenderer->nextFrame();
+    ImGui::NewFrame();
+    WorldRenderer::drawGui(settings, worldRenderer->getStats(), capabilities);
+    if (shaderReloader && shaderReloader->isBuilding())
     {
-      ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
-      etna::reload_shaders();
-      spdlog::info("Successfully reloaded shaders!");
+      // Appends to the window of the settings, right below the hint on reloading
+      ImGui::Begin("Simple render settings");
+      ImGui::TextColored(ImVec4(1.0f, 0.5f, 0.0f, 1.0f), "Compiling shaders...");
+      ImGui::End();
     }
+    drawPacingGui();
+    ImGui::Render();
+
+    packet.gui = std::make_shared<ImGuiDrawSnapshot>(*ImGui::GetDrawData());
   }
+
+  packet.settings = settings;
 }
 
 void Renderer::update(const FramePacket& packet)
 {
+  currentGui = packet.gui;
+  currentInputNs = packet.inputTimeNs;
   worldRenderer->update(packet);
 }
 
 void Renderer::drawFrame()
 {
-  ZoneScoped;
+  TRACE_ZONE;
 
-  {
-    ZoneScopedN("drawGui");
-    guiRenderer->nextFrame();
-    ImGui::NewFrame();
-    worldRenderer->drawGui();
-    ImGui::Render();
-  }
+  // Between frames is the only point where nothing is being recorded
+  reloadShadersIfReady();
+
+  // Usually a no-op, as etna already waited for this frame slot or waitBeforeInput did
+  waitForFrame(inFlightFrames[frameIndex % inFlightFrames.size()]);
 
   auto currentCmdBuf = commandManager->acquireNext();
 
@@ -131,6 +217,14 @@ void Renderer::drawFrame()
   // it doesn't actually begin anything, just resets descriptor pools
   etna::begin_frame();
 
+  if (window)
+    drawFrameToWindow(currentCmdBuf);
+  else
+    drawFrameHeadless(currentCmdBuf);
+}
+
+void Renderer::drawFrameToWindow(vk::CommandBuffer cmd_buf)
+{
   auto nextSwapchainImage = window->acquireNext();
 
   // NOTE: here, we skip frames when the window is in the process of being
@@ -141,39 +235,40 @@ void Renderer::drawFrame()
   {
     auto [image, view, availableSem] = *nextSwapchainImage;
 
-    ETNA_CHECK_VK_RESULT(currentCmdBuf.begin(vk::CommandBufferBeginInfo{}));
+    ETNA_CHECK_VK_RESULT(cmd_buf.begin(vk::CommandBufferBeginInfo{}));
     {
-      ETNA_PROFILE_GPU(currentCmdBuf, renderFrame);
+      ETNA_PROFILE_GPU(cmd_buf, renderFrame);
 
-      worldRenderer->renderWorld(currentCmdBuf, image, view);
+      worldRenderer->renderWorld(cmd_buf, image, view);
 
-      {
-        ImDrawData* pDrawData = ImGui::GetDrawData();
+      if (currentGui)
         guiRenderer->render(
-          currentCmdBuf, {{0, 0}, {resolution.x, resolution.y}}, image, view, pDrawData);
-      }
+          cmd_buf, {{0, 0}, {resolution.x, resolution.y}}, image, view, currentGui->get());
 
       etna::set_state(
-        currentCmdBuf,
+        cmd_buf,
         image,
         vk::PipelineStageFlagBits2::eColorAttachmentOutput,
         {},
         vk::ImageLayout::ePresentSrcKHR,
         vk::ImageAspectFlagBits::eColor);
 
-      etna::flush_barriers(currentCmdBuf);
+      etna::flush_barriers(cmd_buf);
 
-      ETNA_READ_BACK_GPU_PROFILING(currentCmdBuf);
+      ETNA_READ_BACK_GPU_PROFILING(cmd_buf);
     }
-    ETNA_CHECK_VK_RESULT(currentCmdBuf.end());
+    ETNA_CHECK_VK_RESULT(cmd_buf.end());
 
-    auto renderingDone = commandManager->submit(std::move(currentCmdBuf), std::move(availableSem));
+    auto renderingDone = commandManager->submit(std::move(cmd_buf), std::move(availableSem));
+    trackFrame(true);
 
     const bool presented = window->present(std::move(renderingDone), view);
 
     if (!presented)
       nextSwapchainImage = std::nullopt;
   }
+  else
+    trackFrame(false);
 
   etna::end_frame();
 
@@ -187,6 +282,124 @@ void Renderer::drawFrame()
   }
 }
 
+void Renderer::drawFrameHeadless(vk::CommandBuffer cmd_buf)
+{
+  ETNA_CHECK_VK_RESULT(cmd_buf.begin(vk::CommandBufferBeginInfo{}));
+  {
+    ETNA_PROFILE_GPU(cmd_buf, renderFrame);
+
+    const auto& target = headlessTarget->getImage();
+    worldRenderer->renderWorld(cmd_buf, target.get(), target.getView({}));
+
+    headlessTarget->recordCapture(cmd_buf);
+
+    ETNA_READ_BACK_GPU_PROFILING(cmd_buf);
+  }
+  ETNA_CHECK_VK_RESULT(cmd_buf.end());
+
+  headlessTarget->submit(*commandManager, cmd_buf);
+  trackFrame(true);
+
+  etna::end_frame();
+}
+
+void Renderer::captureNextFrame(std::filesystem::path path)
+{
+  ETNA_VERIFYF(headlessTarget, "Frame capture is only supported in headless mode");
+  headlessTarget->captureNextFrame(std::move(path));
+}
+
+std::span<const GpuTimer::Timing> Renderer::getGpuTimings() const
+{
+  return worldRenderer->getGpuTimings();
+}
+
+void Renderer::waitBeforeInput()
+{
+  if (framePacing != FramePacing::LowLatency)
+    return;
+
+  TRACE_ZONE;
+
+  // Whatever the CPU would otherwise wait for when acquiring a frame slot is waited for here,
+  // before input is sampled rather than after, so the input is as fresh as possible.
+  // NOTE: VK_KHR_present_wait would allow waiting for the actual presentation, but it requires
+  // a present id to be chained into vkQueuePresentKHR, which etna::Window does not allow.
+  waitForFrame(inFlightFrames[frameIndex % inFlightFrames.size()]);
+}
+
+void Renderer::waitForFrame(InFlightFrame& frame)
+{
+  if (!frame.pending)
+    return;
+
+  auto device = etna::get_context().getDevice();
+  ETNA_CHECK_VK_RESULT(
+    device.waitForFences({frame.done.get()}, VK_TRUE, std::numeric_limits<std::uint64_t>::max()));
+  ETNA_CHECK_VK_RESULT(device.resetFences({frame.done.get()}));
+  frame.pending = false;
+}
+
+static float ns_to_ms(std::uint64_t ns)
+{
+  return static_cast<float>(static_cast<double>(ns) * 1e-6);
+}
+
+void Renderer::trackFrame(bool submitted)
+{
+  auto& frame = inFlightFrames[frameIndex++ % inFlightFrames.size()];
+
+  // Recording of the current frame has read back GPU timings of the previous one in this slot
+  if (frame.submitNs != 0)
+  {
+    std::uint64_t gpuDoneNs = frame.submitNs;
+    for (const auto& timing : worldRenderer->getGpuTimings())
+      if (timing.depth == 0)
+        gpuDoneNs = std::max(gpuDoneNs, timing.endNs);
+
+    lastLatency = FrameLatency{
+      .inputToSubmitMs = ns_to_ms(frame.submitNs - std::min(frame.inputNs, frame.submitNs)),
+      .submitToGpuDoneMs = ns_to_ms(gpuDoneNs - frame.submitNs),
+    };
+
+    // Smoothed, so that the numbers in the GUI are readable
+    constexpr float alpha = 0.05f;
+    std::lock_guard lock(latencyMutex);
+    averageLatency.inputToSubmitMs =
+      glm::mix(averageLatency.inputToSubmitMs, lastLatency->inputToSubmitMs, alpha);
+    averageLatency.submitToGpuDoneMs =
+      glm::mix(averageLatency.submitToGpuDoneMs, lastLatency->submitToGpuDoneMs, alpha);
+  }
+
+  if (!submitted)
+  {
+    frame.submitNs = 0;
+    return;
+  }
+
+  frame.inputNs = currentInputNs;
+  frame.submitNs = TraceRecorder::now();
+  // Fence signal operations cover all previously submitted work, so this one
+  // is signaled exactly when the GPU is done with the frame
+  ETNA_CHECK_VK_RESULT(etna::get_context().getQueue().submit({}, frame.done.get()));
+  frame.pending = true;
+}
+
+void Renderer::drawPacingGui()
+{
+  const FrameLatency latency = [this]() {
+    std::lock_guard lock(latencyMutex);
+    return averageLatency;
+  }();
+
+  ImGui::Begin("Frame pacing");
+  ImGui::Text(
+    "Mode: %s", framePacing == FramePacing::LowLatency ? "low latency" : "throughput");
+  ImGui::Text("Input to submit: %.2f ms", latency.inputToSubmitMs);
+  ImGui::Text("Submit to GPU done: %.2f ms", latency.submitToGpuDoneMs);
+  ImGui::End();
+}
+
 Renderer::~Renderer()
 {
   ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
@@ -1,11 +1,15 @@
 #pragma once
 
+#include <mutex>
+
 #include <etna/GlobalContext.hpp>
 #include <etna/PerFrameCmdMgr.hpp>
 #include <glm/glm.hpp>
 #include <function2/function2.hpp>
 
 #include "wsi/Keyboard.hpp"
+#include "render_utils/HeadlessTarget.hpp"
+#include "render_utils/ShaderHotReloader.hpp"
 
 #include "FramePacket.hpp"
 #include "WorldRenderer.hpp"
@@ -22,19 +26,70 @@ using ResolutionProvider = fu2::unique_function<glm::uvec2() const>;
 class Renderer
 {
 public:
+  enum class FramePacing
+  {
+    // Lets etna queue up to numFramesInFlight frames, input is sampled before waiting for them
+    Throughput,
+    // Waits for the oldest frame in flight right before input is sampled
+    LowLatency,
+  };
+
+  struct FrameLatency
+  {
+    float inputToSubmitMs = 0;
+    float submitToGpuDoneMs = 0;
+  };
+
   explicit Renderer(glm::uvec2 resolution);
   ~Renderer();
 
   // Initializing all of rendering is a tricky multi-step dance
-  void initVulkan(std::span<const char*> instance_extensions);
+  void initVulkan(std::span<const char*> instance_extensions, bool headless = false);
   void initFrameDelivery(vk::UniqueSurfaceKHR surface, ResolutionProvider res_provider);
+  // Renders into an offscreen image instead of a swapchain, no window or GUI required
+  void initHeadlessFrameDelivery();
   void recreateSwapchain(glm::uvec2 res);
   void loadScene(std::filesystem::path path);
 
-  void debugInput(const Keyboard& kb);
   void update(const FramePacket& packet);
   void drawFrame();
 
+  // These two must be called by the thread that polls the window, which might not be
+  // the one drawing frames. They only edit settings that are sent with the next packet.
+  void debugInput(const Keyboard& kb);
+  // Builds the GUI, if there is one, and fills in the settings
+  void prepareFramePacket(FramePacket& packet);
+
+  // Headless only. Writes the next drawn frame into a PNG file.
+  void captureNextFrame(std::filesystem::path path);
+
+  std::span<const GpuTimer::Timing> getGpuTimings() const;
+
+  void setFramePacing(FramePacing pacing) { framePacing = pacing; }
+  // Must be called by the same thread as drawFrame, right before input for the next frame is
+  // sampled. Does nothing unless pacing is set to low latency.
+  void waitBeforeInput();
+  // Of the latest frame whose GPU timings were read back, lags behind by the frames in flight
+  std::optional<FrameLatency> getLastFrameLatency() const { return lastLatency; }
+
+private:
+  void initWorldRenderer(vk::Format target_format);
+  void reloadShadersIfReady();
+  void drawFrameToWindow(vk::CommandBuffer cmd_buf);
+  void drawFrameHeadless(vk::CommandBuffer cmd_buf);
+  void drawPacingGui();
+
+  struct InFlightFrame
+  {
+    // Signaled by an empty submit right after the frame, i.e. once the GPU is done with it
+    vk::UniqueFence done;
+    bool pending = false;
+    std::uint64_t inputNs = 0;
+    std::uint64_t submitNs = 0;
+  };
+  void waitForFrame(InFlightFrame& frame);
+  // Must be called once per drawFrame, right after submitting it, if anything was submitted
+  void trackFrame(bool submitted);
 
 private:
   ResolutionProvider resolutionProvider;
@@ -42,7 +97,26 @@ private:
   std::unique_ptr<etna::PerFrameCmdMgr> commandManager;
 
   glm::uvec2 resolution;
+  RenderCapabilities capabilities;
   std::unique_ptr<ImGuiRenderer> guiRenderer;
+  // Owned by the thread that polls the window, edited by the GUI and hotkeys
+  RenderSettings settings;
+  // Of the frame being drawn
+  std::shared_ptr<ImGuiDrawSnapshot> currentGui;
 
   std::unique_ptr<WorldRenderer> worldRenderer;
+
+  std::unique_ptr<ShaderHotReloader> shaderReloader;
+
+  FramePacing framePacing = FramePacing::Throughput;
+  std::vector<InFlightFrame> inFlightFrames;
+  std::uint64_t frameIndex = 0;
+  std::uint64_t currentInputNs = 0;
+  std::optional<FrameLatency> lastLatency;
+  // Displayed by the GUI, which might be built on a different thread
+  mutable std::mutex latencyMutex;
+  FrameLatency averageLatency;
+
+  // Replaces the window in headless mode
+  std::unique_ptr<HeadlessTarget> headlessTarget;
 };
@@ -0,0 +1,240 @@
+#include "ShadowAtlas.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+#include <etna/Assert.hpp>
+#include <etna/GlobalContext.hpp>
+#include <etna/Profiling.hpp>
+#include <imgui.h>
+
+#include "profiling/TraceRecorder.hpp"
+
+
+// Tiles are placed along a Z-order curve. As long as they are placed from
+// the largest to the smallest, every tile ends up aligned and nothing overlaps.
+static glm::uvec2 morton_decode(std::uint32_t code)
+{
+  glm::uvec2 result{0};
+  for (std::uint32_t bit = 0; bit < 16; ++bit)
+  {
+    result.x |= ((code >> (2 * bit)) & 1u) << bit;
+    result.y |= ((code >> (2 * bit + 1)) & 1u) << bit;
+  }
+  return result;
+}
+
+static glm::mat4x4 spot_light_matrix(const SpotLight& light)
+{
+  // Any vector that isn't parallel to the direction works as an up vector
+  const glm::vec3 up =
+    std::abs(light.direction.y) > 0.99f ? glm::vec3{1, 0, 0} : glm::vec3{0, 1, 0};
+
+  Camera lightCam{
+    .position = light.position,
+    .rotation = {},
+    .fov = 2.0f * light.outerAngle,
+    .zNear = 0.1f,
+    .zFar = light.range,
+  };
+  lightCam.lookAt(light.position, light.position + light.direction, up);
+
+  return lightCam.projTm(1.0f) * lightCam.viewTm();
+}
+
+ShadowAtlas::ShadowAtlas()
+{
+  auto& ctx = etna::get_context();
+
+  atlas = ctx.createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{RESOLUTION, RESOLUTION, 1},
+    .name = "spot_shadow_atlas",
+    .format = vk::Format::eD16Unorm,
+    .imageUsage =
+      vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
+  });
+}
+
+void ShadowAtlas::update(
+  std::span<const SpotLight> lights,
+  const Camera& main_cam,
+  SceneManager& scene,
+  std::span<const std::uint32_t> dynamic_instances,
+  TransientAllocator& transient_memory)
+{
+  TRACE_ZONE;
+
+  ETNA_VERIFYF(
+    lights.size() <= MAX_SPOT_LIGHTS, "Too many spot lights, max is {}", MAX_SPOT_LIGHTS);
+
+  tilesToRender.clear();
+
+  if (invalidated || scene.getStaticGeometryVersion() != lastStaticGeometryVersion)
+  {
+    invalidated = false;
+    lastStaticGeometryVersion = scene.getStaticGeometryVersion();
+    shadows.clear();
+  }
+  shadows.resize(lights.size());
+
+  const auto previousShadows = shadows;
+  packTiles(lights, main_cam);
+
+  std::vector<BoundingBox> dynamicBounds;
+  dynamicBounds.reserve(dynamic_instances.size());
+  for (const auto instIdx : dynamic_instances)
+    dynamicBounds.push_back(scene.getInstanceBounds(instIdx));
+
+  const auto touchedByDynamicCasters = [&](const glm::mat4x4& matrix) {
+    const auto inside = [&matrix](const BoundingBox& bounds) {
+      return !bounds.outsideFrustum(matrix);
+    };
+    // Casters that left the frustum must be erased from the shadow as well
+    return std::any_of(dynamicBounds.begin(), dynamicBounds.end(), inside) ||
+      std::any_of(previousDynamicBounds.begin(), previousDynamicBounds.end(), inside);
+  };
+
+  const auto instanceCount = static_cast<std::uint32_t>(scene.getInstanceMatrices().size());
+  for (std::size_t i = 0; i < lights.size(); ++i)
+  {
+    auto& shadow = shadows[i];
+    const auto& previous = previousShadows[i];
+
+    shadow.matrix = spot_light_matrix(lights[i]);
+    if (shadow.rect.extent.width == 0)
+    {
+      shadow.valid = false;
+      continue;
+    }
+
+    const bool upToDate = previous.valid && previous.rect == shadow.rect &&
+      previous.matrix == shadow.matrix && !touchedByDynamicCasters(shadow.matrix);
+    shadow.valid = true;
+    if (upToDate)
+      continue;
+
+    auto& tile = tilesToRender.emplace_back(TileToRender{
+      .matrix = shadow.matrix,
+      .rect = shadow.rect,
+      .casters = {},
+    });
+    for (std::uint32_t instIdx = 0; instIdx < instanceCount; ++instIdx)
+      if (!scene.getInstanceBounds(instIdx).outsideFrustum(shadow.matrix))
+        tile.casters.push_back(instIdx);
+  }
+
+  previousDynamicBounds = std::move(dynamicBounds);
+
+  lightBuffer = transient_memory.allocate(lights.size() * sizeof(SpotLightData));
+  auto* lightData = reinterpret_cast<SpotLightData*>(lightBuffer.data);
+  for (std::size_t i = 0; i < lights.size(); ++i)
+  {
+    const auto& rect = shadows[i].rect;
+    lightData[i] = SpotLightData{
+      .matrix = shadows[i].matrix,
+      .shadowRect =
+        glm::vec4{
+          static_cast<float>(rect.offset.x),
+          static_cast<float>(rect.offset.y),
+          static_cast<float>(rect.extent.width),
+          static_cast<float>(rect.extent.height)} /
+        static_cast<float>(RESOLUTION),
+      .position = lights[i].position,
+      .range = lights[i].range,
+      .direction = lights[i].direction,
+      .cosOuterAngle = std::cos(glm::radians(lights[i].outerAngle)),
+      .color = lights[i].color,
+      .padding0 = 0,
+    };
+  }
+}
+
+void ShadowAtlas::packTiles(std::span<const SpotLight> lights, const Camera& main_cam)
+{
+  // Rough estimate of how big the light's area of influence is on the screen
+  std::vector<float> importance(lights.size());
+  for (std::size_t i = 0; i < lights.size(); ++i)
+  {
+    const glm::vec3 toLight = lights[i].position - main_cam.position;
+    const float distance = std::max(glm::length(toLight), 0.01f);
+    importance[i] = lights[i].range / distance;
+    // Lights behind the camera only matter for shadows entering the view
+    if (glm::dot(toLight, main_cam.forward()) < -lights[i].range)
+      importance[i] *= 0.25f;
+  }
+
+  std::vector<std::uint32_t> order(lights.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&importance](std::uint32_t a, std::uint32_t b) {
+    return importance[a] > importance[b];
+  });
+
+  std::vector<std::uint32_t> tileSizes(lights.size());
+  std::uint64_t demand = 0;
+  for (const auto lightIdx : order)
+  {
+    std::uint32_t size = MAX_TILE_SIZE;
+    for (float threshold = 1.0f; size > MIN_TILE_SIZE && importance[lightIdx] < threshold;
+         threshold *= 0.5f)
+      size /= 2;
+    tileSizes[lightIdx] = size;
+    demand += std::uint64_t{size} * size;
+  }
+
+  // Shrink the least important tiles until everything fits
+  const std::uint64_t capacity = std::uint64_t{RESOLUTION} * RESOLUTION;
+  for (auto it = order.rbegin(); demand > capacity && it != order.rend();)
+  {
+    auto& size = tileSizes[*it];
+    if (size == MIN_TILE_SIZE)
+    {
+      ++it;
+      continue;
+    }
+    demand -= std::uint64_t{size} * size * 3 / 4;
+    size /= 2;
+  }
+
+  // Shrinking might have broken the order of sizes, which the packing relies upon
+  std::stable_sort(order.begin(), order.end(), [&tileSizes](std::uint32_t a, std::uint32_t b) {
+    return tileSizes[a] > tileSizes[b];
+  });
+
+  constexpr std::uint32_t CELLS_PER_SIDE = RESOLUTION / MIN_TILE_SIZE;
+  std::uint32_t cursor = 0;
+  for (const auto lightIdx : order)
+  {
+    const std::uint32_t cellsPerSide = tileSizes[lightIdx] / MIN_TILE_SIZE;
+    const std::uint32_t cells = cellsPerSide * cellsPerSide;
+    if (cursor + cells > CELLS_PER_SIDE * CELLS_PER_SIDE)
+    {
+      shadows[lightIdx].rect = vk::Rect2D{};
+      continue;
+    }
+
+    const glm::uvec2 cell = morton_decode(cursor);
+    shadows[lightIdx].rect = vk::Rect2D{
+      .offset =
+        {static_cast<std::int32_t>(cell.x * MIN_TILE_SIZE),
+         static_cast<std::int32_t>(cell.y * MIN_TILE_SIZE)},
+      .extent = {tileSizes[lightIdx], tileSizes[lightIdx]},
+    };
+    cursor += cells;
+  }
+}
+
+ShadowAtlas::Stats ShadowAtlas::getStats() const
+{
+  return Stats{
+    .shadowedLights = static_cast<std::size_t>(std::count_if(
+      shadows.begin(), shadows.end(), [](const LightShadow& shadow) { return shadow.valid; })),
+    .lightCount = shadows.size(),
+    .tilesRendered = tilesToRender.size(),
+  };
+}
+
+void ShadowAtlas::drawGui(const Stats& stats)
+{
+  ImGui::Text("Shadowed spot lights: %zu / %zu", stats.shadowedLights, stats.lightCount);
+  ImGui::Text("Shadow tiles rendered last frame: %zu", stats.tilesRendered);
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include <etna/Buffer.hpp>
+#include <etna/Image.hpp>
+#include <glm/glm.hpp>
+
+#include "scene/Camera.hpp"
+#include "scene/SceneManager.hpp"
+#include "render_utils/TransientAllocator.hpp"
+#include "shaders/SpotLight.h"
+
+
+struct SpotLight
+{
+  glm::vec3 position;
+  glm::vec3 direction;
+  glm::vec3 color;
+  float range;
+  // Half of the cone angle, in degrees
+  float outerAngle;
+};
+
+/**
+ * Packs shadow maps of many spot lights into a single atlas. Lights that
+ * cover more of the screen get bigger tiles. A light's tile is only
+ * re-rendered when the tile moved or a dynamic caster inside of its
+ * frustum changed, so static lights cost nothing after the first frame.
+ */
+class ShadowAtlas
+{
+public:
+  static constexpr std::uint32_t RESOLUTION = 4096;
+  static constexpr std::uint32_t MIN_TILE_SIZE = 128;
+  static constexpr std::uint32_t MAX_TILE_SIZE = 1024;
+
+  struct TileToRender
+  {
+    glm::mat4x4 matrix;
+    vk::Rect2D rect;
+    std::vector<std::uint32_t> casters;
+  };
+
+  struct Stats
+  {
+    std::size_t shadowedLights = 0;
+    std::size_t lightCount = 0;
+    std::size_t tilesRendered = 0;
+  };
+
+  ShadowAtlas();
+
+  // The light buffer of the current frame is allocated from transient_memory
+  void update(
+    std::span<const SpotLight> lights,
+    const Camera& main_cam,
+    SceneManager& scene,
+    std::span<const std::uint32_t> dynamic_instances,
+    TransientAllocator& transient_memory);
+
+  void invalidate() { invalidated = true; }
+
+  Stats getStats() const;
+
+  static void drawGui(const Stats& stats);
+
+  std::span<const TileToRender> getTilesToRender() const { return tilesToRender; }
+  const etna::Image& getAtlas() const { return atlas; }
+  // Light buffer to be used by the current frame
+  const TransientAllocator::Allocation& getLightBuffer() const { return lightBuffer; }
+
+private:
+  struct LightShadow
+  {
+    glm::mat4x4 matrix{1.0f};
+    // Empty if the light didn't get a tile
+    vk::Rect2D rect{};
+    bool valid = false;
+  };
+
+  void packTiles(std::span<const SpotLight> lights, const Camera& main_cam);
+
+private:
+  etna::Image atlas;
+  TransientAllocator::Allocation lightBuffer;
+
+  std::vector<LightShadow> shadows;
+  std::vector<TileToRender> tilesToRender;
+  std::vector<BoundingBox> previousDynamicBounds;
+
+  std::uint64_t lastStaticGeometryVersion = 0;
+  bool invalidated = true;
+};
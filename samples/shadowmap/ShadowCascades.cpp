@@ -0,0 +1,173 @@
+#include "ShadowCascades.hpp"
+
+#include <fmt/format.h>
+#include <imgui.h>
+
+
+static std::array<glm::vec3, 8> frustum_slice_corners(
+  const Camera& cam, float aspect, float near_depth, float far_depth)
+{
+  const float tanHalfFov = std::tan(glm::radians(cam.fov) * 0.5f);
+
+  std::array<glm::vec3, 8> result;
+  for (int i = 0; i < 8; ++i)
+  {
+    const float depth = (i & 4) != 0 ? far_depth : near_depth;
+    const float halfHeight = depth * tanHalfFov;
+    const float halfWidth = halfHeight * aspect;
+    result[i] = cam.position + cam.forward() * depth +
+      cam.up() * ((i & 1) != 0 ? halfHeight : -halfHeight) +
+      cam.right() * ((i & 2) != 0 ? halfWidth : -halfWidth);
+  }
+  return result;
+}
+
+ShadowCascades::ShadowCascades(std::uint32_t a_resolution)
+  : resolution{a_resolution}
+{
+}
+
+void ShadowCascades::update(
+  const Camera& main_cam, float aspect, const Camera& light_cam, SceneManager& scene)
+{
+  ++frameIndex;
+
+  const glm::vec3 lightDir = light_cam.forward();
+  const glm::vec3 lightUp = light_cam.up();
+  if (
+    settings != lastSettings || lightDir != lastLightDir || lightUp != lastLightUp ||
+    scene.getStaticGeometryVersion() != lastStaticGeometryVersion)
+  {
+    lastSettings = settings;
+    lastLightDir = lightDir;
+    lastLightUp = lightUp;
+    lastStaticGeometryVersion = scene.getStaticGeometryVersion();
+    forceUpdate = true;
+  }
+
+  const float nearDepth = std::max(main_cam.zNear, 0.1f);
+  const float farDepth =
+    std::max(std::min(settings.shadowDistance, main_cam.zFar), nearDepth + 1.0f);
+
+  updatedLastFrame = 0;
+  float sliceNear = nearDepth;
+  for (int i = 0; i < settings.cascadeCount; ++i)
+  {
+    auto& cascade = cascades[i];
+
+    // Practical split scheme, see "Parallel-Split Shadow Maps"
+    const float t = static_cast<float>(i + 1) / static_cast<float>(settings.cascadeCount);
+    const float logSplit = nearDepth * std::pow(farDepth / nearDepth, t);
+    const float uniformSplit = nearDepth + (farDepth - nearDepth) * t;
+    cascade.splitFar = glm::mix(uniformSplit, logSplit, settings.splitLambda);
+
+    const auto corners = frustum_slice_corners(main_cam, aspect, sliceNear, cascade.splitFar);
+    sliceNear = cascade.splitFar;
+
+    // A bounding sphere doesn't change size when the camera rotates, which
+    // together with texel snapping makes the cascades stable.
+    glm::vec3 center{0};
+    for (const auto& corner : corners)
+      center += corner;
+    center /= static_cast<float>(corners.size());
+
+    float radius = 0;
+    for (const auto& corner : corners)
+      radius = std::max(radius, glm::length(corner - center));
+    radius = std::ceil(radius * 16.0f) / 16.0f;
+
+    const bool stillCovered =
+      glm::length(center - cascade.coveredCenter) + radius <= cascade.coveredRadius;
+    const auto period = static_cast<std::uint64_t>(std::max(settings.updatePeriods[i], 1));
+    // Offset by the index so that the cascades don't all get updated on the same frame
+    const bool scheduled = (frameIndex + static_cast<std::uint64_t>(i)) % period == 0;
+
+    cascade.needsUpdate = forceUpdate || !stillCovered || scheduled;
+    if (!cascade.needsUpdate)
+      continue;
+
+    cascade.coveredCenter = center;
+    cascade.coveredRadius = radius * (1.0f + settings.slackFraction);
+    cascade.matrix = fitCascade(center, cascade.coveredRadius, light_cam);
+    ++updatedLastFrame;
+  }
+
+  forceUpdate = false;
+
+  cullCasters(scene);
+}
+
+glm::mat4x4 ShadowCascades::fitCascade(glm::vec3 center, float radius, const Camera& light_cam)
+  const
+{
+  const float backOffset = radius + settings.casterMargin;
+
+  Camera cascadeCam = light_cam;
+  cascadeCam.lookAt(center - light_cam.forward() * backOffset, center, light_cam.up());
+  const glm::mat4x4 view = cascadeCam.viewTm();
+
+  auto proj = glm::orthoLH_ZO(+radius, -radius, +radius, -radius, 0.0f, backOffset + radius);
+
+  // Snap the projection to whole texels so that shadow edges don't shimmer when
+  // the camera moves. Light orientation is fixed, so the world origin landing
+  // on a texel corner means that all other texels are aligned as well.
+  const glm::vec4 origin = proj * view * glm::vec4(0, 0, 0, 1);
+  const float halfRes = static_cast<float>(resolution) * 0.5f;
+  const glm::vec2 originTexels = glm::vec2(origin) * halfRes;
+  const glm::vec2 offset = (glm::round(originTexels) - originTexels) / halfRes;
+  proj[3][0] += offset.x;
+  proj[3][1] += offset.y;
+
+  return proj * view;
+}
+
+void ShadowCascades::cullCasters(SceneManager& scene)
+{
+  for (auto& cascade : getCascades())
+    if (cascade.needsUpdate)
+      cascade.casters.clear();
+
+  const auto instanceCount = static_cast<std::uint32_t>(scene.getInstanceMatrices().size());
+  for (std::uint32_t instIdx = 0; instIdx < instanceCount; ++instIdx)
+  {
+    const BoundingBox bounds = scene.getInstanceBounds(instIdx);
+
+    for (auto& cascade : getCascades())
+    {
+      if (!cascade.needsUpdate)
+        continue;
+
+      // The projection is orthographic, so there is no perspective division to care about
+      const BoundingBox clipBounds = bounds.transformed(cascade.matrix);
+      const bool outside = clipBounds.max.x < -1.0f || clipBounds.min.x > 1.0f ||
+        clipBounds.max.y < -1.0f || clipBounds.min.y > 1.0f || clipBounds.max.z < 0.0f ||
+        clipBounds.min.z > 1.0f;
+
+      if (!outside)
+        cascade.casters.push_back(instIdx);
+    }
+  }
+}
+
+void ShadowCascades::fillUniforms(UniformParams& params) const
+{
+  params.cascadeCount = static_cast<shader_uint>(settings.cascadeCount);
+  for (int i = 0; i < settings.cascadeCount; ++i)
+  {
+    params.cascadeMatrices[i] = cascades[i].matrix;
+    params.cascadeSplits[i] = cascades[i].splitFar;
+  }
+}
+
+void ShadowCascades::drawGui(Settings& settings, const Stats& stats)
+{
+  ImGui::SliderInt("Cascade count", &settings.cascadeCount, 1, MAX_SHADOW_CASCADES);
+  ImGui::SliderFloat("Split lambda", &settings.splitLambda, 0.0f, 1.0f);
+  ImGui::SliderFloat("Shadow distance", &settings.shadowDistance, 10.0f, 500.0f);
+  ImGui::SliderFloat("Caster margin", &settings.casterMargin, 0.0f, 100.0f);
+  ImGui::SliderFloat("Cascade slack", &settings.slackFraction, 0.0f, 0.5f);
+  for (int i = 0; i < settings.cascadeCount; ++i)
+    ImGui::SliderInt(
+      fmt::format("Cascade {} update period", i).c_str(), &settings.updatePeriods[i], 1, 16);
+  ImGui::Text("Cascades re-rendered last frame: %d", stats.updatedLastFrame);
+}
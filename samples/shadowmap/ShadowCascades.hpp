@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "shaders/UniformParams.h"
+#include "scene/Camera.hpp"
+#include "scene/SceneManager.hpp"
+
+
+/**
+ * Cascaded shadow maps for a directional light. Splits the main camera frustum
+ * into several slices and fits a texel-snapped orthographic projection around each one.
+ * Far cascades are expensive and change slowly, so they are only re-rendered every few
+ * frames, or earlier if the camera moved so far that their contents became unusable.
+ */
+class ShadowCascades
+{
+public:
+  struct Settings
+  {
+    int cascadeCount = MAX_SHADOW_CASCADES;
+    // 0 means uniform splits, 1 means logarithmic splits, values in between blend the two
+    float splitLambda = 0.8f;
+    float shadowDistance = 100.0f;
+    // Casters this far behind a cascade towards the light still cast shadows into it
+    float casterMargin = 30.0f;
+    // Cascade i is re-rendered at least every updatePeriods[i] frames
+    std::array<int, MAX_SHADOW_CASCADES> updatePeriods{1, 2, 4, 8};
+    // Cascades are fitted with this much slack so that they stay valid while the camera moves
+    float slackFraction = 0.1f;
+
+    bool operator==(const Settings&) const = default;
+  };
+
+  struct Stats
+  {
+    int updatedLastFrame = 0;
+  };
+
+  struct Cascade
+  {
+    // Light view-projection the current contents of the cascade were rendered with
+    glm::mat4x4 matrix{1.0f};
+    // View depth of the far plane of the camera frustum slice
+    float splitFar = 0;
+    // The sphere covered by the current contents of the cascade
+    glm::vec3 coveredCenter{0};
+    float coveredRadius = -1;
+    bool needsUpdate = true;
+    std::vector<std::uint32_t> casters;
+  };
+
+  explicit ShadowCascades(std::uint32_t resolution);
+
+  // Fits the cascades to the camera and selects the ones that have to be re-rendered
+  void update(const Camera& main_cam, float aspect, const Camera& light_cam, SceneManager& scene);
+
+  void invalidate() { forceUpdate = true; }
+
+  void fillUniforms(UniformParams& params) const;
+
+  Stats getStats() const { return Stats{.updatedLastFrame = updatedLastFrame}; }
+
+  static void drawGui(Settings& settings, const Stats& stats);
+
+  std::span<Cascade> getCascades()
+  {
+    return {cascades.data(), static_cast<std::size_t>(settings.cascadeCount)};
+  }
+
+  std::uint32_t getResolution() const { return resolution; }
+
+  Settings settings;
+
+private:
+  glm::mat4x4 fitCascade(glm::vec3 center, float radius, const Camera& light_cam) const;
+  void cullCasters(SceneManager& scene);
+
+private:
+  std::uint32_t resolution;
+  std::array<Cascade, MAX_SHADOW_CASCADES> cascades;
+
+  std::uint64_t frameIndex = 0;
+  bool forceUpdate = true;
+  Settings lastSettings;
+  glm::vec3 lastLightDir{0};
+  glm::vec3 lastLightUp{0};
+  std::uint64_t lastStaticGeometryVersion = 0;
+  int updatedLastFrame = 0;
+};
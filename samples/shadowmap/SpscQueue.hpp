@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+
+/**
+ * Bounded lock-free queue for exactly one producer and one consumer thread.
+ * Pushing into a full queue and popping from an empty one block, so the
+ * capacity limits how far the producer can run ahead of the consumer.
+ */
+template <class T>
+class SpscQueue
+{
+public:
+  explicit SpscQueue(std::size_t capacity)
+    : slots(capacity)
+  {
+  }
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  // Returns false if the queue was closed
+  bool push(T value)
+  {
+    while (true)
+    {
+      const std::uint32_t seen = version.load(std::memory_order_acquire);
+      if (closed.load(std::memory_order_acquire))
+        return false;
+      if (tryPush(value))
+        return true;
+      version.wait(seen, std::memory_order_acquire);
+    }
+  }
+
+  // Never blocks, returns false if the queue is full or closed
+  bool tryPush(T& value)
+  {
+    const std::size_t currentTail = tail.load(std::memory_order_relaxed);
+    if (closed.load(std::memory_order_acquire) ||
+        currentTail - head.load(std::memory_order_acquire) == slots.size())
+      return false;
+
+    slots[currentTail % slots.size()] = std::move(value);
+    tail.store(currentTail + 1, std::memory_order_release);
+    notify();
+    return true;
+  }
+
+  // Returns nullopt once the queue is closed and everything in it was popped
+  std::optional<T> pop()
+  {
+    while (true)
+    {
+      const std::uint32_t seen = version.load(std::memory_order_acquire);
+
+      const std::size_t currentHead = head.load(std::memory_order_relaxed);
+      if (currentHead != tail.load(std::memory_order_acquire))
+      {
+        std::optional<T> result = std::move(slots[currentHead % slots.size()]);
+        head.store(currentHead + 1, std::memory_order_release);
+        notify();
+        return result;
+      }
+
+      if (closed.load(std::memory_order_acquire))
+        return std::nullopt;
+      version.wait(seen, std::memory_order_acquire);
+    }
+  }
+
+  // Wakes up both sides, pushes fail from now on, pops drain the rest
+  void close()
+  {
+    closed.store(true, std::memory_order_release);
+    notify();
+  }
+
+private:
+  // Every change bumps the version, so that a side waiting upon it
+  // can't miss a change that happened right before it went to sleep
+  void notify()
+  {
+    version.fetch_add(1, std::memory_order_release);
+    version.notify_all();
+  }
+
+private:
+  std::vector<T> slots;
+  std::atomic<std::size_t> head{0};
+  std::atomic<std::size_t> tail{0};
+  std::atomic<std::uint32_t> version{0};
+  std::atomic<bool> closed{false};
+};
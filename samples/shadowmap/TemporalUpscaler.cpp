@@ -0,0 +1,254 @@
+#include "TemporalUpscaler.hpp"
+
+#include <algorithm>
+#include <string>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/RenderTargetStates.hpp>
+#include <etna/DescriptorSet.hpp>
+#include <etna/Profiling.hpp>
+#include <imgui.h>
+
+
+// Halton(2, 3) covers a pixel evenly, any number of consecutive frames is well spread
+static constexpr std::uint32_t JITTER_PHASE_COUNT = 8;
+
+static float halton(std::uint32_t index, std::uint32_t base)
+{
+  float fraction = 1.0f;
+  float result = 0.0f;
+  while (index > 0)
+  {
+    fraction /= static_cast<float>(base);
+    result += fraction * static_cast<float>(index % base);
+    index /= base;
+  }
+  return result;
+}
+
+TemporalUpscaler::TemporalUpscaler(ShaderPermutations& shader_permutations)
+  : permutations{shader_permutations}
+{
+}
+
+void TemporalUpscaler::loadShaders()
+{
+  permutations.addProgram(
+    "velocity",
+    {SHADOWMAP_SHADERS_ROOT "velocity.vert.spv", SHADOWMAP_SHADERS_ROOT "velocity.frag.spv"});
+  permutations.addProgram("taa_resolve", {SHADOWMAP_SHADERS_ROOT "taa_resolve.comp.spv"});
+}
+
+void TemporalUpscaler::allocateResources(glm::uvec2 output_resolution)
+{
+  outputResolution = output_resolution;
+  historyValid = false;
+
+  for (std::size_t i = 0; i < history.size(); ++i)
+    history[i] = etna::get_context().createImage(etna::Image::CreateInfo{
+      .extent = vk::Extent3D{outputResolution.x, outputResolution.y, 1},
+      .name = "taa_history_" + std::to_string(i),
+      .format = HISTORY_FORMAT,
+      .imageUsage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+    });
+}
+
+void TemporalUpscaler::setupPipelines(
+  const etna::VertexShaderInputDescription& position_input, DeferredDeletionQueue& retired)
+{
+  auto& pipelineManager = etna::get_context().getPipelineManager();
+
+  retired.retire(std::move(velocityPipeline));
+  velocityPipeline = pipelineManager.createGraphicsPipeline(
+    permutations.getProgram("velocity").c_str(),
+    etna::GraphicsPipeline::CreateInfo{
+      .vertexShaderInput = position_input,
+      .rasterizationConfig =
+        vk::PipelineRasterizationStateCreateInfo{
+          .polygonMode = vk::PolygonMode::eFill,
+          .cullMode = vk::CullModeFlagBits::eBack,
+          .frontFace = vk::FrontFace::eCounterClockwise,
+          .lineWidth = 1.f,
+        },
+      // Only the visible surface of every pixel gets through
+      .depthConfig =
+        vk::PipelineDepthStencilStateCreateInfo{
+          .depthTestEnable = VK_TRUE,
+          .depthWriteEnable = VK_FALSE,
+          .depthCompareOp = vk::CompareOp::eEqual,
+          .maxDepthBounds = 1.f,
+        },
+      .fragmentShaderOutput =
+        {
+          .colorAttachmentFormats = {VELOCITY_FORMAT},
+          .depthAttachmentFormat = vk::Format::eD32Sfloat,
+        },
+    });
+
+  retired.retire(std::move(resolvePipeline));
+  resolvePipeline =
+    pipelineManager.createComputePipeline(permutations.getProgram("taa_resolve").c_str(), {});
+}
+
+glm::uvec2 TemporalUpscaler::getRenderResolution(glm::uvec2 output_resolution) const
+{
+  if (!settings.enabled)
+    return output_resolution;
+
+  const glm::vec2 scaled = glm::round(glm::vec2(output_resolution) * settings.renderScale);
+  return glm::clamp(glm::uvec2(scaled), glm::uvec2(1), output_resolution);
+}
+
+void TemporalUpscaler::beginFrame(const glm::mat4x4& proj_view, glm::uvec2 render_resolution)
+{
+  prevProjView = currProjView;
+  currProjView = proj_view;
+  renderResolution = render_resolution;
+  currentHistory = 1 - currentHistory;
+
+  // Halton starts at 1, as 0 would be the corner of the pixel every time
+  const std::uint32_t phase = frameIndex++ % JITTER_PHASE_COUNT + 1;
+  const glm::vec2 pixelOffset{halton(phase, 2) - 0.5f, halton(phase, 3) - 0.5f};
+  jitter = 2.0f * pixelOffset / glm::vec2(renderResolution);
+}
+
+void TemporalUpscaler::renderVelocity(
+  vk::CommandBuffer cmd_buf,
+  SceneManager& scene,
+  std::span<const std::uint32_t> instances,
+  const glm::mat4x4& proj_view,
+  const etna::Image& depth_image,
+  const etna::Image& velocity,
+  TransientAllocator& transient_memory)
+{
+  ETNA_PROFILE_GPU(cmd_buf, renderVelocity);
+
+  // Pixels without geometry don't move
+  etna::RenderTargetState renderTargets(
+    cmd_buf,
+    {{0, 0}, {renderResolution.x, renderResolution.y}},
+    {{.image = velocity.get(), .view = velocity.getView({})}},
+    {.image = depth_image.get(),
+     .view = depth_image.getView({}),
+     .loadOp = vk::AttachmentLoadOp::eLoad});
+
+  if (!scene.getVertexBuffer())
+    return;
+
+  auto instanceMeshes = scene.getInstanceMeshes();
+  auto instanceMatrices = scene.getInstanceMatrices();
+  auto meshes = scene.getMeshes();
+  auto relems = scene.getRenderElements();
+
+  // Nothing to compare against, so nothing has moved
+  if (!historyValid || prevInstanceMatrices.size() != instanceMatrices.size())
+    prevInstanceMatrices.assign(instanceMatrices.begin(), instanceMatrices.end());
+
+  // Laid out as the Velocity buffer of velocity.vert
+  auto params = transient_memory.allocate(
+    (2 + prevInstanceMatrices.size()) * sizeof(glm::mat4x4), alignof(glm::mat4x4));
+  auto* matrices = reinterpret_cast<glm::mat4x4*>(params.data);
+  matrices[0] = currProjView;
+  matrices[1] = prevProjView;
+  std::copy(prevInstanceMatrices.begin(), prevInstanceMatrices.end(), matrices + 2);
+
+  auto programInfo = etna::get_shader_program(permutations.getProgram("velocity").c_str());
+  auto set = etna::create_descriptor_set(
+    programInfo.getDescriptorLayoutId(0), cmd_buf, {etna::Binding{0, params.genBinding()}});
+
+  const auto layout = velocityPipeline.getVkPipelineLayout();
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, velocityPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, {set.getVkSet()}, {});
+
+  cmd_buf.bindVertexBuffers(0, {scene.getPositionBuffer()}, {0});
+  cmd_buf.bindIndexBuffer(scene.getIndexBuffer(), 0, vk::IndexType::eUint32);
+
+  struct PushConstants
+  {
+    glm::mat4x4 projView;
+    glm::mat4x4 model;
+  } pushConst{proj_view, {}};
+
+  for (const auto instIdx : instances)
+  {
+    pushConst.model = instanceMatrices[instIdx];
+    cmd_buf.pushConstants<PushConstants>(
+      layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst});
+
+    // The instance index reaches the shader as gl_InstanceIndex
+    const auto& mesh = meshes[instanceMeshes[instIdx]];
+    for (std::size_t j = 0; j < mesh.relemCount; ++j)
+    {
+      const auto& relem = relems[mesh.firstRelem + j];
+      cmd_buf.drawIndexed(relem.indexCount, 1, relem.indexOffset, relem.vertexOffset, instIdx);
+    }
+  }
+
+  prevInstanceMatrices.assign(instanceMatrices.begin(), instanceMatrices.end());
+}
+
+void TemporalUpscaler::resolve(
+  vk::CommandBuffer cmd_buf,
+  const etna::Image& shaded_color,
+  const etna::Image& depth,
+  const etna::Image& velocity,
+  vk::Extent2D render_extent,
+  const etna::Sampler& sampler)
+{
+  ETNA_PROFILE_GPU(cmd_buf, resolveTemporalUpscaling);
+
+  const auto sampled = [&sampler](const etna::Image& image) {
+    return image.genBinding(sampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal);
+  };
+
+  auto programInfo = etna::get_shader_program(permutations.getProgram("taa_resolve").c_str());
+  auto set = etna::create_descriptor_set(
+    programInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {
+      etna::Binding{0, sampled(shaded_color)},
+      etna::Binding{1, sampled(depth)},
+      etna::Binding{2, sampled(velocity)},
+      etna::Binding{3, sampled(getPreviousHistory())},
+      etna::Binding{4, getHistory().genBinding({}, vk::ImageLayout::eGeneral)},
+    });
+
+  const glm::vec2 renderSize(glm::uvec2{render_extent.width, render_extent.height});
+
+  struct PushConstants
+  {
+    glm::vec2 renderSize;
+    glm::vec2 outputSize;
+    glm::vec2 jitter;
+    float feedback;
+    std::uint32_t historyValid;
+  } pushConst{
+    .renderSize = renderSize,
+    .outputSize = glm::vec2(outputResolution),
+    // NDC and pixel coordinates both grow to the right and down
+    .jitter = 0.5f * jitter * renderSize,
+    .feedback = settings.feedback,
+    .historyValid = historyValid ? 1u : 0u,
+  };
+
+  const auto layout = resolvePipeline.getVkPipelineLayout();
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, resolvePipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, layout, 0, {set.getVkSet()}, {});
+  cmd_buf.pushConstants<PushConstants>(
+    layout, vk::ShaderStageFlagBits::eCompute, 0, {pushConst});
+
+  etna::flush_barriers(cmd_buf);
+
+  cmd_buf.dispatch((outputResolution.x + 7) / 8, (outputResolution.y + 7) / 8, 1);
+
+  historyValid = true;
+}
+
+void TemporalUpscaler::drawGui(Settings& settings)
+{
+  ImGui::Checkbox("Enabled", &settings.enabled);
+  ImGui::SliderFloat("Render scale", &settings.renderScale, 0.5f, 1.0f);
+  ImGui::SliderFloat("History feedback", &settings.feedback, 0.5f, 0.98f);
+  ImGui::Text("Shaded pixels: %.0f%%", 100.0f * settings.renderScale * settings.renderScale);
+}
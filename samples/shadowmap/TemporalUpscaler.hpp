@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <etna/Image.hpp>
+#include <etna/Sampler.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/GraphicsPipeline.hpp>
+#include <glm/glm.hpp>
+
+#include "scene/SceneManager.hpp"
+#include "render_utils/TransientAllocator.hpp"
+#include "render_utils/DeferredDeletionQueue.hpp"
+#include "render_utils/ShaderPermutations.hpp"
+
+
+/**
+ * Temporal upscaling: the main view is rendered at a lower resolution with a different
+ * sub-pixel jitter every frame, and the frames are accumulated into a history at the output
+ * resolution. Motion vectors come from the current and previous transforms of the camera and
+ * of every instance, so the history follows moving geometry.
+ */
+class TemporalUpscaler
+{
+public:
+  static constexpr vk::Format VELOCITY_FORMAT = vk::Format::eR16G16Sfloat;
+  static constexpr vk::Format HISTORY_FORMAT = vk::Format::eR16G16B16A16Sfloat;
+
+  struct Settings
+  {
+    bool enabled = false;
+    // Of the output resolution along each axis, 0.71 shades half of the pixels
+    float renderScale = 0.71f;
+    float feedback = 0.9f;
+  };
+
+  explicit TemporalUpscaler(ShaderPermutations& permutations);
+
+  void loadShaders();
+  void allocateResources(glm::uvec2 output_resolution);
+  void setupPipelines(
+    const etna::VertexShaderInputDescription& position_input, DeferredDeletionQueue& retired);
+
+  bool isEnabled() const { return settings.enabled; }
+  // Must be called whenever the history stops matching the frames, e.g. after re-enabling
+  void invalidateHistory() { historyValid = false; }
+  // Before any dynamic resolution scaling
+  glm::uvec2 getRenderResolution(glm::uvec2 output_resolution) const;
+
+  // Picks the jitter of the new frame, must be called once per frame with the unjittered matrix
+  void beginFrame(const glm::mat4x4& proj_view, glm::uvec2 render_resolution);
+  // Offset of the projection in NDC, zero when disabled
+  glm::vec2 getJitter() const { return settings.enabled ? jitter : glm::vec2(0.0f); }
+
+  // Only writes pixels whose depth matches depth_image exactly, so proj_view must be the one
+  // the main view was rendered with. Previous transforms are allocated from transient_memory.
+  void renderVelocity(
+    vk::CommandBuffer cmd_buf,
+    SceneManager& scene,
+    std::span<const std::uint32_t> instances,
+    const glm::mat4x4& proj_view,
+    const etna::Image& depth_image,
+    const etna::Image& velocity,
+    TransientAllocator& transient_memory);
+
+  // Inputs are only read in their top left render_extent part, the result goes into the history
+  void resolve(
+    vk::CommandBuffer cmd_buf,
+    const etna::Image& shaded_color,
+    const etna::Image& depth,
+    const etna::Image& velocity,
+    vk::Extent2D render_extent,
+    const etna::Sampler& sampler);
+
+  // Written by this frame's resolve
+  const etna::Image& getHistory() const { return history[currentHistory]; }
+  // Read by this frame's resolve
+  const etna::Image& getPreviousHistory() const { return history[1 - currentHistory]; }
+
+  static void drawGui(Settings& settings);
+
+  Settings settings;
+
+private:
+  ShaderPermutations& permutations;
+
+  glm::uvec2 outputResolution{};
+  std::array<etna::Image, 2> history;
+  std::uint32_t currentHistory = 0;
+  // Cleared whenever the previous history doesn't match the current frame at all
+  bool historyValid = false;
+
+  std::uint32_t frameIndex = 0;
+  glm::vec2 jitter{};
+  glm::uvec2 renderResolution{};
+  glm::mat4x4 currProjView{1.0f};
+  glm::mat4x4 prevProjView{1.0f};
+  std::vector<glm::mat4x4> prevInstanceMatrices;
+
+  etna::GraphicsPipeline velocityPipeline;
+  etna::ComputePipeline resolvePipeline;
+};
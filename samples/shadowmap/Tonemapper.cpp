@@ -0,0 +1,93 @@
+#include "Tonemapper.hpp"
+
+#include <cmath>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/RenderTargetStates.hpp>
+#include <etna/DescriptorSet.hpp>
+#include <glm/glm.hpp>
+#include <imgui.h>
+
+
+Tonemapper::Tonemapper(ShaderPermutations& shader_permutations)
+  : permutations{shader_permutations}
+{
+}
+
+void Tonemapper::loadShaders()
+{
+  permutations.addProgram(
+    "tonemap",
+    {SHADOWMAP_SHADERS_ROOT "fullscreen.vert.spv", SHADOWMAP_SHADERS_ROOT "tonemap.frag.spv"});
+}
+
+void Tonemapper::setupPipelines(vk::Format target_format, DeferredDeletionQueue& retired)
+{
+  retired.retire(std::move(pipeline));
+  pipeline = etna::get_context().getPipelineManager().createGraphicsPipeline(
+    permutations.getProgram("tonemap").c_str(),
+    etna::GraphicsPipeline::CreateInfo{
+      .fragmentShaderOutput =
+        {
+          .colorAttachmentFormats = {target_format},
+        },
+    });
+}
+
+void Tonemapper::render(
+  vk::CommandBuffer cmd_buf,
+  vk::Image target_image,
+  vk::ImageView target_image_view,
+  vk::Extent2D target_extent,
+  const etna::Image& source,
+  vk::Extent2D source_size,
+  vk::Extent2D rendered_extent,
+  const etna::Sampler& sampler,
+  const etna::Buffer& exposure,
+  bool auto_exposure)
+{
+  auto programInfo = etna::get_shader_program(permutations.getProgram("tonemap").c_str());
+  auto set = etna::create_descriptor_set(
+    programInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {etna::Binding{0, source.genBinding(sampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+     etna::Binding{1, exposure.genBinding()}});
+
+  etna::RenderTargetState renderTargets(
+    cmd_buf,
+    {{0, 0}, target_extent},
+    {{.image = target_image, .view = target_image_view, .loadOp = vk::AttachmentLoadOp::eDontCare}},
+    {});
+
+  struct PushConstants
+  {
+    glm::vec2 sourceExtent;
+    glm::vec2 sourceSize;
+    float exposureScale;
+    std::uint32_t autoExposure;
+    std::uint32_t tonemapOperator;
+  } pushConst{
+    glm::vec2(glm::uvec2{rendered_extent.width, rendered_extent.height}),
+    glm::vec2(glm::uvec2{source_size.width, source_size.height}),
+    std::exp2(settings.exposureCompensation),
+    auto_exposure ? 1u : 0u,
+    static_cast<std::uint32_t>(settings.tonemapOperator),
+  };
+
+  const auto layout = pipeline.getVkPipelineLayout();
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, {set.getVkSet()}, {});
+  cmd_buf.pushConstants<PushConstants>(
+    layout, vk::ShaderStageFlagBits::eFragment, 0, {pushConst});
+
+  cmd_buf.draw(3, 1, 0, 0);
+}
+
+void Tonemapper::drawGui(Settings& settings)
+{
+  int currentOperator = static_cast<int>(settings.tonemapOperator);
+  if (ImGui::Combo("Operator", &currentOperator, "Clamp\0Reinhard\0ACES\0"))
+    settings.tonemapOperator = static_cast<Operator>(currentOperator);
+  ImGui::SliderFloat("Exposure compensation, EV", &settings.exposureCompensation, -5.0f, 5.0f);
+}
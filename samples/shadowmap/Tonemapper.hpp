@@ -0,0 +1,62 @@
+#pragma once
+
+#include <etna/Buffer.hpp>
+#include <etna/GraphicsPipeline.hpp>
+#include <etna/Image.hpp>
+#include <etna/Sampler.hpp>
+
+#include "shaders/AutoExposure.h"
+#include "render_utils/DeferredDeletionQueue.hpp"
+#include "render_utils/ShaderPermutations.hpp"
+
+
+/**
+ * Brings the HDR main view to the swapchain in a single pass: stretches the part of the image
+ * the main view was rendered into over the whole target with a bicubic filter, applies the
+ * exposure and maps the result into the displayable range.
+ */
+class Tonemapper
+{
+public:
+  enum class Operator
+  {
+    Clamp = TONEMAP_OPERATOR_CLAMP,
+    Reinhard = TONEMAP_OPERATOR_REINHARD,
+    Aces = TONEMAP_OPERATOR_ACES,
+  };
+
+  struct Settings
+  {
+    Operator tonemapOperator = Operator::Aces;
+    // In stops, on top of the automatic exposure
+    float exposureCompensation = 0.0f;
+  };
+
+  explicit Tonemapper(ShaderPermutations& permutations);
+
+  void loadShaders();
+  void setupPipelines(vk::Format target_format, DeferredDeletionQueue& retired);
+
+  // Only the top left rendered_extent part of the source_size sized source is read.
+  // The exposure buffer is only read when auto_exposure is set.
+  void render(
+    vk::CommandBuffer cmd_buf,
+    vk::Image target_image,
+    vk::ImageView target_image_view,
+    vk::Extent2D target_extent,
+    const etna::Image& source,
+    vk::Extent2D source_size,
+    vk::Extent2D rendered_extent,
+    const etna::Sampler& sampler,
+    const etna::Buffer& exposure,
+    bool auto_exposure);
+
+  static void drawGui(Settings& settings);
+
+  Settings settings;
+
+private:
+  ShaderPermutations& permutations;
+
+  etna::GraphicsPipeline pipeline;
+};
@@ -0,0 +1,364 @@
+#include "VirtualShadowMap.hpp"
+
+#include <algorithm>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/Profiling.hpp>
+#include <imgui.h>
+
+#include "profiling/TraceRecorder.hpp"
+
+
+VirtualShadowMap::VirtualShadowMap(ShaderPermutations& shader_permutations)
+  : permutations{shader_permutations}
+  , pageTable(VSM_PAGE_COUNT, NO_PAGE)
+  , pageResident(VSM_PAGE_COUNT, false)
+  , physicalPages(VSM_PHYSICAL_PAGE_COUNT)
+  , pageDirty(VSM_PAGE_COUNT, false)
+{
+  auto& ctx = etna::get_context();
+
+  atlas = ctx.createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{VSM_PHYSICAL_RESOLUTION, VSM_PHYSICAL_RESOLUTION, 1},
+    .name = "vsm_physical_atlas",
+    .format = vk::Format::eD16Unorm,
+    .imageUsage =
+      vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
+  });
+
+  const auto framesInFlight = ctx.getMainWorkCount().multiBufferingCount();
+  for (std::size_t i = 0; i < framesInFlight; ++i)
+  {
+    auto& pageTableBuffer = pageTableBuffers.emplace_back(ctx.createBuffer(etna::Buffer::CreateInfo{
+      .size = VSM_PAGE_COUNT * sizeof(std::uint32_t),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+      .name = "vsm_page_table",
+    }));
+    pageTableBuffer.map();
+    std::fill_n(reinterpret_cast<std::uint32_t*>(pageTableBuffer.data()), VSM_PAGE_COUNT, 0u);
+
+    auto& requestBuffer = pageRequestBuffers.emplace_back(ctx.createBuffer(etna::Buffer::CreateInfo{
+      .size = VSM_PAGE_COUNT * sizeof(std::uint32_t),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_TO_CPU,
+      .name = "vsm_page_requests",
+    }));
+    requestBuffer.map();
+    std::fill_n(reinterpret_cast<std::uint32_t*>(requestBuffer.data()), VSM_PAGE_COUNT, 0u);
+  }
+}
+
+void VirtualShadowMap::loadShaders()
+{
+  permutations.addProgram("vsm_mark_pages", {SHADOWMAP_SHADERS_ROOT "vsm_mark_pages.comp.spv"});
+}
+
+void VirtualShadowMap::setupPipelines(DeferredDeletionQueue& retired)
+{
+  auto& pipelineManager = etna::get_context().getPipelineManager();
+  retired.retire(std::move(markPagesPipeline));
+  markPagesPipeline = pipelineManager.createComputePipeline(
+    permutations.getProgram("vsm_mark_pages").c_str(), {});
+}
+
+const etna::Buffer& VirtualShadowMap::getPageTable() const
+{
+  return pageTableBuffers[etna::get_context().getMainWorkCount().currentResource()];
+}
+
+void VirtualShadowMap::update(
+  const glm::mat4x4& light_matrix,
+  SceneManager& scene,
+  std::span<const std::uint32_t> dynamic_instances)
+{
+  TRACE_ZONE;
+
+  ++frameIndex;
+  pagesToRender.clear();
+
+  if (
+    invalidated || light_matrix != lastLightMatrix ||
+    scene.getStaticGeometryVersion() != lastStaticGeometryVersion)
+  {
+    // Contents of every page are stale, start from scratch
+    invalidated = false;
+    lastLightMatrix = light_matrix;
+    lastStaticGeometryVersion = scene.getStaticGeometryVersion();
+
+    std::fill(pageTable.begin(), pageTable.end(), NO_PAGE);
+    std::fill(pageResident.begin(), pageResident.end(), false);
+    std::fill(pageDirty.begin(), pageDirty.end(), false);
+    dirtyPages.clear();
+    dynamicCasterRects.clear();
+
+    freePhysicalPages.clear();
+    for (std::uint32_t i = VSM_PHYSICAL_PAGE_COUNT; i-- > 0;)
+    {
+      physicalPages[i] = {};
+      freePhysicalPages.push_back(i);
+    }
+  }
+
+  // Requests were produced by a previous usage of this frame slot, which is complete by now
+  const auto slot = etna::get_context().getMainWorkCount().currentResource();
+  auto* requests = reinterpret_cast<std::uint32_t*>(pageRequestBuffers[slot].data());
+
+  std::vector<std::uint32_t> unmappedRequests;
+  requestedLastFrame = 0;
+  for (std::uint32_t page = 0; page < VSM_PAGE_COUNT; ++page)
+  {
+    if (requests[page] == 0)
+      continue;
+    requests[page] = 0;
+    ++requestedLastFrame;
+
+    if (pageTable[page] == NO_PAGE)
+      unmappedRequests.push_back(page);
+    else
+      physicalPages[pageTable[page]].lastRequestedFrame = frameIndex;
+  }
+
+  // Don't allocate more than can be rendered soon, otherwise pages would be evicted for nothing
+  auto allocationBudget = static_cast<std::size_t>(settings.pageBudget);
+  allocationBudget -= std::min(allocationBudget, dirtyPages.size());
+  for (const auto page : unmappedRequests)
+  {
+    if (allocationBudget == 0)
+      break;
+
+    const auto physicalPage = allocatePhysicalPage();
+    if (physicalPage == NO_PAGE)
+      break;
+    --allocationBudget;
+
+    pageTable[page] = physicalPage;
+    physicalPages[physicalPage] = {.virtualPage = page, .lastRequestedFrame = frameIndex};
+    addDirtyPage(page);
+  }
+
+  // Moving casters invalidate both the pages they left and the pages they entered
+  for (const auto& rect : dynamicCasterRects)
+    markDirty(rect);
+  dynamicCasterRects.clear();
+  for (const auto instIdx : dynamic_instances)
+    if (auto rect = findPageRect(scene.getInstanceBounds(instIdx)))
+    {
+      markDirty(*rect);
+      dynamicCasterRects.push_back(*rect);
+    }
+
+  std::vector<std::uint32_t> postponedPages;
+  for (const auto page : dirtyPages)
+  {
+    // Evicted pages and duplicates have their flag reset already
+    if (!pageDirty[page])
+      continue;
+
+    if (pagesToRender.size() >= static_cast<std::size_t>(settings.pageBudget))
+    {
+      postponedPages.push_back(page);
+      continue;
+    }
+
+    pageDirty[page] = false;
+    pageResident[page] = true;
+    pagesToRender.push_back(preparePage(page, scene));
+  }
+  dirtyPages = std::move(postponedPages);
+
+  auto* gpuPageTable = reinterpret_cast<std::uint32_t*>(pageTableBuffers[slot].data());
+  for (std::uint32_t page = 0; page < VSM_PAGE_COUNT; ++page)
+    gpuPageTable[page] = pageResident[page] ? pageTable[page] | VSM_PAGE_RESIDENT_BIT : 0;
+}
+
+std::uint32_t VirtualShadowMap::allocatePhysicalPage()
+{
+  if (!freePhysicalPages.empty())
+  {
+    const auto result = freePhysicalPages.back();
+    freePhysicalPages.pop_back();
+    return result;
+  }
+
+  // Evict the least recently requested page, but never one needed this frame
+  std::uint32_t victim = NO_PAGE;
+  std::uint64_t oldestFrame = frameIndex;
+  for (std::uint32_t i = 0; i < VSM_PHYSICAL_PAGE_COUNT; ++i)
+    if (physicalPages[i].lastRequestedFrame < oldestFrame)
+    {
+      oldestFrame = physicalPages[i].lastRequestedFrame;
+      victim = i;
+    }
+
+  if (victim == NO_PAGE)
+    return NO_PAGE;
+
+  const auto evictedPage = physicalPages[victim].virtualPage;
+  pageTable[evictedPage] = NO_PAGE;
+  pageResident[evictedPage] = false;
+  pageDirty[evictedPage] = false;
+  physicalPages[victim] = {};
+
+  return victim;
+}
+
+void VirtualShadowMap::addDirtyPage(std::uint32_t page)
+{
+  if (pageDirty[page])
+    return;
+
+  pageDirty[page] = true;
+  dirtyPages.push_back(page);
+}
+
+void VirtualShadowMap::markDirty(const PageRect& rect)
+{
+  for (std::uint32_t y = rect.min.y; y <= rect.max.y; ++y)
+    for (std::uint32_t x = rect.min.x; x <= rect.max.x; ++x)
+    {
+      const std::uint32_t page = y * VSM_PAGES_PER_SIDE + x;
+      if (pageTable[page] != NO_PAGE)
+        addDirtyPage(page);
+    }
+}
+
+std::optional<VirtualShadowMap::PageRect> VirtualShadowMap::findPageRect(
+  const BoundingBox& bounds) const
+{
+  // NOTE: only correct for orthographic light projections, which are used by default
+  const BoundingBox clipBounds = bounds.transformed(lastLightMatrix);
+  if (
+    clipBounds.max.x < -1.0f || clipBounds.min.x > 1.0f || clipBounds.max.y < -1.0f ||
+    clipBounds.min.y > 1.0f)
+    return std::nullopt;
+
+  const auto toPage = [](float ndc) {
+    const float pages = static_cast<float>(VSM_PAGES_PER_SIDE);
+    const float page = std::clamp((ndc * 0.5f + 0.5f) * pages, 0.0f, pages - 1.0f);
+    return static_cast<std::uint32_t>(page);
+  };
+
+  return PageRect{
+    .min = {toPage(clipBounds.min.x), toPage(clipBounds.min.y)},
+    .max = {toPage(clipBounds.max.x), toPage(clipBounds.max.y)},
+  };
+}
+
+VirtualShadowMap::PageToRender VirtualShadowMap::preparePage(
+  std::uint32_t page, SceneManager& scene) const
+{
+  const float pages = static_cast<float>(VSM_PAGES_PER_SIDE);
+  const glm::vec2 pageCoords(page % VSM_PAGES_PER_SIDE, page / VSM_PAGES_PER_SIDE);
+  const glm::vec2 ndcMin = pageCoords / pages * 2.0f - 1.0f;
+
+  // Stretches the page over the whole clip space
+  glm::mat4x4 crop{1.0f};
+  crop[0][0] = pages;
+  crop[1][1] = pages;
+  crop[3][0] = -pages * ndcMin.x - 1.0f;
+  crop[3][1] = -pages * ndcMin.y - 1.0f;
+
+  const auto physicalPage = pageTable[page];
+  PageToRender result{
+    .matrix = crop * lastLightMatrix,
+    .rect =
+      vk::Rect2D{
+        .offset =
+          {static_cast<std::int32_t>(physicalPage % VSM_PHYSICAL_PAGES_PER_SIDE * VSM_PAGE_SIZE),
+           static_cast<std::int32_t>(physicalPage / VSM_PHYSICAL_PAGES_PER_SIDE * VSM_PAGE_SIZE)},
+        .extent = {VSM_PAGE_SIZE, VSM_PAGE_SIZE},
+      },
+    .casters = {},
+  };
+
+  const auto instanceCount = static_cast<std::uint32_t>(scene.getInstanceMatrices().size());
+  for (std::uint32_t instIdx = 0; instIdx < instanceCount; ++instIdx)
+  {
+    const BoundingBox clipBounds = scene.getInstanceBounds(instIdx).transformed(result.matrix);
+    const bool outside = clipBounds.max.x < -1.0f || clipBounds.min.x > 1.0f ||
+      clipBounds.max.y < -1.0f || clipBounds.min.y > 1.0f || clipBounds.max.z < 0.0f ||
+      clipBounds.min.z > 1.0f;
+
+    if (!outside)
+      result.casters.push_back(instIdx);
+  }
+
+  return result;
+}
+
+void VirtualShadowMap::markPages(
+  vk::CommandBuffer cmd_buf,
+  const etna::Image& depth,
+  const etna::Sampler& sampler,
+  const glm::mat4x4& ndc_to_light_clip,
+  glm::uvec2 resolution)
+{
+  ETNA_PROFILE_GPU(cmd_buf, markVirtualShadowMapPages);
+
+  auto& requestBuffer =
+    pageRequestBuffers[etna::get_context().getMainWorkCount().currentResource()];
+
+  auto programInfo = etna::get_shader_program(permutations.getProgram("vsm_mark_pages").c_str());
+  auto set = etna::create_descriptor_set(
+    programInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {etna::Binding{0, depth.genBinding(sampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+     etna::Binding{1, requestBuffer.genBinding()}});
+
+  struct PushConstants
+  {
+    glm::mat4x4 ndcToLightClip;
+    glm::uvec2 resolution;
+  } pushConst{ndc_to_light_clip, resolution};
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, markPagesPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute,
+    markPagesPipeline.getVkPipelineLayout(),
+    0,
+    {set.getVkSet()},
+    {});
+  cmd_buf.pushConstants<PushConstants>(
+    markPagesPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, {pushConst});
+
+  etna::flush_barriers(cmd_buf);
+
+  cmd_buf.dispatch((resolution.x + 15) / 16, (resolution.y + 15) / 16, 1);
+
+  const vk::MemoryBarrier2 toHost{
+    .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+    .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &toHost,
+  });
+}
+
+VirtualShadowMap::Stats VirtualShadowMap::getStats() const
+{
+  return Stats{
+    .requestedPages = requestedLastFrame,
+    .mappedPages = VSM_PHYSICAL_PAGE_COUNT - freePhysicalPages.size(),
+    .renderedPages = pagesToRender.size(),
+    .postponedPages = dirtyPages.size(),
+  };
+}
+
+void VirtualShadowMap::drawGui(Settings& settings, const Stats& stats)
+{
+  ImGui::SliderInt("Page render budget", &settings.pageBudget, 1, 256);
+  ImGui::Text(
+    "Pages requested: %u, mapped: %zu / %u",
+    stats.requestedPages,
+    stats.mappedPages,
+    VSM_PHYSICAL_PAGE_COUNT);
+  ImGui::Text(
+    "Pages rendered last frame: %zu, postponed: %zu",
+    stats.renderedPages,
+    stats.postponedPages);
+}
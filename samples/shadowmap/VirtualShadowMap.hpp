@@ -0,0 +1,134 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <etna/Buffer.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/Image.hpp>
+#include <etna/Sampler.hpp>
+#include <glm/glm.hpp>
+
+#include "scene/SceneManager.hpp"
+#include "shaders/VirtualShadowMap.h"
+#include "render_utils/DeferredDeletionQueue.hpp"
+#include "render_utils/ShaderPermutations.hpp"
+
+
+/**
+ * Software paged shadow map with a huge virtual resolution. Only pages that are
+ * needed by visible pixels get a physical page in the atlas, and they are only
+ * re-rendered when something inside of them changes. Page requests are
+ * produced on the GPU and read back without stalling, so newly visible
+ * pages appear with a delay of a few frames.
+ */
+class VirtualShadowMap
+{
+public:
+  struct PageToRender
+  {
+    // Light view-projection cropped to the page
+    glm::mat4x4 matrix;
+    // Where the page lives in the physical atlas
+    vk::Rect2D rect;
+    std::vector<std::uint32_t> casters;
+  };
+
+  struct Settings
+  {
+    // How many pages may be rendered per frame, pages over the budget wait for later frames
+    int pageBudget = 64;
+  };
+
+  struct Stats
+  {
+    std::uint32_t requestedPages = 0;
+    std::size_t mappedPages = 0;
+    std::size_t renderedPages = 0;
+    std::size_t postponedPages = 0;
+  };
+
+  explicit VirtualShadowMap(ShaderPermutations& permutations);
+
+  void loadShaders();
+  void setupPipelines(DeferredDeletionQueue& retired);
+
+  // Must be called after the fence of the current frame slot was waited upon.
+  // Reads back page requests, updates page residency and selects pages to render.
+  void update(
+    const glm::mat4x4& light_matrix,
+    SceneManager& scene,
+    std::span<const std::uint32_t> dynamic_instances);
+
+  // Requests the pages needed by the main view for future frames
+  void markPages(
+    vk::CommandBuffer cmd_buf,
+    const etna::Image& depth,
+    const etna::Sampler& sampler,
+    const glm::mat4x4& ndc_to_light_clip,
+    glm::uvec2 resolution);
+
+  void invalidate() { invalidated = true; }
+
+  Stats getStats() const;
+
+  static void drawGui(Settings& settings, const Stats& stats);
+
+  std::span<const PageToRender> getPagesToRender() const { return pagesToRender; }
+  const etna::Image& getAtlas() const { return atlas; }
+  // Page table to be used by the current frame
+  const etna::Buffer& getPageTable() const;
+
+  Settings settings;
+
+private:
+  static constexpr std::uint32_t NO_PAGE = ~0u;
+
+  struct PhysicalPage
+  {
+    std::uint32_t virtualPage = NO_PAGE;
+    std::uint64_t lastRequestedFrame = 0;
+  };
+
+  struct PageRect
+  {
+    glm::uvec2 min;
+    glm::uvec2 max;
+  };
+
+  std::uint32_t allocatePhysicalPage();
+  void addDirtyPage(std::uint32_t page);
+  void markDirty(const PageRect& rect);
+  std::optional<PageRect> findPageRect(const BoundingBox& bounds) const;
+  PageToRender preparePage(std::uint32_t page, SceneManager& scene) const;
+
+private:
+  ShaderPermutations& permutations;
+
+  etna::Image atlas;
+  std::vector<etna::Buffer> pageTableBuffers;
+  std::vector<etna::Buffer> pageRequestBuffers;
+  etna::ComputePipeline markPagesPipeline;
+
+  // Virtual page -> physical page index or NO_PAGE
+  std::vector<std::uint32_t> pageTable;
+  // Whether the page was rendered at least once since it got its physical page
+  std::vector<bool> pageResident;
+  std::vector<PhysicalPage> physicalPages;
+  std::vector<std::uint32_t> freePhysicalPages;
+  std::vector<bool> pageDirty;
+  std::vector<std::uint32_t> dirtyPages;
+
+  // Pages covered by dynamic casters last frame, they must be re-rendered when the casters move
+  std::vector<PageRect> dynamicCasterRects;
+
+  std::vector<PageToRender> pagesToRender;
+
+  glm::mat4x4 lastLightMatrix{0.0f};
+  std::uint64_t lastStaticGeometryVersion = 0;
+  bool invalidated = true;
+  std::uint64_t frameIndex = 0;
+
+  std::uint32_t requestedLastFrame = 0;
+};
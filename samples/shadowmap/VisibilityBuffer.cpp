@@ -0,0 +1,212 @@
+#include "VisibilityBuffer.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/RenderTargetStates.hpp>
+#include <imgui.h>
+
+
+VisibilityBuffer::VisibilityBuffer(ShaderPermutations& shader_permutations)
+  : permutations{shader_permutations}
+{
+}
+
+void VisibilityBuffer::loadShaders()
+{
+  permutations.addProgram(
+    "visibility_buffer",
+    {SHADOWMAP_SHADERS_ROOT "visbuffer.vert.spv", SHADOWMAP_SHADERS_ROOT "visbuffer.frag.spv"});
+  permutations.addProgram(
+    "visibility_buffer_resolve", {SHADOWMAP_SHADERS_ROOT "visbuffer_resolve.comp.spv"});
+}
+
+void VisibilityBuffer::allocateResources(glm::uvec2 res)
+{
+  resolution = res;
+  renderResolution = res;
+
+  visibility = etna::get_context().createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{resolution.x, resolution.y, 1},
+    .name = "visibility_buffer",
+    .format = vk::Format::eR32Uint,
+    .imageUsage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eStorage,
+  });
+}
+
+void VisibilityBuffer::setupPipelines(
+  const etna::VertexShaderInputDescription& position_input, DeferredDeletionQueue& retired)
+{
+  auto& pipelineManager = etna::get_context().getPipelineManager();
+
+  // Resolve permutations are recreated on demand from the current programs
+  retired.retire(std::exchange(resolvePipelines, {}));
+
+  retired.retire(std::move(rasterPipeline));
+  rasterPipeline = pipelineManager.createGraphicsPipeline(
+    permutations.getProgram("visibility_buffer").c_str(),
+    etna::GraphicsPipeline::CreateInfo{
+      .vertexShaderInput = position_input,
+      .rasterizationConfig =
+        vk::PipelineRasterizationStateCreateInfo{
+          .polygonMode = vk::PolygonMode::eFill,
+          .cullMode = vk::CullModeFlagBits::eBack,
+          .frontFace = vk::FrontFace::eCounterClockwise,
+          .lineWidth = 1.f,
+        },
+      .fragmentShaderOutput =
+        {
+          .colorAttachmentFormats = {vk::Format::eR32Uint},
+          .depthAttachmentFormat = vk::Format::eD32Sfloat,
+        },
+    });
+}
+
+void VisibilityBuffer::render(
+  vk::CommandBuffer cmd_buf,
+  SceneManager& scene,
+  std::span<const std::uint32_t> instances,
+  const glm::mat4x4& proj_view,
+  const etna::Image& depth_image,
+  TransientAllocator& transient_memory)
+{
+  // Clears the IDs to VISBUF_EMPTY
+  etna::RenderTargetState renderTargets(
+    cmd_buf,
+    {{0, 0}, {renderResolution.x, renderResolution.y}},
+    {{.image = visibility.get(), .view = visibility.getView({})}},
+    {.image = depth_image.get(), .view = depth_image.getView({})});
+
+  drawCount = 0;
+  droppedDrawCount = 0;
+
+  if (!scene.getVertexBuffer())
+    return;
+
+  auto instanceMeshes = scene.getInstanceMeshes();
+  auto instanceMatrices = scene.getInstanceMatrices();
+  auto meshes = scene.getMeshes();
+  auto relems = scene.getRenderElements();
+
+  std::uint32_t requiredDraws = 0;
+  for (const auto instIdx : instances)
+  {
+    const auto& mesh = meshes[instanceMeshes[instIdx]];
+    for (std::size_t j = 0; j < mesh.relemCount; ++j)
+    {
+      const std::uint32_t triangleCount = relems[mesh.firstRelem + j].indexCount / 3;
+      requiredDraws +=
+        (triangleCount + VISBUF_MAX_DRAW_PRIMITIVES - 1) / VISBUF_MAX_DRAW_PRIMITIVES;
+    }
+  }
+
+  drawBuffer = transient_memory.allocate(
+    std::min(requiredDraws, VISBUF_MAX_DRAWS) * sizeof(VisibilityDraw), alignof(VisibilityDraw));
+  auto* draws = reinterpret_cast<VisibilityDraw*>(drawBuffer.data);
+
+  auto programInfo = etna::get_shader_program(permutations.getProgram("visibility_buffer").c_str());
+  auto set = etna::create_descriptor_set(
+    programInfo.getDescriptorLayoutId(0), cmd_buf, {etna::Binding{0, drawBuffer.genBinding()}});
+
+  const auto layout = rasterPipeline.getVkPipelineLayout();
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, rasterPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, {set.getVkSet()}, {});
+  cmd_buf.pushConstants<glm::mat4x4>(layout, vk::ShaderStageFlagBits::eVertex, 0, {proj_view});
+
+  cmd_buf.bindVertexBuffers(0, {scene.getPositionBuffer()}, {0});
+  cmd_buf.bindIndexBuffer(scene.getIndexBuffer(), 0, vk::IndexType::eUint32);
+
+  for (const auto instIdx : instances)
+  {
+    const auto& model = instanceMatrices[instIdx];
+    const glm::mat4x4 normalMatrix = glm::transpose(glm::inverse(model));
+
+    const auto meshIdx = instanceMeshes[instIdx];
+    for (std::size_t j = 0; j < meshes[meshIdx].relemCount; ++j)
+    {
+      const auto& relem = relems[meshes[meshIdx].firstRelem + j];
+      const std::uint32_t triangleCount = relem.indexCount / 3;
+
+      // Primitive IDs only have so many bits, so big relems take several draws
+      for (std::uint32_t first = 0; first < triangleCount; first += VISBUF_MAX_DRAW_PRIMITIVES)
+      {
+        if (drawCount == VISBUF_MAX_DRAWS)
+        {
+          ++droppedDrawCount;
+          continue;
+        }
+
+        draws[drawCount] = VisibilityDraw{
+          .model = model,
+          .normalMatrix = normalMatrix,
+          .firstIndex = relem.indexOffset + 3 * first,
+          .vertexOffset = relem.vertexOffset,
+          .padding0 = {},
+        };
+
+        // The draw index reaches the shaders as gl_InstanceIndex
+        const std::uint32_t count = std::min(triangleCount - first, VISBUF_MAX_DRAW_PRIMITIVES);
+        cmd_buf.drawIndexed(
+          3 * count, 1, relem.indexOffset + 3 * first, relem.vertexOffset, drawCount);
+        ++drawCount;
+      }
+    }
+  }
+}
+
+void VisibilityBuffer::resolve(
+  vk::CommandBuffer cmd_buf,
+  SceneManager& scene,
+  std::vector<etna::Binding> shading_bindings,
+  std::span<const ShaderPermutations::Constant> shading_constants,
+  const glm::mat4x4& proj_view,
+  const etna::Image& target)
+{
+  // Scene buffers can't be bound before anything is loaded
+  if (!scene.getVertexBuffer())
+    return;
+
+  shading_bindings.push_back(
+    etna::Binding{10, visibility.genBinding({}, vk::ImageLayout::eGeneral)});
+  shading_bindings.push_back(etna::Binding{11, drawBuffer.genBinding()});
+  shading_bindings.push_back(etna::Binding{12, scene.getVertexStorageBuffer().genBinding()});
+  shading_bindings.push_back(etna::Binding{13, scene.getIndexStorageBuffer().genBinding()});
+  shading_bindings.push_back(etna::Binding{14, target.genBinding({}, vk::ImageLayout::eGeneral)});
+
+  const auto& program = permutations.getProgram("visibility_buffer_resolve", shading_constants);
+  auto pipelineIt = resolvePipelines.find(program);
+  if (pipelineIt == resolvePipelines.end())
+  {
+    auto& pipelineManager = etna::get_context().getPipelineManager();
+    auto newPipeline = pipelineManager.createComputePipeline(program.c_str(), {});
+    pipelineIt = resolvePipelines.emplace(program, std::move(newPipeline)).first;
+  }
+  const auto& pipeline = pipelineIt->second;
+
+  auto programInfo = etna::get_shader_program(program.c_str());
+  auto set = etna::create_descriptor_set(
+    programInfo.getDescriptorLayoutId(0), cmd_buf, std::move(shading_bindings));
+
+  const auto layout = pipeline.getVkPipelineLayout();
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, layout, 0, {set.getVkSet()}, {});
+
+  const glm::mat4x4 invViewProj = glm::inverse(proj_view);
+  cmd_buf.pushConstants<glm::mat4x4>(layout, vk::ShaderStageFlagBits::eCompute, 0, {invViewProj});
+
+  etna::flush_barriers(cmd_buf);
+
+  cmd_buf.dispatch((renderResolution.x + 7) / 8, (renderResolution.y + 7) / 8, 1);
+}
+
+void VisibilityBuffer::drawGui(const Stats& stats)
+{
+  ImGui::Text("Visibility buffer draws: %u", stats.drawCount);
+  if (stats.droppedDrawCount > 0)
+    ImGui::TextColored(
+      ImVec4(1.0f, 0.3f, 0.3f, 1.0f),
+      "%u draws don't fit into the visibility IDs and were dropped",
+      stats.droppedDrawCount);
+}
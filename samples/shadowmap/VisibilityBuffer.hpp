@@ -0,0 +1,90 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <etna/Buffer.hpp>
+#include <etna/Image.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/GraphicsPipeline.hpp>
+#include <etna/DescriptorSet.hpp>
+#include <glm/glm.hpp>
+
+#include "shaders/VisibilityBuffer.h"
+#include "scene/SceneManager.hpp"
+#include "render_utils/TransientAllocator.hpp"
+#include "render_utils/DeferredDeletionQueue.hpp"
+#include "render_utils/ShaderPermutations.hpp"
+
+
+/**
+ * Visibility buffer rendering: the geometry pass only writes a draw and triangle ID
+ * per pixel, and a single compute pass then fetches the triangle from the unified
+ * scene buffers, interpolates its attributes and shades the pixel. Overdraw costs
+ * nothing but rasterization, and no G-buffer has to be written or read back.
+ */
+class VisibilityBuffer
+{
+public:
+  // The resolve pass shares the lighting shaders, and thus their permutations
+  struct Stats
+  {
+    std::uint32_t drawCount = 0;
+    std::uint32_t droppedDrawCount = 0;
+  };
+
+  explicit VisibilityBuffer(ShaderPermutations& permutations);
+
+  void loadShaders();
+  void allocateResources(glm::uvec2 resolution);
+  // Only the top left part of the buffer is used when the main view is scaled down
+  void setRenderResolution(glm::uvec2 res) { renderResolution = res; }
+  void setupPipelines(
+    const etna::VertexShaderInputDescription& position_input, DeferredDeletionQueue& retired);
+
+  // Renders IDs of all instances into the visibility buffer, depth goes into depth_image.
+  // Per-draw data of the current frame is allocated from transient_memory.
+  void render(
+    vk::CommandBuffer cmd_buf,
+    SceneManager& scene,
+    std::span<const std::uint32_t> instances,
+    const glm::mat4x4& proj_view,
+    const etna::Image& depth_image,
+    TransientAllocator& transient_memory);
+
+  // Shading bindings are expected to contain everything clustered_lighting.glsl needs,
+  // and shading constants to select the permutation of it
+  void resolve(
+    vk::CommandBuffer cmd_buf,
+    SceneManager& scene,
+    std::vector<etna::Binding> shading_bindings,
+    std::span<const ShaderPermutations::Constant> shading_constants,
+    const glm::mat4x4& proj_view,
+    const etna::Image& target);
+
+  Stats getStats() const
+  {
+    return Stats{.drawCount = drawCount, .droppedDrawCount = droppedDrawCount};
+  }
+
+  static void drawGui(const Stats& stats);
+
+  const etna::Image& getVisibility() const { return visibility; }
+
+private:
+  ShaderPermutations& permutations;
+
+  TransientAllocator::Allocation drawBuffer;
+  std::uint32_t drawCount = 0;
+  std::uint32_t droppedDrawCount = 0;
+
+  etna::Image visibility;
+  glm::uvec2 resolution{};
+  glm::uvec2 renderResolution{};
+
+  etna::GraphicsPipeline rasterPipeline;
+  // Keyed by the name of the program permutation
+  std::unordered_map<std::string, etna::ComputePipeline> resolvePipelines;
+};
@@ -1,5 +1,10 @@
 #include "WorldRenderer.hpp"
 
+#include <array>
+#include <bit>
+#include <random>
+#include <utility>
+
 #include <etna/GlobalContext.hpp>
 #include <etna/PipelineManager.hpp>
 #include <etna/RenderTargetStates.hpp>
@@ -7,78 +12,263 @@
 #include <glm/ext.hpp>
 #include <imgui.h>
 
+#include "profiling/TraceRecorder.hpp"
+
+
+// Every render path shades into an HDR image of this format, which is then tonemapped into the
+// swapchain. Half the size of RGBA16F, and lighting is never negative anyway.
+static constexpr vk::Format SHADED_COLOR_FORMAT = vk::Format::eB10G11R11UfloatPack32;
 
-WorldRenderer::WorldRenderer()
-  : sceneMgr{std::make_unique<SceneManager>()}
+static vk::UniqueImageView create_depth_view(
+  const etna::Image& image,
+  vk::ImageViewType type,
+  vk::Format format,
+  std::uint32_t base_layer,
+  std::uint32_t layer_count)
+{
+  return etna::unwrap_vk_result(
+    etna::get_context().getDevice().createImageViewUnique(vk::ImageViewCreateInfo{
+      .image = image.get(),
+      .viewType = type,
+      .format = format,
+      .subresourceRange =
+        {
+          .aspectMask = vk::ImageAspectFlagBits::eDepth,
+          .baseMipLevel = 0,
+          .levelCount = 1,
+          .baseArrayLayer = base_layer,
+          .layerCount = layer_count,
+        },
+    }));
+}
+
+WorldRenderer::WorldRenderer(const RenderCapabilities& device_capabilities)
+  : capabilities{device_capabilities}
+  , sceneMgr{std::make_unique<SceneManager>()}
+  , transientMemory{std::make_unique<TransientAllocator>(TransientAllocator::CreateInfo{
+      .sizePerFrame = 16 * 1024 * 1024,
+      .bufferUsage = vk::BufferUsageFlagBits::eUniformBuffer |
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+      .name = "transient_memory",
+    })}
+  , gpuTimer{std::make_unique<GpuTimer>()}
+  , depthReduction{std::make_unique<DepthReduction>(shaderPermutations)}
+  , virtualShadowMap{std::make_unique<VirtualShadowMap>(shaderPermutations)}
+  , spotShadowAtlas{std::make_unique<ShadowAtlas>()}
+  , clusteredLights{std::make_unique<ClusteredLights>(shaderPermutations)}
+  , visibilityBuffer{std::make_unique<VisibilityBuffer>(shaderPermutations)}
+  , autoExposure{std::make_unique<AutoExposure>(shaderPermutations)}
+  , tonemapper{shaderPermutations}
+  , temporalUpscaler{shaderPermutations}
 {
 }
 
 void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
 {
   resolution = swapchain_resolution;
+  renderResolution = resolution;
 
   auto& ctx = etna::get_context();
 
-  mainViewDepth = ctx.createImage(etna::Image::CreateInfo{
-    .extent = vk::Extent3D{resolution.x, resolution.y, 1},
-    .name = "main_view_depth",
-    .format = vk::Format::eD32Sfloat,
-    .imageUsage = vk::ImageUsageFlagBits::eDepthStencilAttachment,
-  });
+  visibilityBuffer->allocateResources(resolution);
+  temporalUpscaler.allocateResources(resolution);
 
   shadowMap = ctx.createImage(etna::Image::CreateInfo{
     .extent = vk::Extent3D{2048, 2048, 1},
     .name = "shadow_map",
     .format = vk::Format::eD16Unorm,
+    .imageUsage = vk::ImageUsageFlagBits::eDepthStencilAttachment |
+      vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+  });
+
+  staticShadowMap = ctx.createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{2048, 2048, 1},
+    .name = "static_shadow_map",
+    .format = vk::Format::eD16Unorm,
+    .imageUsage = vk::ImageUsageFlagBits::eDepthStencilAttachment |
+      vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc,
+  });
+  shadowCache.dirty = true;
+
+  for (auto& view : cascadeShadowMapLayerViews)
+    view.reset();
+  cascadeShadowMapArrayView.reset();
+
+  const auto cascadeRes = shadowCascades.getResolution();
+  cascadeShadowMap = ctx.createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{cascadeRes, cascadeRes, 1},
+    .name = "cascade_shadow_map",
+    .format = vk::Format::eD16Unorm,
     .imageUsage =
       vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
+    .layers = MAX_SHADOW_CASCADES,
   });
+  cascadeShadowMapArrayView = create_depth_view(
+    cascadeShadowMap, vk::ImageViewType::e2DArray, vk::Format::eD16Unorm, 0, MAX_SHADOW_CASCADES);
+  for (std::uint32_t i = 0; i < MAX_SHADOW_CASCADES; ++i)
+    cascadeShadowMapLayerViews[i] =
+      create_depth_view(cascadeShadowMap, vk::ImageViewType::e2D, vk::Format::eD16Unorm, i, 1);
+  shadowCascades.invalidate();
 
   defaultSampler = etna::Sampler(etna::Sampler::CreateInfo{.name = "default_sampler"});
-  constants = ctx.createBuffer(etna::Buffer::CreateInfo{
-    .size = sizeof(UniformParams),
-    .bufferUsage = vk::BufferUsageFlagBits::eUniformBuffer,
-    .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
-    .name = "constants",
-  });
-
-  constants.map();
 }
 
 void WorldRenderer::loadScene(std::filesystem::path path)
 {
   sceneMgr->selectScene(path);
+  animatedCasterBaseTms.clear();
+  spotLights.clear();
+  localLightBase.clear();
 }
 
 void WorldRenderer::loadShaders()
 {
-  etna::create_program(
+  shaderPermutations.addProgram(
     "simple_material",
     {SHADOWMAP_SHADERS_ROOT "simple_shadow.frag.spv", SHADOWMAP_SHADERS_ROOT "simple.vert.spv"});
-  etna::create_program("simple_shadow", {SHADOWMAP_SHADERS_ROOT "simple.vert.spv"});
+  shaderPermutations.addProgram("simple_shadow", {SHADOWMAP_SHADERS_ROOT "depth_only.vert.spv"});
+  shaderPermutations.addProgram("depth_prepass", {SHADOWMAP_SHADERS_ROOT "depth_only.vert.spv"});
+  if (capabilities.layeredCascades)
+    shaderPermutations.addProgram(
+      "layered_shadow", {SHADOWMAP_SHADERS_ROOT "depth_layered.vert.spv"});
+  shaderPermutations.addProgram(
+    "gbuffer",
+    {SHADOWMAP_SHADERS_ROOT "gbuffer.frag.spv", SHADOWMAP_SHADERS_ROOT "simple.vert.spv"});
+  if (capabilities.supports(RenderPath::Deferred))
+    shaderPermutations.addProgram(
+      "deferred_lighting", {SHADOWMAP_SHADERS_ROOT "deferred_lighting.comp.spv"});
+  depthReduction->loadShaders();
+  virtualShadowMap->loadShaders();
+  clusteredLights->loadShaders();
+  if (capabilities.supports(RenderPath::VisibilityBuffer))
+    visibilityBuffer->loadShaders();
+  tonemapper.loadShaders();
+  autoExposure->loadShaders();
+  temporalUpscaler.loadShaders();
 }
 
 void WorldRenderer::setupPipelines(vk::Format swapchain_format)
 {
+  // Pipelines are keyed by the formats of their attachments. Only the swapchain
+  // format may change at runtime, so a resize that keeps it rebuilds nothing.
+  // Creation itself is serial: etna's pipeline manager is not thread safe and takes
+  // no VkPipelineCache, so neither worker threads nor a pre-warmed cache would help it.
+  if (swapchain_format == swapchainFormat)
+    return;
+
+  if (swapchainFormat == vk::Format::eUndefined)
+    setupFixedFormatPipelines();
+
+  swapchainFormat = swapchain_format;
+  setupSwapchainPipelines();
+}
+
+void WorldRenderer::setupSwapchainPipelines()
+{
+  retiredPipelines.retire(std::move(quadRenderer));
   quadRenderer = std::make_unique<QuadRenderer>(QuadRenderer::CreateInfo{
-    .format = swapchain_format,
+    .format = swapchainFormat,
     .rect = {{0, 0}, {512, 512}},
   });
+  tonemapper.setupPipelines(swapchainFormat, retiredPipelines);
+}
 
+void WorldRenderer::reloadShaders()
+{
+  // Etna recreates pipelines in place, so all of ours, permutations included, stay valid
+  shaderPermutations.reload();
+}
+
+std::array<ShaderPermutations::Constant, 2> WorldRenderer::lightingConstants() const
+{
+  return {
+    ShaderPermutations::Constant{
+      .id = SPEC_SHADOW_TECHNIQUE,
+      .value = static_cast<std::uint32_t>(settings.shadowTechnique),
+    },
+    ShaderPermutations::Constant{
+      .id = SPEC_DEBUG_CASCADES,
+      .value =
+        settings.shadowTechnique == ShadowTechnique::Cascaded && settings.debugCascades ? 1u : 0u,
+    },
+  };
+}
+
+const etna::GraphicsPipeline& WorldRenderer::getForwardPipeline(
+  const std::string& program, bool depth_equal)
+{
+  auto& pipelines = depth_equal ? depthEqualForwardPipelines : forwardPipelines;
+  if (auto it = pipelines.find(program); it != pipelines.end())
+    return it->second;
+
+  etna::GraphicsPipeline::CreateInfo info{
+    .vertexShaderInput =
+      {
+        .bindings = {etna::VertexShaderInputDescription::Binding{
+          .byteStreamDescription = sceneMgr->getVertexFormatDescription(),
+        }},
+      },
+    .rasterizationConfig =
+      vk::PipelineRasterizationStateCreateInfo{
+        .polygonMode = vk::PolygonMode::eFill,
+        .cullMode = vk::CullModeFlagBits::eBack,
+        .frontFace = vk::FrontFace::eCounterClockwise,
+        .lineWidth = 1.f,
+      },
+    .fragmentShaderOutput =
+      {
+        .colorAttachmentFormats = {SHADED_COLOR_FORMAT},
+        .depthAttachmentFormat = vk::Format::eD32Sfloat,
+      },
+  };
+
+  // Depth was already written by the pre-pass, so only the
+  // closest fragment of every pixel passes the test.
+  if (depth_equal)
+    info.depthConfig = vk::PipelineDepthStencilStateCreateInfo{
+      .depthTestEnable = VK_TRUE,
+      .depthWriteEnable = VK_FALSE,
+      .depthCompareOp = vk::CompareOp::eEqual,
+      .maxDepthBounds = 1.f,
+    };
+
+  auto& pipelineManager = etna::get_context().getPipelineManager();
+  auto pipeline = pipelineManager.createGraphicsPipeline(program.c_str(), info);
+  return pipelines.emplace(program, std::move(pipeline)).first->second;
+}
+
+const etna::ComputePipeline& WorldRenderer::getDeferredLightingPipeline(const std::string& program)
+{
+  if (auto it = deferredLightingPipelines.find(program); it != deferredLightingPipelines.end())
+    return it->second;
+
+  auto& pipelineManager = etna::get_context().getPipelineManager();
+  auto pipeline = pipelineManager.createComputePipeline(program.c_str(), {});
+  return deferredLightingPipelines.emplace(program, std::move(pipeline)).first->second;
+}
+
+void WorldRenderer::setupFixedFormatPipelines()
+{
   etna::VertexShaderInputDescription sceneVertexInputDesc{
     .bindings = {etna::VertexShaderInputDescription::Binding{
       .byteStreamDescription = sceneMgr->getVertexFormatDescription(),
     }},
   };
 
+  etna::VertexShaderInputDescription scenePositionInputDesc{
+    .bindings = {etna::VertexShaderInputDescription::Binding{
+      .byteStreamDescription = sceneMgr->getPositionFormatDescription(),
+    }},
+  };
+
 
   auto& pipelineManager = etna::get_context().getPipelineManager();
 
-  basicForwardPipeline = {};
-  basicForwardPipeline = pipelineManager.createGraphicsPipeline(
-    "simple_material",
+  retiredPipelines.retire(std::move(depthPrepassPipeline));
+  depthPrepassPipeline = pipelineManager.createGraphicsPipeline(
+    shaderPermutations.getProgram("depth_prepass").c_str(),
     etna::GraphicsPipeline::CreateInfo{
-      .vertexShaderInput = sceneVertexInputDesc,
+      .vertexShaderInput = scenePositionInputDesc,
       .rasterizationConfig =
         vk::PipelineRasterizationStateCreateInfo{
           .polygonMode = vk::PolygonMode::eFill,
@@ -88,16 +278,15 @@ void WorldRenderer::setupPipelines(vk::Format swapchain_format)
         },
       .fragmentShaderOutput =
         {
-          .colorAttachmentFormats = {swapchain_format},
           .depthAttachmentFormat = vk::Format::eD32Sfloat,
         },
     });
 
-  shadowPipeline = {};
+  retiredPipelines.retire(std::move(shadowPipeline));
   shadowPipeline = pipelineManager.createGraphicsPipeline(
-    "simple_shadow",
+    shaderPermutations.getProgram("simple_shadow").c_str(),
     etna::GraphicsPipeline::CreateInfo{
-      .vertexShaderInput = sceneVertexInputDesc,
+      .vertexShaderInput = scenePositionInputDesc,
       .rasterizationConfig =
         vk::PipelineRasterizationStateCreateInfo{
           .polygonMode = vk::PolygonMode::eFill,
@@ -110,30 +299,115 @@ void WorldRenderer::setupPipelines(vk::Format swapchain_format)
           .depthAttachmentFormat = vk::Format::eD16Unorm,
         },
     });
+
+  retiredPipelines.retire(std::move(gbufferPipeline));
+  gbufferPipeline = pipelineManager.createGraphicsPipeline(
+    shaderPermutations.getProgram("gbuffer").c_str(),
+    etna::GraphicsPipeline::CreateInfo{
+      .vertexShaderInput = sceneVertexInputDesc,
+      .rasterizationConfig =
+        vk::PipelineRasterizationStateCreateInfo{
+          .polygonMode = vk::PolygonMode::eFill,
+          .cullMode = vk::CullModeFlagBits::eBack,
+          .frontFace = vk::FrontFace::eCounterClockwise,
+          .lineWidth = 1.f,
+        },
+      .fragmentShaderOutput =
+        {
+          .colorAttachmentFormats = {vk::Format::eR16G16Snorm},
+          .depthAttachmentFormat = vk::Format::eD32Sfloat,
+        },
+    });
+
+  depthReduction->setupPipelines(retiredPipelines);
+  virtualShadowMap->setupPipelines(retiredPipelines);
+  clusteredLights->setupPipelines(retiredPipelines);
+  if (capabilities.supports(RenderPath::VisibilityBuffer))
+    visibilityBuffer->setupPipelines(scenePositionInputDesc, retiredPipelines);
+  temporalUpscaler.setupPipelines(scenePositionInputDesc, retiredPipelines);
+  autoExposure->setupPipelines(retiredPipelines);
+
+  if (capabilities.layeredCascades)
+  {
+    retiredPipelines.retire(std::move(layeredShadowPipeline));
+    layeredShadowPipeline = pipelineManager.createGraphicsPipeline(
+      shaderPermutations.getProgram("layered_shadow").c_str(),
+      etna::GraphicsPipeline::CreateInfo{
+        .vertexShaderInput = scenePositionInputDesc,
+        .rasterizationConfig =
+          vk::PipelineRasterizationStateCreateInfo{
+            .polygonMode = vk::PolygonMode::eFill,
+            .cullMode = vk::CullModeFlagBits::eBack,
+            .frontFace = vk::FrontFace::eCounterClockwise,
+            .lineWidth = 1.f,
+          },
+        .fragmentShaderOutput =
+          {
+            .depthAttachmentFormat = vk::Format::eD16Unorm,
+          },
+      });
+  }
 }
 
-void WorldRenderer::debugInput(const Keyboard& kb)
+void WorldRenderer::debugInput(RenderSettings& settings, const Keyboard& kb)
 {
   if (kb[KeyboardKey::kQ] == ButtonState::Falling)
-    drawDebugFSQuad = !drawDebugFSQuad;
+    settings.drawDebugFSQuad = !settings.drawDebugFSQuad;
 
   if (kb[KeyboardKey::kP] == ButtonState::Falling)
-    lightProps.usePerspectiveM = !lightProps.usePerspectiveM;
+    settings.usePerspectiveShadow = !settings.usePerspectiveShadow;
 }
 
 void WorldRenderer::update(const FramePacket& packet)
 {
-  ZoneScoped;
+  TRACE_ZONE;
+
+  // Nothing tracks changes for inactive techniques, so their caches must be rebuilt
+  if (packet.settings.shadowTechnique != settings.shadowTechnique)
+  {
+    shadowCascades.invalidate();
+    virtualShadowMap->invalidate();
+  }
+  if (packet.settings.temporalUpscaler.enabled != settings.temporalUpscaler.enabled)
+    temporalUpscaler.invalidateHistory();
+
+  settings = packet.settings;
+  if (!capabilities.layeredCascades)
+    settings.useLayeredCascades = false;
+  if (!capabilities.supports(settings.renderPath))
+    settings.renderPath = RenderPath::Forward;
+  uniformParams.baseColor = settings.baseColor;
+  lightProps.fitToVisibleSamples = settings.fitToVisibleSamples;
+  lightProps.usePerspectiveM = settings.usePerspectiveShadow;
+  dynamicResolution.settings = settings.dynamicResolution;
+  temporalUpscaler.settings = settings.temporalUpscaler;
+  tonemapper.settings = settings.tonemapper;
+  autoExposure->settings = settings.autoExposure;
+  shadowCascades.settings = settings.shadowCascades;
+  virtualShadowMap->settings = settings.virtualShadowMap;
+
+  // The scaled down image is stretched over the whole swapchain, so the aspect stays the same
+  const float aspect = float(resolution.x) / float(resolution.y);
+
+  frameDeltaTime = std::max(packet.currentTime - lastFrameTime, 0.0f);
+  lastFrameTime = packet.currentTime;
+
+  dynamicResolution.update(gpuTimer->getTiming("renderWorld"));
+  renderResolution =
+    dynamicResolution.getRenderResolution(temporalUpscaler.getRenderResolution(resolution));
+  visibilityBuffer->setRenderResolution(renderResolution);
 
   // calc camera matrix
   {
-    const float aspect = float(resolution.x) / float(resolution.y);
-    worldViewProj = packet.mainCam.projTm(aspect) * packet.mainCam.viewTm();
+    const glm::mat4x4 view = packet.mainCam.viewTm();
+    // Motion vectors are computed without the jitter
+    temporalUpscaler.beginFrame(packet.mainCam.projTm(aspect) * view, renderResolution);
+    worldViewProj = packet.mainCam.projTm(aspect, temporalUpscaler.getJitter()) * view;
   }
 
   // calc light matrix
   {
-    const auto mProj = lightProps.usePerspectiveM
+    auto mProj = lightProps.usePerspectiveM
       ? glm::perspectiveLH_ZO(
           -glm::radians(packet.shadowCam.fov), 1.0f, 1.0f, lightProps.lightTargetDist * 2.0f)
       : glm::orthoLH_ZO(
@@ -144,28 +418,207 @@ void WorldRenderer::update(const FramePacket& packet)
           0.0f,
           lightProps.lightTargetDist);
 
+    const auto& visibleBounds = depthReduction->getBounds();
+    const bool fitToVisibleSamples = settings.shadowTechnique == ShadowTechnique::Single &&
+      lightProps.fitToVisibleSamples && !lightProps.usePerspectiveM;
+    if (fitToVisibleSamples && visibleBounds)
+    {
+      // The bounds are a few frames old, so leave some room for camera movement
+      const glm::vec3 extent = visibleBounds->lightSpaceMax - visibleBounds->lightSpaceMin;
+      const glm::vec3 padding = extent * 0.05f + glm::vec3(0.5f);
+      const glm::vec3 boundsMin = visibleBounds->lightSpaceMin - padding;
+      const glm::vec3 boundsMax = visibleBounds->lightSpaceMax + padding;
+
+      // Casters between the light and the visible samples must not be clipped away
+      mProj = glm::orthoLH_ZO(
+        boundsMax.x,
+        boundsMin.x,
+        boundsMax.y,
+        boundsMin.y,
+        std::min(boundsMin.z, 0.0f),
+        boundsMax.z);
+    }
+
     lightMatrix = mProj * packet.shadowCam.viewTm();
+    ndcToLightView = packet.shadowCam.viewTm() * glm::inverse(worldViewProj);
 
     lightPos = packet.shadowCam.position;
   }
 
-  // Upload everything to GPU-mapped memory
+  animateCasters(packet.currentTime);
+
+  // sort instances into static and dynamic shadow casters
+  {
+    const std::size_t instanceCount = sceneMgr->getInstanceMatrices().size();
+    allInstances.resize(instanceCount);
+    staticInstances.clear();
+    dynamicInstances.clear();
+    for (std::uint32_t i = 0; i < instanceCount; ++i)
+    {
+      allInstances[i] = i;
+      (sceneMgr->isInstanceDynamic(i) ? dynamicInstances : staticInstances).push_back(i);
+    }
+  }
+
+  // any change of the light or of the static geometry invalidates the whole cache
+  if (
+    shadowCache.lightProps != lightProps || shadowCache.lightMatrix != lightMatrix ||
+    shadowCache.staticGeometryVersion != sceneMgr->getStaticGeometryVersion())
   {
+    shadowCache.lightProps = lightProps;
+    shadowCache.lightMatrix = lightMatrix;
+    shadowCache.staticGeometryVersion = sceneMgr->getStaticGeometryVersion();
+    shadowCache.dirty = true;
+  }
+
+  mainCam = packet.mainCam;
+  if (spotLights.size() != static_cast<std::size_t>(settings.spotLightCount))
+    generateSpotLights();
+  if (localLightBase.size() != static_cast<std::size_t>(settings.localLightCount))
+    generateLocalLights();
+
+  localLights = localLightBase;
+  if (settings.animateLocalLights)
+    for (std::size_t i = 0; i < localLights.size(); ++i)
+    {
+      const float phase = packet.currentTime + static_cast<float>(i);
+      const glm::vec3 offset{std::sin(phase), 0, std::cos(phase)};
+      localLights[i].position += 0.5f * localLights[i].range * offset;
+    }
+
+  if (settings.shadowTechnique == ShadowTechnique::Cascaded)
+  {
+    shadowCascades.update(packet.mainCam, aspect, packet.shadowCam, *sceneMgr);
+    shadowCascades.fillUniforms(uniformParams);
+  }
+  else
+    uniformParams.cascadeCount = 0;
+
+  // Uploaded to the GPU in renderWorld, once the frame slot is free
+  {
+    uniformParams.spotLightCount = static_cast<shader_uint>(spotLights.size());
+    uniformParams.localLightCount = static_cast<shader_uint>(localLights.size());
+    uniformParams.viewMatrix = packet.mainCam.viewTm();
+    uniformParams.invProjMatrix =
+      glm::inverse(packet.mainCam.projTm(aspect, temporalUpscaler.getJitter()));
+    uniformParams.screenSize = glm::vec2(renderResolution);
+    // Log slices near the camera are tiny, so start them a bit further away
+    uniformParams.clusterNear = std::max(packet.mainCam.zNear, 0.1f);
+    uniformParams.clusterFar = packet.mainCam.zFar;
+    uniformParams.cameraPos = packet.mainCam.position;
+    uniformParams.cameraForward = packet.mainCam.forward();
     uniformParams.lightMatrix = lightMatrix;
     uniformParams.lightPos = lightPos;
     uniformParams.time = packet.currentTime;
+  }
+}
+
+BoundingBox WorldRenderer::computeSceneBounds() const
+{
+  BoundingBox sceneBounds;
+  for (std::size_t i = 0; i < sceneMgr->getInstanceMatrices().size(); ++i)
+    if (const auto bounds = sceneMgr->getInstanceBounds(i); !bounds.empty())
+    {
+      sceneBounds.extend(bounds.min);
+      sceneBounds.extend(bounds.max);
+    }
+  return sceneBounds;
+}
+
+void WorldRenderer::generateSpotLights()
+{
+  spotLights.clear();
+
+  const BoundingBox sceneBounds = computeSceneBounds();
+  if (sceneBounds.empty())
+    return;
+
+  const glm::vec3 extent = sceneBounds.max - sceneBounds.min;
+
+  // Fixed seed, so that lights stay in place when their count changes
+  std::mt19937 rng{42};
+  std::uniform_real_distribution<float> unit{0.0f, 1.0f};
+
+  for (int i = 0; i < settings.spotLightCount; ++i)
+  {
+    const glm::vec3 relativePos{unit(rng), glm::mix(0.3f, 0.9f, unit(rng)), unit(rng)};
+    const glm::vec3 direction{unit(rng) - 0.5f, -1.0f, unit(rng) - 0.5f};
+    const glm::vec3 color{unit(rng), unit(rng), unit(rng)};
+
+    spotLights.push_back(SpotLight{
+      .position = sceneBounds.min + extent * relativePos,
+      .direction = glm::normalize(direction),
+      .color = 0.5f + 0.5f * color,
+      .range = 0.25f * glm::length(extent),
+      .outerAngle = 30.0f,
+    });
+  }
+}
+
+void WorldRenderer::generateLocalLights()
+{
+  localLightBase.clear();
+
+  const BoundingBox sceneBounds = computeSceneBounds();
+  if (sceneBounds.empty())
+    return;
+
+  const glm::vec3 extent = sceneBounds.max - sceneBounds.min;
+
+  std::mt19937 rng{1337};
+  std::uniform_real_distribution<float> unit{0.0f, 1.0f};
+
+  for (int i = 0; i < settings.localLightCount; ++i)
+  {
+    const glm::vec3 relativePos{unit(rng), unit(rng), unit(rng)};
+    const glm::vec3 direction{unit(rng) - 0.5f, -1.0f, unit(rng) - 0.5f};
+    const glm::vec3 color{unit(rng), unit(rng), unit(rng)};
+    // Every fourth light is a spot light
+    const bool isSpot = i % 4 == 0;
 
-    std::memcpy(constants.data(), &uniformParams, sizeof(uniformParams));
+    localLightBase.push_back(LocalLight{
+      .position = sceneBounds.min + extent * relativePos,
+      .range = 0.03f * glm::length(extent),
+      .color = 0.5f * color,
+      .cosOuterAngle = isSpot ? std::cos(glm::radians(40.0f)) : -2.0f,
+      .direction = glm::normalize(direction),
+      .padding0 = 0,
+    });
+  }
+}
+
+void WorldRenderer::animateCasters(float time)
+{
+  auto instanceMatrices = sceneMgr->getInstanceMatrices();
+  const std::size_t count =
+    std::min(static_cast<std::size_t>(settings.animatedCasterCount), instanceMatrices.size());
+
+  // Animate the last instances, as the first ones usually are big things like the ground.
+  // Instances stay dynamic once animated, so they are put back into place when not animated.
+  for (std::size_t i = animatedCasterBaseTms.size(); i < count; ++i)
+    animatedCasterBaseTms.push_back(instanceMatrices[instanceMatrices.size() - 1 - i]);
+
+  for (std::size_t i = 0; i < animatedCasterBaseTms.size(); ++i)
+  {
+    const float offset = i < count ? 0.5f * std::sin(2.0f * time + static_cast<float>(i)) : 0.0f;
+    sceneMgr->setInstanceMatrix(
+      instanceMatrices.size() - 1 - i,
+      glm::translate(glm::mat4x4(1.0f), glm::vec3{0, offset, 0}) * animatedCasterBaseTms[i]);
   }
 }
 
 void WorldRenderer::renderScene(
-  vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout)
+  vk::CommandBuffer cmd_buf,
+  const glm::mat4x4& glob_tm,
+  vk::PipelineLayout pipeline_layout,
+  bool positions_only,
+  std::span<const std::uint32_t> instances)
 {
   if (!sceneMgr->getVertexBuffer())
     return;
 
-  cmd_buf.bindVertexBuffers(0, {sceneMgr->getVertexBuffer()}, {0});
+  cmd_buf.bindVertexBuffers(
+    0, {positions_only ? sceneMgr->getPositionBuffer() : sceneMgr->getVertexBuffer()}, {0});
   cmd_buf.bindIndexBuffer(sceneMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
 
   pushConst2M.projView = glob_tm;
@@ -176,7 +629,7 @@ void WorldRenderer::renderScene(
   auto meshes = sceneMgr->getMeshes();
   auto relems = sceneMgr->getRenderElements();
 
-  for (std::size_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
+  for (const auto instIdx : instances)
   {
     pushConst2M.model = instanceMatrices[instIdx];
 
@@ -197,78 +650,975 @@ void WorldRenderer::renderScene(
 void WorldRenderer::renderWorld(
   vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view)
 {
+  gpuTimer->beginFrame(cmd_buf);
+  transientMemory->beginFrame();
+  retiredPipelines.beginFrame();
+  constants = transientMemory->upload(uniformParams);
+  depthReduction->readBack();
+  if (settings.shadowTechnique == ShadowTechnique::Virtual)
+    virtualShadowMap->update(lightMatrix, *sceneMgr, dynamicInstances);
+  spotShadowAtlas->update(spotLights, mainCam, *sceneMgr, dynamicInstances, *transientMemory);
+  clusteredLights->update(localLights, *transientMemory);
+
   ETNA_PROFILE_GPU(cmd_buf, renderWorld);
+  auto worldTimer = gpuTimer->scope(cmd_buf, "renderWorld");
 
   // draw scene to shadowmap
 
   {
     ETNA_PROFILE_GPU(cmd_buf, renderShadowMap);
+    auto passTimer = gpuTimer->scope(cmd_buf, "renderShadowMap");
+
+    if (settings.shadowTechnique == ShadowTechnique::Cascaded && settings.useLayeredCascades)
+      renderShadowCascadesLayered(cmd_buf);
+    else if (settings.shadowTechnique == ShadowTechnique::Cascaded)
+      renderShadowCascades(cmd_buf);
+    else if (settings.shadowTechnique == ShadowTechnique::Virtual)
+      renderVirtualShadowMap(cmd_buf);
+    else
+      renderShadowMap(cmd_buf);
+  }
+
+  if (!spotShadowAtlas->getTilesToRender().empty())
+  {
+    ETNA_PROFILE_GPU(cmd_buf, renderSpotLightShadows);
+    auto passTimer = gpuTimer->scope(cmd_buf, "renderSpotLightShadows");
+
+    renderSpotLightShadows(cmd_buf);
+  }
+
+  // Everything below only concerns the main view and goes through the frame graph
+
+  const auto target = renderGraph.importImage("swapchain_image", target_image);
+  const auto clusterGrid =
+    renderGraph.importBuffer("cluster_grid", clusteredLights->getClusterGrid());
+  const auto clusterLightIndices =
+    renderGraph.importBuffer("cluster_light_indices", clusteredLights->getClusterLightIndices());
+
+  // Images are allocated at full size, so that changing the render resolution doesn't
+  // reallocate anything. Passes only touch the top left renderExtent part of them.
+  const vk::Extent2D extent{resolution.x, resolution.y};
+  const vk::Extent2D renderExtent{renderResolution.x, renderResolution.y};
+  const RenderGraph::ImageDesc depthDesc{
+    .extent = extent,
+    .format = vk::Format::eD32Sfloat,
+    .usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
+  };
+  const RenderGraph::ImageDesc shadedColorDesc{
+    .extent = extent,
+    .format = SHADED_COLOR_FORMAT,
+    .usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled |
+      (capabilities.shadedColorStorage ? vk::ImageUsageFlagBits::eStorage
+                                       : vk::ImageUsageFlags{}),
+  };
+
+  const auto computeStage = vk::PipelineStageFlagBits2::eComputeShader;
+  const auto fragmentStage = vk::PipelineStageFlagBits2::eFragmentShader;
+
+  // Culled automatically when nothing reads the lists, e.g. on the deferred path
+  renderGraph.addPass(
+    "clusterLights",
+    [&](RenderGraph::PassBuilder& builder) {
+      builder.write(clusterGrid, RenderGraph::storageBuffer(computeStage, true));
+      builder.write(clusterLightIndices, RenderGraph::storageBuffer(computeStage, true));
+    },
+    [&](vk::CommandBuffer cmd, const RenderGraph&) {
+      auto passTimer = gpuTimer->scope(cmd, "clusterLights");
+      clusteredLights->cull(cmd, constants);
+    });
+
+  // Execute functions reference these, so they must outlive renderGraph.execute
+  RenderGraph::ImageHandle depth;
+  RenderGraph::ImageHandle gbufferNormal;
+  RenderGraph::ImageHandle shadedColor;
+  RenderGraph::ImageHandle velocity;
+  RenderGraph::ImageHandle history;
+  RenderGraph::ImageHandle previousHistory;
+  RenderGraph::BufferHandle exposureHistogram;
+  RenderGraph::BufferHandle exposure;
+  // What ends up being stretched over the swapchain image
+  RenderGraph::ImageHandle presented;
+  vk::Extent2D presentedExtent = renderExtent;
+
+  if (settings.renderPath == RenderPath::Forward)
+  {
+    // lay down depth so that the forward pass shades every pixel only once
+    if (settings.useDepthPrepass)
+      renderGraph.addPass(
+        "renderDepthPrepass",
+        [&](RenderGraph::PassBuilder& builder) {
+          depth = builder.createImage("main_view_depth", depthDesc, RenderGraph::depthAttachment());
+        },
+        [&](vk::CommandBuffer cmd, const RenderGraph& graph) {
+          ETNA_PROFILE_GPU(cmd, renderDepthPrepass);
+          auto passTimer = gpuTimer->scope(cmd, "renderDepthPrepass");
+
+          const auto& depthImage = graph.getImage(depth);
+          etna::RenderTargetState renderTargets(
+            cmd,
+            {{0, 0}, renderExtent},
+            {},
+            {.image = depthImage.get(), .view = depthImage.getView({})});
+
+          cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, depthPrepassPipeline.getVkPipeline());
+          renderScene(
+            cmd, worldViewProj, depthPrepassPipeline.getVkPipelineLayout(), true, allInstances);
+        });
+
+    renderGraph.addPass(
+      "renderForward",
+      [&](RenderGraph::PassBuilder& builder) {
+        builder.read(clusterGrid, RenderGraph::storageBuffer(fragmentStage, false));
+        builder.read(clusterLightIndices, RenderGraph::storageBuffer(fragmentStage, false));
+        shadedColor =
+          builder.createImage("shaded_color", shadedColorDesc, RenderGraph::colorAttachment());
+        if (settings.useDepthPrepass)
+        {
+          builder.read(depth, RenderGraph::depthAttachment());
+          builder.write(depth, RenderGraph::depthAttachment());
+        }
+        else
+          depth = builder.createImage("main_view_depth", depthDesc, RenderGraph::depthAttachment());
+      },
+      [&](vk::CommandBuffer cmd, const RenderGraph& graph) {
+        ETNA_PROFILE_GPU(cmd, renderForward);
+        auto passTimer = gpuTimer->scope(cmd, "renderForward");
+
+        const auto& program =
+          shaderPermutations.getProgram("simple_material", lightingConstants());
+        const auto& forwardPipeline = getForwardPipeline(program, settings.useDepthPrepass);
+
+        auto simpleMaterialInfo = etna::get_shader_program(program.c_str());
+
+        auto bindings = lightingBindings();
+        bindings.push_back(etna::Binding{8, clusteredLights->getClusterGrid().genBinding()});
+        bindings.push_back(
+          etna::Binding{9, clusteredLights->getClusterLightIndices().genBinding()});
+        auto set = etna::create_descriptor_set(
+          simpleMaterialInfo.getDescriptorLayoutId(0), cmd, std::move(bindings));
+
+        const auto& depthImage = graph.getImage(depth);
+        const auto& colorImage = graph.getImage(shadedColor);
+        etna::RenderTargetState renderTargets(
+          cmd,
+          {{0, 0}, renderExtent},
+          {{.image = colorImage.get(), .view = colorImage.getView({})}},
+          {.image = depthImage.get(),
+           .view = depthImage.getView({}),
+           .loadOp = settings.useDepthPrepass ? vk::AttachmentLoadOp::eLoad
+                                              : vk::AttachmentLoadOp::eClear});
+
+        cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, forwardPipeline.getVkPipeline());
+        cmd.bindDescriptorSets(
+          vk::PipelineBindPoint::eGraphics,
+          forwardPipeline.getVkPipelineLayout(),
+          0,
+          {set.getVkSet()},
+          {});
+
+        renderScene(
+          cmd, worldViewProj, forwardPipeline.getVkPipelineLayout(), false, allInstances);
+      });
+  }
+  else if (settings.renderPath == RenderPath::Deferred)
+  {
+    renderGraph.addPass(
+      "renderGBuffer",
+      [&](RenderGraph::PassBuilder& builder) {
+        gbufferNormal = builder.createImage(
+          "gbuffer_normal",
+          {
+            .extent = extent,
+            .format = vk::Format::eR16G16Snorm,
+            .usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled,
+          },
+          RenderGraph::colorAttachment());
+        depth = builder.createImage("main_view_depth", depthDesc, RenderGraph::depthAttachment());
+      },
+      [&](vk::CommandBuffer cmd, const RenderGraph& graph) {
+        ETNA_PROFILE_GPU(cmd, renderGBuffer);
+        auto passTimer = gpuTimer->scope(cmd, "renderGBuffer");
+        renderGBuffer(cmd, graph.getImage(gbufferNormal), graph.getImage(depth));
+      });
+
+    renderGraph.addPass(
+      "deferredLighting",
+      [&](RenderGraph::PassBuilder& builder) {
+        builder.read(gbufferNormal, RenderGraph::sampled(computeStage));
+        builder.read(depth, RenderGraph::sampled(computeStage, vk::ImageAspectFlagBits::eDepth));
+        shadedColor = builder.createImage(
+          "shaded_color", shadedColorDesc, RenderGraph::storageImage(computeStage, true));
+      },
+      [&](vk::CommandBuffer cmd, const RenderGraph& graph) {
+        ETNA_PROFILE_GPU(cmd, deferredLighting);
+        auto passTimer = gpuTimer->scope(cmd, "deferredLighting");
+        renderDeferredLighting(
+          cmd, graph.getImage(gbufferNormal), graph.getImage(depth), graph.getImage(shadedColor));
+      });
+  }
+  else if (settings.renderPath == RenderPath::VisibilityBuffer)
+  {
+    const auto visibility =
+      renderGraph.importImage("visibility_buffer", visibilityBuffer->getVisibility());
+
+    renderGraph.addPass(
+      "renderVisibilityBuffer",
+      [&](RenderGraph::PassBuilder& builder) {
+        builder.write(visibility, RenderGraph::colorAttachment());
+        depth = builder.createImage("main_view_depth", depthDesc, RenderGraph::depthAttachment());
+      },
+      [&](vk::CommandBuffer cmd, const RenderGraph& graph) {
+        ETNA_PROFILE_GPU(cmd, renderVisibilityBuffer);
+        auto passTimer = gpuTimer->scope(cmd, "renderVisibilityBuffer");
+        visibilityBuffer->render(
+          cmd, *sceneMgr, allInstances, worldViewProj, graph.getImage(depth), *transientMemory);
+      });
+
+    renderGraph.addPass(
+      "resolveVisibilityBuffer",
+      [&](RenderGraph::PassBuilder& builder) {
+        builder.read(visibility, RenderGraph::storageImage(computeStage, false));
+        builder.read(clusterGrid, RenderGraph::storageBuffer(computeStage, false));
+        builder.read(clusterLightIndices, RenderGraph::storageBuffer(computeStage, false));
+        shadedColor = builder.createImage(
+          "shaded_color", shadedColorDesc, RenderGraph::storageImage(computeStage, true));
+      },
+      [&](vk::CommandBuffer cmd, const RenderGraph& graph) {
+        ETNA_PROFILE_GPU(cmd, resolveVisibilityBuffer);
+        auto passTimer = gpuTimer->scope(cmd, "resolveVisibilityBuffer");
+
+        auto bindings = lightingBindings();
+        bindings.push_back(etna::Binding{8, clusteredLights->getClusterGrid().genBinding()});
+        bindings.push_back(
+          etna::Binding{9, clusteredLights->getClusterLightIndices().genBinding()});
+        visibilityBuffer->resolve(
+          cmd,
+          *sceneMgr,
+          std::move(bindings),
+          lightingConstants(),
+          worldViewProj,
+          graph.getImage(shadedColor));
+      });
+  }
+
+  presented = shadedColor;
+  if (temporalUpscaler.isEnabled())
+  {
+    history = renderGraph.importImage("taa_history", temporalUpscaler.getHistory());
+    previousHistory =
+      renderGraph.importImage("taa_previous_history", temporalUpscaler.getPreviousHistory());
+
+    renderGraph.addPass(
+      "renderVelocity",
+      [&](RenderGraph::PassBuilder& builder) {
+        builder.read(depth, RenderGraph::depthAttachment());
+        velocity = builder.createImage(
+          "velocity",
+          {
+            .extent = extent,
+            .format = TemporalUpscaler::VELOCITY_FORMAT,
+            .usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled,
+          },
+          RenderGraph::colorAttachment());
+      },
+      [&](vk::CommandBuffer cmd, const RenderGraph& graph) {
+        auto passTimer = gpuTimer->scope(cmd, "renderVelocity");
+        temporalUpscaler.renderVelocity(
+          cmd,
+          *sceneMgr,
+          allInstances,
+          worldViewProj,
+          graph.getImage(depth),
+          graph.getImage(velocity),
+          *transientMemory);
+      });
+
+    renderGraph.addPass(
+      "resolveTemporalUpscaling",
+      [&](RenderGraph::PassBuilder& builder) {
+        builder.read(shadedColor, RenderGraph::sampled(computeStage));
+        builder.read(depth, RenderGraph::sampled(computeStage, vk::ImageAspectFlagBits::eDepth));
+        builder.read(velocity, RenderGraph::sampled(computeStage));
+        builder.read(previousHistory, RenderGraph::sampled(computeStage));
+        builder.write(history, RenderGraph::storageImage(computeStage, true));
+      },
+      [&](vk::CommandBuffer cmd, const RenderGraph& graph) {
+        auto passTimer = gpuTimer->scope(cmd, "resolveTemporalUpscaling");
+        temporalUpscaler.resolve(
+          cmd,
+          graph.getImage(shadedColor),
+          graph.getImage(depth),
+          graph.getImage(velocity),
+          renderExtent,
+          defaultSampler);
+      });
+
+    // Already at the output resolution, so the tonemap pass doesn't have to scale it
+    presented = history;
+    presentedExtent = extent;
+  }
+
+  exposure = renderGraph.importBuffer("exposure", autoExposure->getExposure());
+  if (autoExposure->isEnabled())
+  {
+    exposureHistogram =
+      renderGraph.importBuffer("exposure_histogram", autoExposure->getHistogram());
+
+    renderGraph.addPass(
+      "luminanceHistogram",
+      [&](RenderGraph::PassBuilder& builder) {
+        builder.read(presented, RenderGraph::sampled(computeStage));
+        builder.write(exposureHistogram, RenderGraph::storageBuffer(computeStage, true));
+      },
+      [&](vk::CommandBuffer cmd, const RenderGraph& graph) {
+        auto passTimer = gpuTimer->scope(cmd, "luminanceHistogram");
+        autoExposure->buildHistogram(
+          cmd, graph.getImage(presented), presentedExtent, defaultSampler);
+      });
+
+    renderGraph.addPass(
+      "adaptExposure",
+      [&](RenderGraph::PassBuilder& builder) {
+        builder.read(exposureHistogram, RenderGraph::storageBuffer(computeStage, true));
+        builder.write(exposureHistogram, RenderGraph::storageBuffer(computeStage, true));
+        builder.write(exposure, RenderGraph::storageBuffer(computeStage, true));
+      },
+      [&](vk::CommandBuffer cmd, const RenderGraph&) {
+        auto passTimer = gpuTimer->scope(cmd, "adaptExposure");
+        autoExposure->adapt(cmd, frameDeltaTime);
+      });
+  }
+
+  renderGraph.addPass(
+    "tonemap",
+    [&](RenderGraph::PassBuilder& builder) {
+      builder.read(presented, RenderGraph::sampled(fragmentStage));
+      if (autoExposure->isEnabled())
+        builder.read(exposure, RenderGraph::storageBuffer(fragmentStage, false));
+      builder.write(target, RenderGraph::colorAttachment());
+      builder.hasSideEffects();
+    },
+    [&](vk::CommandBuffer cmd, const RenderGraph& graph) {
+      auto passTimer = gpuTimer->scope(cmd, "tonemap");
+      tonemapper.render(
+        cmd,
+        target_image,
+        target_image_view,
+        extent,
+        graph.getImage(presented),
+        extent,
+        presentedExtent,
+        defaultSampler,
+        autoExposure->getExposure(),
+        autoExposure->isEnabled());
+    });
+
+  // Both read the results back to the CPU
+  if (settings.shadowTechnique == ShadowTechnique::Single && lightProps.fitToVisibleSamples)
+    renderGraph.addPass(
+      "depthReduction",
+      [&](RenderGraph::PassBuilder& builder) {
+        builder.read(depth, RenderGraph::sampled(computeStage, vk::ImageAspectFlagBits::eDepth));
+        builder.hasSideEffects();
+      },
+      [&](vk::CommandBuffer cmd, const RenderGraph& graph) {
+        auto passTimer = gpuTimer->scope(cmd, "depthReduction");
+        depthReduction->reduce(
+          cmd, graph.getImage(depth), defaultSampler, ndcToLightView, renderResolution);
+      });
+
+  if (settings.shadowTechnique == ShadowTechnique::Virtual)
+    renderGraph.addPass(
+      "markVirtualShadowMapPages",
+      [&](RenderGraph::PassBuilder& builder) {
+        builder.read(depth, RenderGraph::sampled(computeStage, vk::ImageAspectFlagBits::eDepth));
+        builder.hasSideEffects();
+      },
+      [&](vk::CommandBuffer cmd, const RenderGraph& graph) {
+        auto passTimer = gpuTimer->scope(cmd, "markVirtualShadowMapPages");
+        virtualShadowMap->markPages(
+          cmd,
+          graph.getImage(depth),
+          defaultSampler,
+          lightMatrix * glm::inverse(worldViewProj),
+          renderResolution);
+      });
+
+  if (settings.drawDebugFSQuad && settings.shadowTechnique == ShadowTechnique::Single)
+    renderGraph.addPass(
+      "debugQuad",
+      [&](RenderGraph::PassBuilder& builder) {
+        builder.write(target, RenderGraph::colorAttachment());
+        builder.hasSideEffects();
+      },
+      [&](vk::CommandBuffer cmd, const RenderGraph&) {
+        quadRenderer->render(
+          cmd,
+          target_image,
+          target_image_view,
+          settings.cacheStaticShadows && dynamicInstances.empty() ? staticShadowMap : shadowMap,
+          defaultSampler);
+      });
+
+  renderGraph.execute(cmd_buf);
+
+  publishStats();
+}
+
+void WorldRenderer::publishStats()
+{
+  const auto timings = gpuTimer->getTimings();
+
+  std::lock_guard lock(statsMutex);
+  stats.transientMemoryUsed = transientMemory->getUsedSize();
+  stats.transientMemorySize = transientMemory->getSizePerFrame();
+  stats.visibleBounds = depthReduction->getBounds();
+  stats.dynamicResolution = dynamicResolution.getStats();
+  stats.spotShadowAtlas = spotShadowAtlas->getStats();
+  stats.shadowCascades = shadowCascades.getStats();
+  stats.virtualShadowMap = virtualShadowMap->getStats();
+  stats.visibilityBuffer = visibilityBuffer->getStats();
+  stats.renderGraph = renderGraph.getStats();
+  stats.gpuTimings.assign(timings.begin(), timings.end());
+}
+
+RenderStats WorldRenderer::getStats() const
+{
+  std::lock_guard lock(statsMutex);
+  return stats;
+}
+
+std::vector<etna::Binding> WorldRenderer::lightingBindings()
+{
+  // With nothing dynamic, the cached shadow map can be used as is
+  const auto& currentShadowMap =
+    settings.cacheStaticShadows && dynamicInstances.empty() ? staticShadowMap : shadowMap;
+
+  return {
+    etna::Binding{0, constants.genBinding()},
+    etna::Binding{
+      1,
+      currentShadowMap.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+    etna::Binding{
+      2,
+      etna::ImageBinding{
+        cascadeShadowMap,
+        vk::DescriptorImageInfo{
+          .sampler = defaultSampler.get(),
+          .imageView = cascadeShadowMapArrayView.get(),
+          .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+        }}},
+    etna::Binding{
+      3,
+      virtualShadowMap->getAtlas().genBinding(
+        defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+    etna::Binding{4, virtualShadowMap->getPageTable().genBinding()},
+    etna::Binding{
+      5,
+      spotShadowAtlas->getAtlas().genBinding(
+        defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+    etna::Binding{6, spotShadowAtlas->getLightBuffer().genBinding()},
+    etna::Binding{7, clusteredLights->getLightBuffer().genBinding()},
+  };
+}
+
+void WorldRenderer::renderGBuffer(
+  vk::CommandBuffer cmd_buf, const etna::Image& gbuffer_normal, const etna::Image& depth)
+{
+  // Octahedral world space normals, everything else is reconstructed or uniform
+  etna::RenderTargetState renderTargets(
+    cmd_buf,
+    {{0, 0}, {renderResolution.x, renderResolution.y}},
+    {{.image = gbuffer_normal.get(), .view = gbuffer_normal.getView({})}},
+    {.image = depth.get(), .view = depth.getView({})});
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, gbufferPipeline.getVkPipeline());
+  renderScene(cmd_buf, worldViewProj, gbufferPipeline.getVkPipelineLayout(), false, allInstances);
+}
+
+void WorldRenderer::renderDeferredLighting(
+  vk::CommandBuffer cmd_buf,
+  const etna::Image& gbuffer_normal,
+  const etna::Image& depth,
+  const etna::Image& target)
+{
+  const auto& program = shaderPermutations.getProgram("deferred_lighting", lightingConstants());
+  const auto& pipeline = getDeferredLightingPipeline(program);
+  auto deferredLightingInfo = etna::get_shader_program(program.c_str());
+
+  auto bindings = lightingBindings();
+  bindings.push_back(etna::Binding{
+    10, gbuffer_normal.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)});
+  bindings.push_back(etna::Binding{
+    11, depth.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)});
+  bindings.push_back(etna::Binding{12, target.genBinding({}, vk::ImageLayout::eGeneral)});
+  auto set = etna::create_descriptor_set(
+    deferredLightingInfo.getDescriptorLayoutId(0), cmd_buf, std::move(bindings));
+
+  const auto layout = pipeline.getVkPipelineLayout();
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, layout, 0, {set.getVkSet()}, {});
+
+  const glm::mat4x4 invViewProj = glm::inverse(worldViewProj);
+  cmd_buf.pushConstants<glm::mat4x4>(layout, vk::ShaderStageFlagBits::eCompute, 0, {invViewProj});
+
+  etna::flush_barriers(cmd_buf);
+
+  // Matches TILE_SIZE of the shader
+  constexpr std::uint32_t tileSize = 16;
+  cmd_buf.dispatch(
+    (renderResolution.x + tileSize - 1) / tileSize,
+    (renderResolution.y + tileSize - 1) / tileSize,
+    1);
+}
+
+void WorldRenderer::renderShadowMap(vk::CommandBuffer cmd_buf)
+{
+  const vk::Rect2D shadowRect{{0, 0}, {2048, 2048}};
+
+  if (!settings.cacheStaticShadows)
+  {
+    etna::RenderTargetState renderTargets(
+      cmd_buf, shadowRect, {}, {.image = shadowMap.get(), .view = shadowMap.getView({})});
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, shadowPipeline.getVkPipeline());
+    renderScene(cmd_buf, lightMatrix, shadowPipeline.getVkPipelineLayout(), true, allInstances);
+    return;
+  }
+
+  if (shadowCache.dirty)
+  {
+    ETNA_PROFILE_GPU(cmd_buf, renderStaticShadowCasters);
 
     etna::RenderTargetState renderTargets(
       cmd_buf,
-      {{0, 0}, {2048, 2048}},
+      shadowRect,
       {},
-      {.image = shadowMap.get(), .view = shadowMap.getView({})});
+      {.image = staticShadowMap.get(), .view = staticShadowMap.getView({})});
 
     cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, shadowPipeline.getVkPipeline());
-    renderScene(cmd_buf, lightMatrix, shadowPipeline.getVkPipelineLayout());
+    renderScene(
+      cmd_buf, lightMatrix, shadowPipeline.getVkPipelineLayout(), true, staticInstances);
+
+    shadowCache.dirty = false;
   }
 
-  // draw final scene to screen
+  // The cached map is sampled directly in this case
+  if (dynamicInstances.empty())
+    return;
 
   {
-    ETNA_PROFILE_GPU(cmd_buf, renderForward);
+    ETNA_PROFILE_GPU(cmd_buf, copyStaticShadowCasters);
+
+    etna::set_state(
+      cmd_buf,
+      staticShadowMap.get(),
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferRead,
+      vk::ImageLayout::eTransferSrcOptimal,
+      vk::ImageAspectFlagBits::eDepth);
+    etna::set_state(
+      cmd_buf,
+      shadowMap.get(),
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferWrite,
+      vk::ImageLayout::eTransferDstOptimal,
+      vk::ImageAspectFlagBits::eDepth);
+    etna::flush_barriers(cmd_buf);
+
+    const vk::ImageSubresourceLayers depthLayer{
+      .aspectMask = vk::ImageAspectFlagBits::eDepth,
+      .mipLevel = 0,
+      .baseArrayLayer = 0,
+      .layerCount = 1,
+    };
+    cmd_buf.copyImage(
+      staticShadowMap.get(),
+      vk::ImageLayout::eTransferSrcOptimal,
+      shadowMap.get(),
+      vk::ImageLayout::eTransferDstOptimal,
+      {vk::ImageCopy{
+        .srcSubresource = depthLayer,
+        .dstSubresource = depthLayer,
+        .extent = vk::Extent3D{2048, 2048, 1},
+      }});
+  }
 
-    auto simpleMaterialInfo = etna::get_shader_program("simple_material");
+  {
+    ETNA_PROFILE_GPU(cmd_buf, renderDynamicShadowCasters);
 
-    auto set = etna::create_descriptor_set(
-      simpleMaterialInfo.getDescriptorLayoutId(0),
+    etna::RenderTargetState renderTargets(
       cmd_buf,
-      {etna::Binding{0, constants.genBinding()},
-       etna::Binding{
-         1, shadowMap.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)}});
+      shadowRect,
+      {},
+      {.image = shadowMap.get(),
+       .view = shadowMap.getView({}),
+       .loadOp = vk::AttachmentLoadOp::eLoad});
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, shadowPipeline.getVkPipeline());
+    renderScene(
+      cmd_buf, lightMatrix, shadowPipeline.getVkPipelineLayout(), true, dynamicInstances);
+  }
+}
+
+void WorldRenderer::renderShadowCascades(vk::CommandBuffer cmd_buf)
+{
+  const auto res = shadowCascades.getResolution();
+  const auto cascades = shadowCascades.getCascades();
+
+  for (std::size_t i = 0; i < cascades.size(); ++i)
+  {
+    // Cascades that are still valid keep their contents from previous frames
+    if (!cascades[i].needsUpdate)
+      continue;
 
     etna::RenderTargetState renderTargets(
       cmd_buf,
-      {{0, 0}, {resolution.x, resolution.y}},
-      {{.image = target_image, .view = target_image_view}},
-      {.image = mainViewDepth.get(), .view = mainViewDepth.getView({})});
-
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, basicForwardPipeline.getVkPipeline());
-    cmd_buf.bindDescriptorSets(
-      vk::PipelineBindPoint::eGraphics,
-      basicForwardPipeline.getVkPipelineLayout(),
+      {{0, 0}, {res, res}},
+      {},
+      {.image = cascadeShadowMap.get(), .view = cascadeShadowMapLayerViews[i].get()});
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, shadowPipeline.getVkPipeline());
+    renderScene(
+      cmd_buf,
+      cascades[i].matrix,
+      shadowPipeline.getVkPipelineLayout(),
+      true,
+      cascades[i].casters);
+  }
+}
+
+void WorldRenderer::renderShadowCascadesLayered(vk::CommandBuffer cmd_buf)
+{
+  const auto res = shadowCascades.getResolution();
+  const auto cascades = shadowCascades.getCascades();
+
+  const vk::Rect2D cascadeRect{{0, 0}, {res, res}};
+
+  cascadeCasterMasks.assign(sceneMgr->getInstanceMatrices().size(), 0);
+  std::vector<vk::ClearRect> clearRects;
+  for (std::uint32_t i = 0; i < cascades.size(); ++i)
+  {
+    if (!cascades[i].needsUpdate)
+      continue;
+
+    for (const auto instIdx : cascades[i].casters)
+      cascadeCasterMasks[instIdx] |= 1u << i;
+
+    clearRects.push_back(vk::ClearRect{.rect = cascadeRect, .baseArrayLayer = i, .layerCount = 1});
+  }
+
+  if (clearRects.empty())
+    return;
+
+  layeredCasters.clear();
+  for (std::uint32_t i = 0; i < cascadeCasterMasks.size(); ++i)
+    if (cascadeCasterMasks[i] != 0)
+      layeredCasters.push_back(i);
+
+  // RenderTargetState only supports a single layer, so the render pass is started manually
+  etna::set_state(
+    cmd_buf,
+    cascadeShadowMap.get(),
+    vk::PipelineStageFlagBits2::eEarlyFragmentTests |
+      vk::PipelineStageFlagBits2::eLateFragmentTests,
+    vk::AccessFlagBits2::eDepthStencilAttachmentRead |
+      vk::AccessFlagBits2::eDepthStencilAttachmentWrite,
+    vk::ImageLayout::eDepthAttachmentOptimal,
+    vk::ImageAspectFlagBits::eDepth);
+  etna::flush_barriers(cmd_buf);
+
+  const vk::RenderingAttachmentInfo depthAttachment{
+    .imageView = cascadeShadowMapArrayView.get(),
+    .imageLayout = vk::ImageLayout::eDepthAttachmentOptimal,
+    // Cascades that are still valid must keep their contents, so only the updated ones are cleared
+    .loadOp = vk::AttachmentLoadOp::eLoad,
+    .storeOp = vk::AttachmentStoreOp::eStore,
+  };
+  cmd_buf.beginRendering(vk::RenderingInfo{
+    .renderArea = cascadeRect,
+    .layerCount = static_cast<std::uint32_t>(cascades.size()),
+    .pDepthAttachment = &depthAttachment,
+  });
+
+  cmd_buf.setViewport(
+    0,
+    {vk::Viewport{
+      .x = 0,
+      .y = 0,
+      .width = static_cast<float>(res),
+      .height = static_cast<float>(res),
+      .minDepth = 0.0f,
+      .maxDepth = 1.0f,
+    }});
+  cmd_buf.setScissor(0, {cascadeRect});
+
+  cmd_buf.clearAttachments(
+    {vk::ClearAttachment{
+      .aspectMask = vk::ImageAspectFlagBits::eDepth,
+      .clearValue = vk::ClearDepthStencilValue{1.0f, 0},
+    }},
+    clearRects);
+
+  if (sceneMgr->getVertexBuffer())
+  {
+    const auto& program = shaderPermutations.getProgram("layered_shadow");
+    auto layeredShadowInfo = etna::get_shader_program(program.c_str());
+    auto set = etna::create_descriptor_set(
+      layeredShadowInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {etna::Binding{0, constants.genBinding()}});
+
+    const auto layout = layeredShadowPipeline.getVkPipelineLayout();
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, layeredShadowPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, {set.getVkSet()}, {});
+
+    cmd_buf.bindVertexBuffers(0, {sceneMgr->getPositionBuffer()}, {0});
+    cmd_buf.bindIndexBuffer(sceneMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
+
+    auto instanceMeshes = sceneMgr->getInstanceMeshes();
+    auto instanceMatrices = sceneMgr->getInstanceMatrices();
+    auto meshes = sceneMgr->getMeshes();
+    auto relems = sceneMgr->getRenderElements();
+
+    for (const auto instIdx : layeredCasters)
+    {
+      const LayeredPushConstants pushConst{
+        .model = instanceMatrices[instIdx],
+        .cascadeMask = cascadeCasterMasks[instIdx],
+      };
+      cmd_buf.pushConstants<LayeredPushConstants>(
+        layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst});
+
+      // One instance per cascade, the shader picks the layer from the mask
+      const auto cascadeCount = static_cast<std::uint32_t>(std::popcount(pushConst.cascadeMask));
+
+      const auto meshIdx = instanceMeshes[instIdx];
+      for (std::size_t j = 0; j < meshes[meshIdx].relemCount; ++j)
+      {
+        const auto& relem = relems[meshes[meshIdx].firstRelem + j];
+        cmd_buf.drawIndexed(
+          relem.indexCount, cascadeCount, relem.indexOffset, relem.vertexOffset, 0);
+      }
+    }
+  }
+
+  cmd_buf.endRendering();
+}
+
+void WorldRenderer::renderVirtualShadowMap(vk::CommandBuffer cmd_buf)
+{
+  const auto pages = virtualShadowMap->getPagesToRender();
+  if (pages.empty())
+    return;
+
+  const auto& atlas = virtualShadowMap->getAtlas();
+
+  // Pages that were not touched must keep their contents, so every page is cleared separately
+  etna::RenderTargetState renderTargets(
+    cmd_buf,
+    {{0, 0}, {VSM_PHYSICAL_RESOLUTION, VSM_PHYSICAL_RESOLUTION}},
+    {},
+    {.image = atlas.get(), .view = atlas.getView({}), .loadOp = vk::AttachmentLoadOp::eLoad});
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, shadowPipeline.getVkPipeline());
+
+  for (const auto& page : pages)
+  {
+    cmd_buf.clearAttachments(
+      {vk::ClearAttachment{
+        .aspectMask = vk::ImageAspectFlagBits::eDepth,
+        .clearValue = vk::ClearDepthStencilValue{1.0f, 0},
+      }},
+      {vk::ClearRect{.rect = page.rect, .baseArrayLayer = 0, .layerCount = 1}});
+
+    cmd_buf.setViewport(
       0,
-      {set.getVkSet()},
-      {});
+      {vk::Viewport{
+        .x = static_cast<float>(page.rect.offset.x),
+        .y = static_cast<float>(page.rect.offset.y),
+        .width = static_cast<float>(page.rect.extent.width),
+        .height = static_cast<float>(page.rect.extent.height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f,
+      }});
+    cmd_buf.setScissor(0, {page.rect});
 
-    renderScene(cmd_buf, worldViewProj, basicForwardPipeline.getVkPipelineLayout());
+    renderScene(cmd_buf, page.matrix, shadowPipeline.getVkPipelineLayout(), true, page.casters);
   }
+}
+
+void WorldRenderer::renderSpotLightShadows(vk::CommandBuffer cmd_buf)
+{
+  const auto& atlas = spotShadowAtlas->getAtlas();
+
+  // Tiles of lights that didn't change must keep their contents
+  etna::RenderTargetState renderTargets(
+    cmd_buf,
+    {{0, 0}, {ShadowAtlas::RESOLUTION, ShadowAtlas::RESOLUTION}},
+    {},
+    {.image = atlas.get(), .view = atlas.getView({}), .loadOp = vk::AttachmentLoadOp::eLoad});
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, shadowPipeline.getVkPipeline());
 
-  if (drawDebugFSQuad)
-    quadRenderer->render(cmd_buf, target_image, target_image_view, shadowMap, defaultSampler);
+  for (const auto& tile : spotShadowAtlas->getTilesToRender())
+  {
+    cmd_buf.clearAttachments(
+      {vk::ClearAttachment{
+        .aspectMask = vk::ImageAspectFlagBits::eDepth,
+        .clearValue = vk::ClearDepthStencilValue{1.0f, 0},
+      }},
+      {vk::ClearRect{.rect = tile.rect, .baseArrayLayer = 0, .layerCount = 1}});
+
+    cmd_buf.setViewport(
+      0,
+      {vk::Viewport{
+        .x = static_cast<float>(tile.rect.offset.x),
+        .y = static_cast<float>(tile.rect.offset.y),
+        .width = static_cast<float>(tile.rect.extent.width),
+        .height = static_cast<float>(tile.rect.extent.height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f,
+      }});
+    cmd_buf.setScissor(0, {tile.rect});
+
+    renderScene(cmd_buf, tile.matrix, shadowPipeline.getVkPipelineLayout(), true, tile.casters);
+  }
 }
 
-void WorldRenderer::drawGui()
+void WorldRenderer::drawGui(
+  RenderSettings& settings, const RenderStats& stats, const RenderCapabilities& capabilities)
 {
   ImGui::Begin("Simple render settings");
 
-  float color[3]{uniformParams.baseColor.r, uniformParams.baseColor.g, uniformParams.baseColor.b};
+  float color[3]{settings.baseColor.r, settings.baseColor.g, settings.baseColor.b};
   ImGui::ColorEdit3(
     "Meshes base color", color, ImGuiColorEditFlags_PickerHueWheel | ImGuiColorEditFlags_NoInputs);
-  uniformParams.baseColor = {color[0], color[1], color[2]};
-
-  float pos[3]{uniformParams.lightPos.x, uniformParams.lightPos.y, uniformParams.lightPos.z};
-  ImGui::SliderFloat3("Light source position", pos, -10.f, 10.f);
-  uniformParams.lightPos = {pos[0], pos[1], pos[2]};
+  settings.baseColor = {color[0], color[1], color[2]};
 
   ImGui::Text(
     "Application average %.3f ms/frame (%.1f FPS)",
     1000.0f / ImGui::GetIO().Framerate,
     ImGui::GetIO().Framerate);
+  ImGui::Text(
+    "Transient memory: %.1f / %.1f KiB",
+    static_cast<float>(stats.transientMemoryUsed) / 1024.0f,
+    static_cast<float>(stats.transientMemorySize) / 1024.0f);
+
+  static constexpr std::array renderPathNames{"Forward", "Deferred", "Visibility buffer"};
+  if (ImGui::BeginCombo("Render path", renderPathNames[static_cast<int>(settings.renderPath)]))
+  {
+    for (int i = 0; i < static_cast<int>(renderPathNames.size()); ++i)
+    {
+      const auto path = static_cast<RenderPath>(i);
+      // Greyed out when the device lacks a feature the path needs
+      const ImGuiSelectableFlags flags =
+        capabilities.supports(path) ? ImGuiSelectableFlags_None : ImGuiSelectableFlags_Disabled;
+      if (ImGui::Selectable(renderPathNames[i], settings.renderPath == path, flags))
+        settings.renderPath = path;
+    }
+    ImGui::EndCombo();
+  }
+  if (settings.renderPath == RenderPath::VisibilityBuffer)
+    VisibilityBuffer::drawGui(stats.visibilityBuffer);
+
+  if (settings.renderPath == RenderPath::Forward)
+    ImGui::Checkbox("Depth pre-pass", &settings.useDepthPrepass);
+  ImGui::SliderInt("Animated shadow casters", &settings.animatedCasterCount, 0, 32);
+
+  // Headers don't push an ID, and several of these have an "Enabled" checkbox
+  ImGui::PushID("DynamicResolution");
+  if (ImGui::CollapsingHeader("Dynamic resolution"))
+    DynamicResolution::drawGui(settings.dynamicResolution, stats.dynamicResolution);
+  ImGui::PopID();
+
+  ImGui::PushID("TemporalUpscaling");
+  if (ImGui::CollapsingHeader("Temporal upscaling"))
+    TemporalUpscaler::drawGui(settings.temporalUpscaler);
+  ImGui::PopID();
+
+  ImGui::PushID("Tonemapping");
+  if (ImGui::CollapsingHeader("Tonemapping"))
+  {
+    Tonemapper::drawGui(settings.tonemapper);
+    ImGui::Separator();
+    ImGui::Text("Auto exposure");
+    AutoExposure::drawGui(settings.autoExposure);
+  }
+  ImGui::PopID();
+
+  if (ImGui::CollapsingHeader("Spot lights"))
+  {
+    ImGui::SliderInt("Spot light count", &settings.spotLightCount, 0, MAX_SPOT_LIGHTS);
+    ShadowAtlas::drawGui(stats.spotShadowAtlas);
+  }
+
+  if (ImGui::CollapsingHeader("Clustered lights"))
+  {
+    ImGui::SliderInt("Local light count", &settings.localLightCount, 0, MAX_LOCAL_LIGHTS);
+    ImGui::Checkbox("Animate local lights", &settings.animateLocalLights);
+  }
+
+  if (ImGui::CollapsingHeader("Shadows", ImGuiTreeNodeFlags_DefaultOpen))
+  {
+    int technique = static_cast<int>(settings.shadowTechnique);
+    ImGui::Combo("Technique", &technique, "Single\0Cascaded\0Virtual\0");
+    settings.shadowTechnique = static_cast<ShadowTechnique>(technique);
+
+    if (settings.shadowTechnique == ShadowTechnique::Single)
+    {
+      ImGui::Checkbox("Cache static shadow casters", &settings.cacheStaticShadows);
+      ImGui::Checkbox("Fit to visible samples (SDSM)", &settings.fitToVisibleSamples);
+      if (settings.fitToVisibleSamples)
+      {
+        if (const auto& visibleBounds = stats.visibleBounds)
+          ImGui::Text(
+            "Visible depth range: [%.4f, %.4f]",
+            visibleBounds->minDepth,
+            visibleBounds->maxDepth);
+        else
+          ImGui::Text("Nothing visible");
+      }
+    }
+    else if (settings.shadowTechnique == ShadowTechnique::Cascaded)
+    {
+      ImGui::Checkbox("Visualize cascades", &settings.debugCascades);
+      if (capabilities.layeredCascades)
+        ImGui::Checkbox("Render cascades in a single pass", &settings.useLayeredCascades);
+      ShadowCascades::drawGui(settings.shadowCascades, stats.shadowCascades);
+    }
+    else if (settings.shadowTechnique == ShadowTechnique::Virtual)
+      VirtualShadowMap::drawGui(settings.virtualShadowMap, stats.virtualShadowMap);
+  }
+
+  if (ImGui::CollapsingHeader("Frame graph"))
+  {
+    const auto& graphStats = stats.renderGraph;
+    ImGui::Text("Passes: %u", graphStats.passCount);
+    for (const auto& name : graphStats.culledPasses)
+      ImGui::BulletText("Culled: %s", name.c_str());
+    ImGui::Text(
+      "Transient images: %u in %u allocations",
+      graphStats.transientImageCount,
+      graphStats.physicalImageCount);
+    ImGui::Text(
+      "Transient buffers: %u in %u allocations",
+      graphStats.transientBufferCount,
+      graphStats.physicalBufferCount);
+  }
+
+  if (ImGui::CollapsingHeader("GPU timings", ImGuiTreeNodeFlags_DefaultOpen))
+    for (const auto& timing : stats.gpuTimings)
+      ImGui::Text(
+        "%*s%s: %.3f ms",
+        static_cast<int>(2 * timing.depth),
+        "",
+        timing.name.c_str(),
+        timing.milliseconds);
 
   ImGui::NewLine();
 
   ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.0f, 1.0f), "Press 'B' to recompile and reload shaders");
+  ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.0f, 1.0f), "Press 'T' to save a trace of recent frames");
   ImGui::End();
 }
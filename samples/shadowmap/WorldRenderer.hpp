@@ -1,17 +1,36 @@
 #pragma once
 
+#include <mutex>
+
 #include <etna/Image.hpp>
 #include <etna/Sampler.hpp>
 #include <etna/Buffer.hpp>
 #include <etna/GraphicsPipeline.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/DescriptorSet.hpp>
 #include <glm/glm.hpp>
 
 #include "shaders/UniformParams.h"
 #include "scene/SceneManager.hpp"
 #include "render_utils/QuadRenderer.hpp"
+#include "render_utils/TransientAllocator.hpp"
+#include "render_utils/ShaderPermutations.hpp"
+#include "render_utils/DeferredDeletionQueue.hpp"
+#include "profiling/GpuTimer.hpp"
+#include "render_graph/RenderGraph.hpp"
 #include "wsi/Keyboard.hpp"
 
 #include "FramePacket.hpp"
+#include "ShadowCascades.hpp"
+#include "DepthReduction.hpp"
+#include "VirtualShadowMap.hpp"
+#include "ShadowAtlas.hpp"
+#include "ClusteredLights.hpp"
+#include "VisibilityBuffer.hpp"
+#include "DynamicResolution.hpp"
+#include "Tonemapper.hpp"
+#include "AutoExposure.hpp"
+#include "TemporalUpscaler.hpp"
 
 
 /**
@@ -21,32 +40,94 @@
 class WorldRenderer
 {
 public:
-  WorldRenderer();
+  explicit WorldRenderer(const RenderCapabilities& capabilities);
 
   void loadScene(std::filesystem::path path);
 
   void loadShaders();
   void allocateResources(glm::uvec2 swapchain_resolution);
   void setupPipelines(vk::Format swapchain_format);
+  // Must be called once new shader binaries are compiled, while no frame is in flight
+  void reloadShaders();
+
+  // Like the GUI, debug hotkeys only edit the settings that are sent with every frame
+  static void debugInput(RenderSettings& settings, const Keyboard& kb);
+  static void drawGui(
+    RenderSettings& settings, const RenderStats& stats, const RenderCapabilities& capabilities);
 
-  void debugInput(const Keyboard& kb);
   void update(const FramePacket& packet);
-  void drawGui();
   void renderWorld(
     vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view);
 
+  // Of the latest recorded frame, may be called from any thread
+  RenderStats getStats() const;
+
+  std::span<const GpuTimer::Timing> getGpuTimings() const { return gpuTimer->getTimings(); }
+
 private:
+  // Pipelines rendering into the swapchain image, rebuilt when its format changes
+  void setupSwapchainPipelines();
+  // Everything else, only built once and on shader reloads
+  void setupFixedFormatPipelines();
+
+  // Depth-only passes should only fetch positions, which are stored in a separate stream
   void renderScene(
-    vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout);
+    vk::CommandBuffer cmd_buf,
+    const glm::mat4x4& glob_tm,
+    vk::PipelineLayout pipeline_layout,
+    bool positions_only,
+    std::span<const std::uint32_t> instances);
+
+  void renderShadowMap(vk::CommandBuffer cmd_buf);
+  void renderShadowCascades(vk::CommandBuffer cmd_buf);
+  void renderShadowCascadesLayered(vk::CommandBuffer cmd_buf);
+  void renderVirtualShadowMap(vk::CommandBuffer cmd_buf);
+  void renderSpotLightShadows(vk::CommandBuffer cmd_buf);
+  void renderGBuffer(
+    vk::CommandBuffer cmd_buf, const etna::Image& gbuffer_normal, const etna::Image& depth);
+  void renderDeferredLighting(
+    vk::CommandBuffer cmd_buf,
+    const etna::Image& gbuffer_normal,
+    const etna::Image& depth,
+    const etna::Image& target);
+  // Resources used by both the forward and the deferred lighting shaders
+  std::vector<etna::Binding> lightingBindings();
+  // Options baked into the lighting shaders of the current frame
+  std::array<ShaderPermutations::Constant, 2> lightingConstants() const;
+  const etna::GraphicsPipeline& getForwardPipeline(const std::string& program, bool depth_equal);
+  const etna::ComputePipeline& getDeferredLightingPipeline(const std::string& program);
+  void generateSpotLights();
+  void generateLocalLights();
+  BoundingBox computeSceneBounds() const;
+  void animateCasters(float time);
+  void publishStats();
 
 
 private:
+  using RenderPath = RenderSettings::RenderPath;
+  using ShadowTechnique = RenderSettings::ShadowTechnique;
+
+  RenderCapabilities capabilities;
   std::unique_ptr<SceneManager> sceneMgr;
+  // Of the frame being drawn, comes with the frame packet
+  RenderSettings settings;
+  ShaderPermutations shaderPermutations;
+  // Pipelines replaced by a shader reload wait here until no frame in flight uses them
+  DeferredDeletionQueue retiredPipelines;
 
-  etna::Image mainViewDepth;
   etna::Image shadowMap;
+  // Contains only static shadow casters, re-rendered only when the light or static geometry changes
+  etna::Image staticShadowMap;
+  // One layer per cascade. Views are created manually, as the layers are
+  // rendered into separately, but sampled as a single array texture.
+  etna::Image cascadeShadowMap;
+  vk::UniqueImageView cascadeShadowMapArrayView;
+  std::array<vk::UniqueImageView, MAX_SHADOW_CASCADES> cascadeShadowMapLayerViews;
   etna::Sampler defaultSampler;
-  etna::Buffer constants;
+  // Everything the GPU reads that changes every frame is allocated from here
+  std::unique_ptr<TransientAllocator> transientMemory;
+  // Uniforms of the current frame
+  TransientAllocator::Allocation constants;
 
   struct PushConstants
   {
@@ -54,8 +135,16 @@ private:
     glm::mat4x4 model;
   } pushConst2M;
 
+  struct LayeredPushConstants
+  {
+    glm::mat4x4 model;
+    std::uint32_t cascadeMask;
+  };
+
   glm::mat4x4 worldViewProj;
   glm::mat4x4 lightMatrix;
+  // Transforms main view NDC into light view space, used by the depth reduction
+  glm::mat4x4 ndcToLightView;
   glm::vec3 lightPos;
 
   struct ShadowMapCam
@@ -63,20 +152,93 @@ private:
     float radius = 10;
     float lightTargetDist = 24;
     bool usePerspectiveM = false;
+    // Fit the orthographic projection to the visible samples instead of using the radius
+    bool fitToVisibleSamples = false;
+
+    bool operator==(const ShadowMapCam&) const = default;
   } lightProps;
 
+  struct ShadowCache
+  {
+    bool dirty = true;
+    ShadowMapCam lightProps;
+    glm::mat4x4 lightMatrix{};
+    std::uint64_t staticGeometryVersion = 0;
+  } shadowCache;
+
+  ShadowCascades shadowCascades{2048};
+  // Bit i is set if the instance has to be rendered into cascade i
+  std::vector<std::uint32_t> cascadeCasterMasks;
+  std::vector<std::uint32_t> layeredCasters;
+
+  std::vector<std::uint32_t> allInstances;
+  std::vector<std::uint32_t> staticInstances;
+  std::vector<std::uint32_t> dynamicInstances;
+
+  std::vector<glm::mat4x4> animatedCasterBaseTms;
+
   UniformParams uniformParams{
     .lightMatrix = {},
     .lightPos = {},
     .time = {},
     .baseColor = {0.9f, 0.92f, 1.0f},
+    .cascadeCount = 0,
+    .cascadeMatrices = {},
+    .cascadeSplits = {},
+    .cameraPos = {},
+    .spotLightCount = 0,
+    .cameraForward = {},
+    .localLightCount = 0,
+    .viewMatrix = {},
+    .invProjMatrix = {},
+    .screenSize = {},
+    .clusterNear = {},
+    .clusterFar = {},
   };
 
-  etna::GraphicsPipeline basicForwardPipeline{};
+  // Format the swapchain pipelines were built for
+  vk::Format swapchainFormat = vk::Format::eUndefined;
+  // Lighting pipelines are keyed by the name of the program permutation, created on demand
+  std::unordered_map<std::string, etna::GraphicsPipeline> forwardPipelines;
+  // Same as forwardPipelines, but only shade fragments that survived the depth pre-pass
+  std::unordered_map<std::string, etna::GraphicsPipeline> depthEqualForwardPipelines;
+  etna::GraphicsPipeline depthPrepassPipeline{};
   etna::GraphicsPipeline shadowPipeline{};
+  etna::GraphicsPipeline layeredShadowPipeline{};
+  etna::GraphicsPipeline gbufferPipeline{};
+  std::unordered_map<std::string, etna::ComputePipeline> deferredLightingPipelines;
+
+  // Main view passes are scheduled through it, their images are transient
+  RenderGraph renderGraph;
+
+  std::unique_ptr<GpuTimer> gpuTimer;
+  std::unique_ptr<DepthReduction> depthReduction;
+  std::unique_ptr<VirtualShadowMap> virtualShadowMap;
+  std::unique_ptr<ShadowAtlas> spotShadowAtlas;
+
+  std::vector<SpotLight> spotLights;
+  Camera mainCam;
+
+  std::unique_ptr<ClusteredLights> clusteredLights;
+  std::unique_ptr<VisibilityBuffer> visibilityBuffer;
+  std::unique_ptr<AutoExposure> autoExposure;
+  std::vector<LocalLight> localLightBase;
+  std::vector<LocalLight> localLights;
 
   std::unique_ptr<QuadRenderer> quadRenderer;
-  bool drawDebugFSQuad = false;
+  // All render paths shade into an offscreen HDR image, this brings it to the swapchain image
+  Tonemapper tonemapper;
+  DynamicResolution dynamicResolution;
+  TemporalUpscaler temporalUpscaler;
 
+  // Of the swapchain, main view images are always allocated at this size
   glm::uvec2 resolution;
+  // The main view is rendered into the top left part of this size, changes every frame
+  glm::uvec2 renderResolution;
+
+  float lastFrameTime = 0;
+  float frameDeltaTime = 0;
+
+  mutable std::mutex statsMutex;
+  RenderStats stats;
 };
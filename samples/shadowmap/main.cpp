@@ -1,11 +1,138 @@
 #include "App.hpp"
 
+#include <cstdlib>
+#include <optional>
+#include <string_view>
 
-int main()
+#include "profiling/TraceRecorder.hpp"
+
+
+static std::optional<float> parse_float(const char* str)
+{
+  char* end = nullptr;
+  const float value = std::strtof(str, &end);
+  if (end == str || *end != '\0')
+    return std::nullopt;
+  return value;
+}
+
+static std::optional<AppOptions> parse_options(int argc, char** argv)
+{
+  AppOptions options;
+  bool hasFrameCount = false;
+  std::optional<std::uint32_t> warmupFrames;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string_view arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+    if (options.headless.parseArgument(argc, argv, i))
+      hasFrameCount = hasFrameCount || arg == "--frames";
+    else if (arg == "--pipeline-depth" && value != nullptr && parse_uint(value))
+    {
+      options.pipelineDepth = *parse_uint(value);
+      ++i;
+    }
+    else if (arg == "--low-latency")
+      options.framePacing = Renderer::FramePacing::LowLatency;
+    else if (arg == "--benchmark")
+    {
+      options.benchmark.emplace();
+      // The camera path is optional
+      if (value != nullptr && value[0] != '-')
+      {
+        options.benchmark->pathFile = value;
+        ++i;
+      }
+    }
+    else if (arg == "--warmup" && value != nullptr && parse_uint(value))
+    {
+      warmupFrames = parse_uint(value);
+      ++i;
+    }
+    else if (arg == "--report" && value != nullptr)
+    {
+      options.reportFile = value;
+      ++i;
+    }
+    else if (arg == "--baseline" && value != nullptr)
+    {
+      options.baselineFile = value;
+      ++i;
+    }
+    else if (arg == "--trace" && value != nullptr)
+    {
+      options.traceFile = value;
+      ++i;
+    }
+    else if (
+      arg == "--trace-seconds" && value != nullptr && parse_float(value).value_or(0.0f) > 0.0f)
+    {
+      options.traceSeconds = parse_float(value);
+      ++i;
+    }
+    else if (arg == "--threshold" && value != nullptr && parse_float(value))
+    {
+      options.regressionThresholdPercent = *parse_float(value);
+      ++i;
+    }
+    else
+    {
+      spdlog::error("Unknown or incomplete argument '{}'", arg);
+      return std::nullopt;
+    }
+  }
+
+  if (!options.headless.validate())
+    return std::nullopt;
+
+  if (options.benchmark && !options.headless.captureFrames.empty())
+  {
+    spdlog::error("Frames can not be captured while benchmarking");
+    return std::nullopt;
+  }
+
+  if (options.framePacing == Renderer::FramePacing::LowLatency)
+    options.pipelineDepth = 0;
+
+  if (options.benchmark)
+  {
+    // Measured frames, the warmup ones come on top
+    if (hasFrameCount)
+      options.benchmark->frameCount = options.headless.frameCount;
+    options.benchmark->warmupFrames = warmupFrames.value_or(options.benchmark->warmupFrames);
+  }
+
+  return options;
+}
+
+int main(int argc, char** argv)
 {
+  const auto options = parse_options(argc, argv);
+  if (!options)
+  {
+    spdlog::info(
+      "Usage: shadowmap [--pipeline-depth N] [--low-latency]\n"
+      "                 [--headless [--frames N] [--capture FRAME]... [--output DIR]]\n"
+      "                 [--benchmark [PATH] [--warmup N] [--frames N] [--report FILE]\n"
+      "                  [--baseline FILE] [--threshold PERCENT]]\n"
+      "                 [--trace FILE [--trace-seconds SECONDS]]");
+    return 1;
+  }
+
+  int exitCode = 0;
+  {
+    App app(*options);
+    exitCode = app.run();
+  }
+
+  if (!options->traceFile.empty())
   {
-    App app;
-    app.run();
+    auto& recorder = TraceRecorder::get();
+    if (options->traceSeconds)
+      recorder.dumpSeconds(options->traceFile, *options->traceSeconds);
+    else
+      recorder.dumpFrames(options->traceFile, TraceRecorder::FRAME_CAPACITY);
   }
 
   // Etna needs to be de-initialized after all resources allocated by app
@@ -13,5 +140,5 @@ int main()
   if (etna::is_initilized())
     etna::shutdown();
 
-  return 0;
+  return exitCode;
 }
@@ -0,0 +1,26 @@
+#ifndef AUTO_EXPOSURE_H_INCLUDED
+#define AUTO_EXPOSURE_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// Bin 0 is for pixels too dark to have a meaningful log luminance,
+// the rest cover the log luminance range uniformly
+#define EXPOSURE_HISTOGRAM_BINS 256u
+// The histogram pass has a thread per pixel and a thread per bin in a 16x16 group
+#define EXPOSURE_HISTOGRAM_GROUP_SIZE 16u
+
+#define TONEMAP_OPERATOR_CLAMP 0u
+#define TONEMAP_OPERATOR_REINHARD 1u
+#define TONEMAP_OPERATOR_ACES 2u
+
+// Written by the GPU only, persists between frames
+struct ExposureState
+{
+  // 0 until the first frame was measured
+  shader_float adaptedLuminance;
+  shader_float exposure;
+};
+
+
+#endif // AUTO_EXPOSURE_H_INCLUDED
@@ -0,0 +1,31 @@
+#ifndef CLUSTERED_LIGHTS_H_INCLUDED
+#define CLUSTERED_LIGHTS_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// The view frustum is split into screen tiles and exponentially distributed depth slices
+#define CLUSTER_TILES_X 16u
+#define CLUSTER_TILES_Y 9u
+#define CLUSTER_SLICES 24u
+#define CLUSTER_COUNT (CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES)
+#define CLUSTER_INDEX(c) (((c).z * CLUSTER_TILES_Y + (c).y) * CLUSTER_TILES_X + (c).x)
+
+#define MAX_LIGHTS_PER_CLUSTER 256u
+// Size of the compacted index lists of all clusters together
+#define MAX_CLUSTER_LIGHT_INDICES (CLUSTER_COUNT * 64u)
+#define MAX_LOCAL_LIGHTS 16384u
+
+// Point light if cosOuterAngle is below -1, spot light otherwise
+struct LocalLight
+{
+  shader_vec3 position;
+  shader_float range;
+  shader_vec3 color;
+  shader_float cosOuterAngle;
+  shader_vec3 direction;
+  shader_float padding0;
+};
+
+
+#endif // CLUSTERED_LIGHTS_H_INCLUDED
@@ -0,0 +1,17 @@
+#ifndef DEPTH_BOUNDS_H_INCLUDED
+#define DEPTH_BOUNDS_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// Floats are stored as order-preserving uints so that atomicMin/atomicMax work on them
+struct DepthBounds
+{
+  shader_uint minDepth;
+  shader_uint maxDepth;
+  shader_uint lightSpaceMin[3];
+  shader_uint lightSpaceMax[3];
+};
+
+
+#endif // DEPTH_BOUNDS_H_INCLUDED
@@ -0,0 +1,23 @@
+#ifndef SPOT_LIGHT_H_INCLUDED
+#define SPOT_LIGHT_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+#define MAX_SPOT_LIGHTS 256
+
+struct SpotLightData
+{
+  shader_mat4 matrix;
+  // Offset and scale of the shadow tile in atlas UV, zero scale if the light casts no shadow
+  shader_vec4 shadowRect;
+  shader_vec3 position;
+  shader_float range;
+  shader_vec3 direction;
+  shader_float cosOuterAngle;
+  shader_vec3 color;
+  shader_float padding0;
+};
+
+
+#endif // SPOT_LIGHT_H_INCLUDED
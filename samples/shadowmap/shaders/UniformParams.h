@@ -4,12 +4,36 @@
 #include "cpp_glsl_compat.h"
 
 
+#define MAX_SHADOW_CASCADES 4
+
+#define SHADOW_TECHNIQUE_SINGLE 0u
+#define SHADOW_TECHNIQUE_CASCADED 1u
+#define SHADOW_TECHNIQUE_VIRTUAL 2u
+
+// Specialization constants of the lighting shaders, options that are fixed for the whole frame
+#define SPEC_SHADOW_TECHNIQUE 0
+#define SPEC_DEBUG_CASCADES 1
+
 struct UniformParams
 {
   shader_mat4 lightMatrix;
   shader_vec3 lightPos;
   shader_float time;
   shader_vec3 baseColor;
+  shader_uint cascadeCount;
+  shader_mat4 cascadeMatrices[MAX_SHADOW_CASCADES];
+  // View space depth of the far plane of every cascade
+  shader_vec4 cascadeSplits;
+  shader_vec3 cameraPos;
+  shader_uint spotLightCount;
+  shader_vec3 cameraForward;
+  shader_uint localLightCount;
+  // Used for clustered shading
+  shader_mat4 viewMatrix;
+  shader_mat4 invProjMatrix;
+  shader_vec2 screenSize;
+  shader_float clusterNear;
+  shader_float clusterFar;
 };
 
 
@@ -0,0 +1,21 @@
+#ifndef VIRTUAL_SHADOW_MAP_H_INCLUDED
+#define VIRTUAL_SHADOW_MAP_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+#define VSM_VIRTUAL_RESOLUTION 16384u
+#define VSM_PAGE_SIZE 128u
+#define VSM_PAGES_PER_SIDE (VSM_VIRTUAL_RESOLUTION / VSM_PAGE_SIZE)
+#define VSM_PAGE_COUNT (VSM_PAGES_PER_SIDE * VSM_PAGES_PER_SIDE)
+
+#define VSM_PHYSICAL_RESOLUTION 4096u
+#define VSM_PHYSICAL_PAGES_PER_SIDE (VSM_PHYSICAL_RESOLUTION / VSM_PAGE_SIZE)
+#define VSM_PHYSICAL_PAGE_COUNT (VSM_PHYSICAL_PAGES_PER_SIDE * VSM_PHYSICAL_PAGES_PER_SIDE)
+
+// Page table entries contain the index of the physical page in the lower bits.
+// Pages that don't have this bit set were never rendered and must not be sampled.
+#define VSM_PAGE_RESIDENT_BIT 0x80000000u
+
+
+#endif // VIRTUAL_SHADOW_MAP_H_INCLUDED
@@ -0,0 +1,27 @@
+#ifndef VISIBILITY_BUFFER_H_INCLUDED
+#define VISIBILITY_BUFFER_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// Every pixel stores (drawId + 1) << VISBUF_PRIMITIVE_BITS | primitiveId,
+// 0 means that nothing was rendered into the pixel.
+#define VISBUF_PRIMITIVE_BITS 18u
+#define VISBUF_PRIMITIVE_MASK ((1u << VISBUF_PRIMITIVE_BITS) - 1u)
+// Render elements with more triangles than this are split into several draws
+#define VISBUF_MAX_DRAW_PRIMITIVES (1u << VISBUF_PRIMITIVE_BITS)
+#define VISBUF_MAX_DRAWS ((1u << (32u - VISBUF_PRIMITIVE_BITS)) - 1u)
+#define VISBUF_EMPTY 0u
+
+struct VisibilityDraw
+{
+  shader_mat4 model;
+  shader_mat4 normalMatrix;
+  // Into the unified index buffer, already points to the first triangle of the draw
+  shader_uint firstIndex;
+  shader_uint vertexOffset;
+  shader_uvec2 padding0;
+};
+
+
+#endif // VISIBILITY_BUFFER_H_INCLUDED
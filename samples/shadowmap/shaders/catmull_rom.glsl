@@ -0,0 +1,45 @@
+#ifndef CATMULL_ROM_GLSL_INCLUDED
+#define CATMULL_ROM_GLSL_INCLUDED
+
+// Catmull-Rom filtering stays sharp where bilinear filtering would visibly blur a resampled image.
+// 16 taps reduced to 5 bilinear ones: pairs of inner taps are merged into a single one
+// placed between them, and the 4 corner taps, which barely contribute, are dropped.
+
+vec3 catmull_rom_fetch(sampler2D tex, vec2 texel, vec2 extent, vec2 size)
+{
+  // Never let bilinear filtering reach texels outside of the extent
+  const vec2 clamped = clamp(texel, vec2(0.5f), extent - 0.5f);
+  return textureLod(tex, clamped / size, 0).rgb;
+}
+
+// pos is in texels, only the top left extent part of the size sized texture is read
+vec3 sample_catmull_rom(sampler2D tex, vec2 pos, vec2 extent, vec2 size)
+{
+  const vec2 center = floor(pos - 0.5f) + 0.5f;
+  const vec2 f = pos - center;
+
+  const vec2 w0 = f * (-0.5f + f * (1.0f - 0.5f * f));
+  const vec2 w1 = 1.0f + f * f * (-2.5f + 1.5f * f);
+  const vec2 w2 = f * (0.5f + f * (2.0f - 1.5f * f));
+  const vec2 w3 = f * f * (-0.5f + 0.5f * f);
+
+  const vec2 w12 = w1 + w2;
+  const vec2 pos0 = center - 1.0f;
+  const vec2 pos12 = center + w2 / w12;
+  const vec2 pos3 = center + 2.0f;
+
+  vec3 color = catmull_rom_fetch(tex, vec2(pos12.x, pos0.y), extent, size) * w12.x * w0.y;
+  color += catmull_rom_fetch(tex, vec2(pos0.x, pos12.y), extent, size) * w0.x * w12.y;
+  color += catmull_rom_fetch(tex, pos12, extent, size) * w12.x * w12.y;
+  color += catmull_rom_fetch(tex, vec2(pos3.x, pos12.y), extent, size) * w3.x * w12.y;
+  color += catmull_rom_fetch(tex, vec2(pos12.x, pos3.y), extent, size) * w12.x * w3.y;
+
+  const float weight =
+    w12.x * w0.y + w0.x * w12.y + w12.x * w12.y + w3.x * w12.y + w12.x * w3.y;
+
+  // Negative lobes overshoot around sharp edges
+  return max(color / weight, 0.0f);
+}
+
+
+#endif // CATMULL_ROM_GLSL_INCLUDED
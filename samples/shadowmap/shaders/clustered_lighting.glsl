@@ -0,0 +1,42 @@
+#ifndef CLUSTERED_LIGHTING_GLSL_INCLUDED
+#define CLUSTERED_LIGHTING_GLSL_INCLUDED
+
+// Local lights looked up through the lists built by cluster_lights.comp
+
+#include "lighting.glsl"
+
+
+layout(binding = 8, std430) readonly buffer ClusterGrid
+{
+  uvec2 clusterGrid[];
+};
+
+layout(binding = 9, std430) readonly buffer ClusterLightIndices
+{
+  uint clusterLightIndices[];
+};
+
+vec3 clustered_lighting(vec2 frag_coord, vec3 wPos, vec3 wNorm)
+{
+  const float viewDepth = dot(wPos - params.cameraPos, params.cameraForward);
+
+  const uvec2 tile = min(
+    uvec2(frag_coord / params.screenSize * vec2(CLUSTER_TILES_X, CLUSTER_TILES_Y)),
+    uvec2(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1));
+  const float slice = log(max(viewDepth, params.clusterNear) / params.clusterNear)
+    / log(params.clusterFar / params.clusterNear) * float(CLUSTER_SLICES);
+  const uvec3 cluster = uvec3(tile, min(uint(slice), CLUSTER_SLICES - 1));
+
+  const uvec2 lightRange = clusterGrid[CLUSTER_INDEX(cluster)];
+
+  vec3 result = vec3(0.0f);
+  for (uint i = 0; i < lightRange.y; ++i)
+  {
+    const LocalLight light = localLights[clusterLightIndices[lightRange.x + i]];
+    result += local_light(
+      light.position, light.range, light.color, light.direction, light.cosOuterAngle, wPos, wNorm);
+  }
+  return result;
+}
+
+#endif // CLUSTERED_LIGHTING_GLSL_INCLUDED
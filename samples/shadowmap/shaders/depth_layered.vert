@@ -0,0 +1,38 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+#extension GL_ARB_shader_viewport_layer_array : require
+
+#include "UniformParams.h"
+
+// Renders an instance into several shadow cascades in a single draw call.
+// Every set bit of the mask produces one instance, which is routed to its layer.
+
+layout(location = 0) in vec3 vPos;
+
+layout(push_constant) uniform params_t
+{
+  mat4 mModel;
+  uint cascadeMask;
+} pushConstant;
+
+layout(binding = 0, set = 0) uniform AppData
+{
+  UniformParams params;
+};
+
+out gl_PerVertex { vec4 gl_Position; };
+
+void main(void)
+{
+  // Find the gl_InstanceIndex-th set bit of the mask
+  uint mask = pushConstant.cascadeMask;
+  for (int i = 0; i < gl_InstanceIndex; ++i)
+    mask &= mask - 1u;
+  const int cascade = findLSB(mask);
+
+  const vec3 wPos = (pushConstant.mModel * vec4(vPos, 1.0f)).xyz;
+
+  gl_Position = params.cascadeMatrices[cascade] * vec4(wPos, 1.0);
+  gl_Layer = cascade;
+}
@@ -0,0 +1,24 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Minimal vertex shader for depth-only passes (shadows, depth pre-pass).
+// Only reads the tightly packed position stream, so it fetches 12 bytes per vertex.
+
+layout(location = 0) in vec3 vPos;
+
+layout(push_constant) uniform params_t
+{
+  mat4 mProjView;
+  mat4 mModel;
+} params;
+
+out gl_PerVertex { vec4 gl_Position; };
+// Must produce exactly the same depth as simple.vert for the depth pre-pass to work
+invariant gl_Position;
+
+void main(void)
+{
+  const vec3 wPos = (params.mModel * vec4(vPos, 1.0f)).xyz;
+
+  gl_Position = params.mProjView * vec4(wPos, 1.0);
+}
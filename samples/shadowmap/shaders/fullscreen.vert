@@ -0,0 +1,13 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// A single triangle covering the whole viewport, texture coordinates are 0..1 inside of it
+
+layout(location = 0) out vec2 vTexCoord;
+
+void main()
+{
+  const vec2 xy = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+  gl_Position = vec4(xy * 2.0f - 1.0f, 0.0f, 1.0f);
+  vTexCoord = xy;
+}
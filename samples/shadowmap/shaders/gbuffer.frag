@@ -0,0 +1,23 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "octahedral.glsl"
+
+// Material data is uniform over the whole scene, so the normal is all there is to store.
+// Position is reconstructed from depth.
+
+layout(location = 0) out vec2 out_normal;
+
+layout(location = 0) in VS_OUT
+{
+  vec3 wPos;
+  vec3 wNorm;
+  vec3 wTangent;
+  vec2 texCoord;
+} surf;
+
+void main()
+{
+  out_normal = oct_encode(normalize(surf.wNorm));
+}
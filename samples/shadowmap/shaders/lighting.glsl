@@ -0,0 +1,206 @@
+#ifndef LIGHTING_GLSL_INCLUDED
+#define LIGHTING_GLSL_INCLUDED
+
+// Shading shared by the forward and the deferred paths. Local lights are
+// culled differently by the two, so their sum is passed in by the caller.
+
+#include "UniformParams.h"
+#include "VirtualShadowMap.h"
+#include "SpotLight.h"
+#include "ClusteredLights.h"
+
+
+layout(binding = 0, set = 0) uniform AppData
+{
+  UniformParams params;
+};
+
+// Baked into every permutation of the program, see ShaderPermutations
+layout(constant_id = SPEC_SHADOW_TECHNIQUE) const uint SHADOW_TECHNIQUE = SHADOW_TECHNIQUE_SINGLE;
+layout(constant_id = SPEC_DEBUG_CASCADES) const bool DEBUG_CASCADES = false;
+
+layout(binding = 1) uniform sampler2D shadowMap;
+layout(binding = 2) uniform sampler2DArray cascadeShadowMap;
+layout(binding = 3) uniform sampler2D virtualShadowAtlas;
+
+layout(binding = 4, std430) readonly buffer VirtualShadowPageTable
+{
+  uint pageTable[];
+};
+
+layout(binding = 5) uniform sampler2D spotShadowAtlas;
+
+layout(binding = 6, std430) readonly buffer SpotLights
+{
+  SpotLightData spotLights[];
+};
+
+layout(binding = 7, std430) readonly buffer LocalLights
+{
+  LocalLight localLights[];
+};
+
+float single_shadow(vec3 wPos)
+{
+  const vec4 posLightClipSpace = params.lightMatrix*vec4(wPos, 1.0f);
+
+  // for orto matrix, we don't need perspective division, you can remove it if you want; this is general case;
+  const vec3 posLightSpaceNDC = posLightClipSpace.xyz/posLightClipSpace.w;
+
+  // just shift coords from [-1,1] to [0,1]
+  const vec2 shadowTexCoord = posLightSpaceNDC.xy*0.5f + vec2(0.5f, 0.5f);
+
+  const bool  outOfView = (shadowTexCoord.x < 0.0001f || shadowTexCoord.x > 0.9999f || shadowTexCoord.y < 0.0091f || shadowTexCoord.y > 0.9999f);
+  return ((posLightSpaceNDC.z < textureLod(shadowMap, shadowTexCoord, 0).x + 0.001f) || outOfView) ? 1.0f : 0.0f;
+}
+
+float cascaded_shadow(vec3 wPos, out uint cascade)
+{
+  const float viewDepth = dot(wPos - params.cameraPos, params.cameraForward);
+
+  cascade = 0;
+  while (cascade + 1u < params.cascadeCount && viewDepth > params.cascadeSplits[cascade])
+    ++cascade;
+
+  // Nothing is shadowed past the last cascade
+  if (viewDepth > params.cascadeSplits[params.cascadeCount - 1u])
+    return 1.0f;
+
+  // cascade projections are always orthographic, so no perspective division is needed
+  const vec4 posLightClipSpace = params.cascadeMatrices[cascade]*vec4(wPos, 1.0f);
+  const vec2 shadowTexCoord = posLightClipSpace.xy*0.5f + vec2(0.5f, 0.5f);
+
+  const float depth = textureLod(cascadeShadowMap, vec3(shadowTexCoord, float(cascade)), 0).x;
+  return posLightClipSpace.z < depth + 0.001f ? 1.0f : 0.0f;
+}
+
+float virtual_shadow(vec3 wPos)
+{
+  const vec4 posLightClipSpace = params.lightMatrix*vec4(wPos, 1.0f);
+  const vec3 posLightSpaceNDC = posLightClipSpace.xyz/posLightClipSpace.w;
+  const vec2 shadowTexCoord = posLightSpaceNDC.xy*0.5f + vec2(0.5f, 0.5f);
+
+  const bool outOfView =
+    any(lessThan(shadowTexCoord, vec2(0.0f))) || any(greaterThanEqual(shadowTexCoord, vec2(1.0f)));
+  if (outOfView)
+    return 1.0f;
+
+  const uvec2 virtualTexel = uvec2(shadowTexCoord * float(VSM_VIRTUAL_RESOLUTION));
+  const uvec2 page = virtualTexel / VSM_PAGE_SIZE;
+  const uint entry = pageTable[page.y * VSM_PAGES_PER_SIDE + page.x];
+
+  // Freshly visible pages are not rendered yet for a couple of frames
+  if ((entry & VSM_PAGE_RESIDENT_BIT) == 0u)
+    return 1.0f;
+
+  const uint physicalPage = entry & ~VSM_PAGE_RESIDENT_BIT;
+  const uvec2 physicalPageCoords =
+    uvec2(physicalPage % VSM_PHYSICAL_PAGES_PER_SIDE, physicalPage / VSM_PHYSICAL_PAGES_PER_SIDE);
+  const uvec2 physicalTexel = physicalPageCoords * VSM_PAGE_SIZE + virtualTexel % VSM_PAGE_SIZE;
+
+  const float depth = texelFetch(virtualShadowAtlas, ivec2(physicalTexel), 0).x;
+  return posLightSpaceNDC.z < depth + 0.0005f ? 1.0f : 0.0f;
+}
+
+float spot_shadow(SpotLightData light, vec3 wPos)
+{
+  // Light didn't get a tile in the atlas
+  if (light.shadowRect.z == 0.0f)
+    return 1.0f;
+
+  const vec4 posLightClipSpace = light.matrix*vec4(wPos, 1.0f);
+  const vec3 posLightSpaceNDC = posLightClipSpace.xyz/posLightClipSpace.w;
+  const vec2 shadowTexCoord = posLightSpaceNDC.xy*0.5f + vec2(0.5f, 0.5f);
+
+  // Don't let the filtering fetch texels of neighbouring tiles
+  const vec2 halfTexel = 0.5f / vec2(textureSize(spotShadowAtlas, 0));
+  const vec2 atlasTexCoord = clamp(
+    light.shadowRect.xy + shadowTexCoord*light.shadowRect.zw,
+    light.shadowRect.xy + halfTexel,
+    light.shadowRect.xy + light.shadowRect.zw - halfTexel);
+
+  const float depth = textureLod(spotShadowAtlas, atlasTexCoord, 0).x;
+  return posLightSpaceNDC.z < depth + 0.0001f ? 1.0f : 0.0f;
+}
+
+// Unshadowed contribution of a point or spot light
+vec3 local_light(
+  vec3 position,
+  float range,
+  vec3 color,
+  vec3 direction,
+  float cosOuterAngle,
+  vec3 wPos,
+  vec3 wNorm)
+{
+  const vec3 toLight = position - wPos;
+  const float dist = length(toLight);
+  if (dist > range)
+    return vec3(0.0f);
+
+  const vec3 lightDir = toLight / dist;
+  const float cone =
+    smoothstep(cosOuterAngle, mix(cosOuterAngle, 1.0f, 0.2f), dot(-lightDir, direction));
+
+  const float falloff = 1.0f - dist / range;
+  return color * max(dot(wNorm, lightDir), 0.0f) * cone * falloff * falloff;
+}
+
+vec3 spot_lighting(vec3 wPos, vec3 wNorm)
+{
+  vec3 result = vec3(0.0f);
+  for (uint i = 0; i < params.spotLightCount; ++i)
+  {
+    const SpotLightData light = spotLights[i];
+
+    const vec3 radiance = local_light(
+      light.position, light.range, light.color, light.direction, light.cosOuterAngle, wPos, wNorm);
+    if (all(equal(radiance, vec3(0.0f))))
+      continue;
+
+    result += radiance * spot_shadow(light, wPos);
+  }
+  return result;
+}
+
+const vec3 CASCADE_DEBUG_COLORS[MAX_SHADOW_CASCADES] = vec3[](
+  vec3(1.0f, 0.3f, 0.3f), vec3(0.3f, 1.0f, 0.3f), vec3(0.3f, 0.3f, 1.0f), vec3(1.0f, 1.0f, 0.3f));
+
+vec3 shade_surface(vec3 wPos, vec3 wNorm, vec3 local_radiance)
+{
+  uint cascade = 0;
+  float shadow = 1.0f;
+  switch (SHADOW_TECHNIQUE)
+  {
+  case SHADOW_TECHNIQUE_SINGLE:
+    shadow = single_shadow(wPos);
+    break;
+  case SHADOW_TECHNIQUE_CASCADED:
+    shadow = cascaded_shadow(wPos, cascade);
+    break;
+  case SHADOW_TECHNIQUE_VIRTUAL:
+    shadow = virtual_shadow(wPos);
+    break;
+  }
+
+  const vec4 dark_violet = vec4(0.59f, 0.0f, 0.82f, 1.0f);
+  const vec4 chartreuse  = vec4(0.5f, 1.0f, 0.0f, 1.0f);
+
+  const vec4 lightColor1 = mix(dark_violet, chartreuse, abs(sin(params.time)));
+  const vec4 lightColor2 = vec4(1.0f, 1.0f, 1.0f, 1.0f);
+
+  const vec3 lightDir   = normalize(params.lightPos - wPos);
+  const vec4 lightColor = max(dot(wNorm, lightDir), 0.0f) * lightColor1;
+  const float ambient = 0.05;
+  // Light formula is pretty arbitrary and most definitely wrong
+  vec3 color = (lightColor.rgb * shadow + ambient) * params.baseColor;
+  color += spot_lighting(wPos, wNorm) * params.baseColor;
+  color += local_radiance * params.baseColor;
+
+  if (SHADOW_TECHNIQUE == SHADOW_TECHNIQUE_CASCADED && DEBUG_CASCADES)
+    color *= CASCADE_DEBUG_COLORS[cascade];
+
+  return color;
+}
+
+#endif // LIGHTING_GLSL_INCLUDED
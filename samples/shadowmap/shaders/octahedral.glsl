@@ -0,0 +1,26 @@
+#ifndef OCTAHEDRAL_GLSL_INCLUDED
+#define OCTAHEDRAL_GLSL_INCLUDED
+
+// Maps unit vectors onto a square, so that a normal fits into two snorm channels
+
+vec2 oct_wrap(vec2 v)
+{
+  return (1.0f - abs(v.yx)) * vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+}
+
+vec2 oct_encode(vec3 n)
+{
+  n /= abs(n.x) + abs(n.y) + abs(n.z);
+  return n.z >= 0.0f ? n.xy : oct_wrap(n.xy);
+}
+
+vec3 oct_decode(vec2 f)
+{
+  vec3 n = vec3(f, 1.0f - abs(f.x) - abs(f.y));
+  const float t = max(-n.z, 0.0f);
+  n.x += n.x >= 0.0f ? -t : t;
+  n.y += n.y >= 0.0f ? -t : t;
+  return normalize(n);
+}
+
+#endif // OCTAHEDRAL_GLSL_INCLUDED
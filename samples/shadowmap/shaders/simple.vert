@@ -24,6 +24,9 @@ layout (location = 0 ) out VS_OUT
 } vOut;
 
 out gl_PerVertex { vec4 gl_Position; };
+// Depth pre-pass relies on bit-exact depth between different programs using this shader
+invariant gl_Position;
+
 void main(void)
 {
   const vec4 wNorm = vec4(decode_normal(floatBitsToInt(vPosNorm.w)),     0.0f);
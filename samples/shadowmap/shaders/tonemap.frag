@@ -0,0 +1,56 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "catmull_rom.glsl"
+#include "AutoExposure.h"
+
+// Brings the HDR main view to the swapchain: stretches its rendered part over the whole
+// target, exposes it and maps the result into the displayable range
+
+layout(location = 0) out vec4 outColor;
+
+layout(location = 0) in vec2 vTexCoord;
+
+layout(binding = 0) uniform sampler2D source;
+
+layout(binding = 1, std430) readonly buffer Exposure
+{
+  ExposureState state;
+};
+
+layout(push_constant) uniform params_t
+{
+  // Size of the top left part of the source that was rendered into, in texels
+  vec2 sourceExtent;
+  // Size of the whole source texture, in texels
+  vec2 sourceSize;
+  // Multiplies the automatic exposure, or is the whole exposure without it
+  float exposureScale;
+  uint autoExposure;
+  uint tonemapOperator;
+} params;
+
+// Narkowicz's fit of the ACES filmic curve
+vec3 tonemap_aces(vec3 x)
+{
+  return clamp((x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f), 0.0f, 1.0f);
+}
+
+void main()
+{
+  const vec2 samplePos = vTexCoord * params.sourceExtent;
+  const vec3 hdr = sample_catmull_rom(source, samplePos, params.sourceExtent, params.sourceSize);
+
+  const float exposure =
+    params.exposureScale * (params.autoExposure != 0u ? state.exposure : 1.0f);
+  const vec3 color = hdr * exposure;
+
+  // The swapchain is sRGB, so clamping is all there is to do without an operator
+  if (params.tonemapOperator == TONEMAP_OPERATOR_REINHARD)
+    outColor = vec4(color / (1.0f + color), 1.0f);
+  else if (params.tonemapOperator == TONEMAP_OPERATOR_ACES)
+    outColor = vec4(tonemap_aces(color), 1.0f);
+  else
+    outColor = vec4(color, 1.0f);
+}
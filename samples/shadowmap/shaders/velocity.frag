@@ -0,0 +1,15 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Offset from the previous to the current position in texture coordinates,
+// so that the previous position is uv - velocity
+
+layout(location = 0) out vec2 outVelocity;
+
+layout(location = 0) in vec4 currClip;
+layout(location = 1) in vec4 prevClip;
+
+void main()
+{
+  outVelocity = 0.5f * (currClip.xy / currClip.w - prevClip.xy / prevClip.w);
+}
@@ -0,0 +1,38 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Screen space motion of every pixel between the previous and the current frame.
+// The instance index is passed as the first instance to look up the previous transform.
+
+layout(location = 0) in vec3 vPos;
+
+layout(push_constant) uniform params_t
+{
+  mat4 mProjView;
+  mat4 mModel;
+} params;
+
+layout(binding = 0, std430) readonly buffer Velocity
+{
+  // Without the jitter, which would otherwise show up as motion
+  mat4 currProjView;
+  mat4 prevProjView;
+  mat4 prevModels[];
+};
+
+layout(location = 0) out vec4 currClip;
+layout(location = 1) out vec4 prevClip;
+
+out gl_PerVertex { vec4 gl_Position; };
+// Only fragments matching the depth of the main view pass the test
+invariant gl_Position;
+
+void main(void)
+{
+  const vec3 wPos = (params.mModel * vec4(vPos, 1.0f)).xyz;
+
+  gl_Position = params.mProjView * vec4(wPos, 1.0);
+
+  currClip = currProjView * vec4(wPos, 1.0f);
+  prevClip = prevProjView * prevModels[gl_InstanceIndex] * vec4(vPos, 1.0f);
+}
@@ -0,0 +1,15 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "VisibilityBuffer.h"
+
+
+layout(location = 0) flat in uint drawId;
+
+layout(location = 0) out uint out_visibility;
+
+void main()
+{
+  out_visibility = ((drawId + 1u) << VISBUF_PRIMITIVE_BITS) | uint(gl_PrimitiveID);
+}
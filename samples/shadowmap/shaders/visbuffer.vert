@@ -0,0 +1,33 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "VisibilityBuffer.h"
+
+// The draw index is passed as the first instance, so that
+// a single push constant range is enough for the whole pass.
+
+layout(location = 0) in vec3 vPos;
+
+layout(push_constant) uniform params_t
+{
+  mat4 mProjView;
+} params;
+
+layout(binding = 0, std430) readonly buffer Draws
+{
+  VisibilityDraw draws[];
+};
+
+layout(location = 0) flat out uint drawId;
+
+out gl_PerVertex { vec4 gl_Position; };
+// Must produce exactly the same depth as depth_only.vert, later passes test against it
+invariant gl_Position;
+
+void main(void)
+{
+  drawId = gl_InstanceIndex;
+  const vec3 wPos = (draws[gl_InstanceIndex].model * vec4(vPos, 1.0f)).xyz;
+  gl_Position = params.mProjView * vec4(wPos, 1.0);
+}
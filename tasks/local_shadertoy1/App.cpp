@@ -5,8 +5,9 @@
 #include <etna/PipelineManager.hpp>
 
 
-App::App()
-  : resolution{1280, 720}
+App::App(HeadlessOptions options)
+  : headless{std::move(options)}
+  , resolution{1280, 720}
   , useVsync{true}
 {
   // First, we need to initialize Vulkan, which is not trivial because
@@ -16,15 +17,21 @@ App::App()
     // Actually rendering anything to a screen is optional in Vulkan, you can
     // alternatively save rendered frames into files, send them over network, etc.
     // Instance extensions do not depend on the actual GPU, only on the OS.
-    auto glfwInstExts = windowing.getRequiredVulkanInstanceExtensions();
-
-    std::vector<const char*> instanceExtensions{glfwInstExts.begin(), glfwInstExts.end()};
-
-    // We also need the swapchain device extension to get access to the OS
-    // window from inside of Vulkan on the GPU.
-    // Device extensions require HW support from the GPU.
-    // Generally, in Vulkan, we call the GPU a "device" and the CPU/OS combination a "host."
-    std::vector<const char*> deviceExtensions{VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    // In headless mode, there is no window and we need none of them.
+    std::vector<const char*> instanceExtensions;
+    std::vector<const char*> deviceExtensions;
+    if (!headless.enabled)
+    {
+      windowing = std::make_unique<OsWindowingManager>();
+      auto glfwInstExts = windowing->getRequiredVulkanInstanceExtensions();
+      instanceExtensions.assign(glfwInstExts.begin(), glfwInstExts.end());
+
+      // We also need the swapchain device extension to get access to the OS
+      // window from inside of Vulkan on the GPU.
+      // Device extensions require HW support from the GPU.
+      // Generally, in Vulkan, we call the GPU a "device" and the CPU/OS combination a "host."
+      deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
 
     // Etna does all of the Vulkan initialization heavy lifting.
     // You can skip figuring out how it works for now.
@@ -39,13 +46,20 @@ App::App()
     });
   }
 
-  // Now we can create an OS window
-  osWindow = windowing.createWindow(OsWindow::CreateInfo{
-    .resolution = resolution,
-  });
-
-  // But we also need to hook the OS window up to Vulkan manually!
+  if (headless.enabled)
   {
+    // Without a window, frames are rendered into an image that stands in for the swapchain
+    headlessTarget = std::make_unique<HeadlessTarget>(vk::Extent2D{resolution.x, resolution.y});
+  }
+  else
+  {
+    // Now we can create an OS window
+    osWindow = windowing->createWindow(OsWindow::CreateInfo{
+      .resolution = resolution,
+    });
+
+    // But we also need to hook the OS window up to Vulkan manually!
+
     // First, we ask GLFW to provide a "surface" for the window,
     // which is an opaque description of the area where we can actually render.
     auto surface = osWindow->createVkSurface(etna::get_context().getInstance());
@@ -84,9 +98,22 @@ App::~App()
 
 void App::run()
 {
-  while (!osWindow->isBeingClosed())
+  if (headless.enabled)
   {
-    windowing.poll();
+    std::filesystem::create_directories(headless.outputDir);
+
+    for (std::uint32_t frame = 0; frame < headless.frameCount; ++frame)
+    {
+      if (auto path = headless.capturePath(frame))
+        headlessTarget->captureNextFrame(std::move(*path));
+
+      drawFrameHeadless();
+    }
+  }
+
+  while (osWindow && !osWindow->isBeingClosed())
+  {
+    windowing->poll();
 
     drawFrame();
   }
@@ -115,31 +142,7 @@ void App::drawFrame()
 
     ETNA_CHECK_VK_RESULT(currentCmdBuf.begin(vk::CommandBufferBeginInfo{}));
     {
-      // First of all, we need to "initialize" th "backbuffer", aka the current swapchain
-      // image, into a state that is appropriate for us working with it. The initial state
-      // is considered to be "undefined" (aka "I contain trash memory"), by the way.
-      // "Transfer" in vulkanese means "copy or blit".
-      // Note that Etna sometimes calls this for you to make life simpler, read Etna's code!
-      etna::set_state(
-        currentCmdBuf,
-        backbuffer,
-        // We are going to use the texture at the transfer stage...
-        vk::PipelineStageFlagBits2::eTransfer,
-        // ...to transfer-write stuff into it...
-        vk::AccessFlagBits2::eTransferWrite,
-        // ...and want it to have the appropriate layout.
-        vk::ImageLayout::eTransferDstOptimal,
-        vk::ImageAspectFlagBits::eColor);
-      // The set_state doesn't actually record any commands, they are deferred to
-      // the moment you call flush_barriers.
-      // As with set_state, Etna sometimes flushes on it's own.
-      // Usually, flushes should be placed before "action", i.e. compute dispatches
-      // and blit/copy operations.
-      etna::flush_barriers(currentCmdBuf);
-
-
-      // TODO: Record your commands here!
-
+      recordFrame(currentCmdBuf, backbuffer);
 
       // At the end of "rendering", we are required to change how the pixels of the
       // swpchain image are laid out in memory to something that is appropriate
@@ -183,3 +186,51 @@ void App::drawFrame()
     ETNA_VERIFY((resolution == glm::uvec2{w, h}));
   }
 }
+
+void App::recordFrame(vk::CommandBuffer cmd_buf, vk::Image backbuffer)
+{
+  // First of all, we need to "initialize" th "backbuffer", aka the current swapchain
+  // image, into a state that is appropriate for us working with it. The initial state
+  // is considered to be "undefined" (aka "I contain trash memory"), by the way.
+  // "Transfer" in vulkanese means "copy or blit".
+  // Note that Etna sometimes calls this for you to make life simpler, read Etna's code!
+  etna::set_state(
+    cmd_buf,
+    backbuffer,
+    // We are going to use the texture at the transfer stage...
+    vk::PipelineStageFlagBits2::eTransfer,
+    // ...to transfer-write stuff into it...
+    vk::AccessFlagBits2::eTransferWrite,
+    // ...and want it to have the appropriate layout.
+    vk::ImageLayout::eTransferDstOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  // The set_state doesn't actually record any commands, they are deferred to
+  // the moment you call flush_barriers.
+  // As with set_state, Etna sometimes flushes on it's own.
+  // Usually, flushes should be placed before "action", i.e. compute dispatches
+  // and blit/copy operations.
+  etna::flush_barriers(cmd_buf);
+
+
+  // TODO: Record your commands here!
+}
+
+void App::drawFrameHeadless()
+{
+  // Same as drawFrame, except that the image we render into never goes to the screen.
+  // The target makes every frame wait for the previous one instead of a swapchain image.
+  auto currentCmdBuf = commandManager->acquireNext();
+
+  etna::begin_frame();
+
+  ETNA_CHECK_VK_RESULT(currentCmdBuf.begin(vk::CommandBufferBeginInfo{}));
+  {
+    recordFrame(currentCmdBuf, headlessTarget->getImage().get());
+    headlessTarget->recordCapture(currentCmdBuf);
+  }
+  ETNA_CHECK_VK_RESULT(currentCmdBuf.end());
+
+  headlessTarget->submit(*commandManager, currentCmdBuf);
+
+  etna::end_frame();
+}
@@ -6,26 +6,34 @@
 #include <etna/Image.hpp>
 
 #include "wsi/OsWindowingManager.hpp"
+#include "render_utils/HeadlessTarget.hpp"
 
 
 class App
 {
 public:
-  App();
+  explicit App(HeadlessOptions options = {});
   ~App();
 
   void run();
 
 private:
   void drawFrame();
+  void drawFrameHeadless();
+  void recordFrame(vk::CommandBuffer cmd_buf, vk::Image backbuffer);
 
 private:
-  OsWindowingManager windowing;
+  HeadlessOptions headless;
+
+  // Both are null in headless mode
+  std::unique_ptr<OsWindowingManager> windowing;
   std::unique_ptr<OsWindow> osWindow;
 
   glm::uvec2 resolution;
   bool useVsync;
 
+  // Exactly one of these two is used, depending on whether we run headless
   std::unique_ptr<etna::Window> vkWindow;
+  std::unique_ptr<HeadlessTarget> headlessTarget;
   std::unique_ptr<etna::PerFrameCmdMgr> commandManager;
 };
@@ -1,12 +1,21 @@
 #include "App.hpp"
 
 #include <etna/Etna.hpp>
+#include <spdlog/spdlog.h>
 
 
-int main()
+int main(int argc, char** argv)
 {
+  auto options = HeadlessOptions::parse(argc, argv);
+  if (!options)
   {
-    App app;
+    spdlog::info(
+      "Usage: local_shadertoy1 [--headless [--frames N] [--capture FRAME]... [--output DIR]]");
+    return 1;
+  }
+
+  {
+    App app(std::move(*options));
     app.run();
   }
 
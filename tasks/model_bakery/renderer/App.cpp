@@ -3,21 +3,33 @@
 #include <tracy/Tracy.hpp>
 
 
-App::App()
+App::App(HeadlessOptions options)
+  : headless{std::move(options)}
 {
   glm::uvec2 initialRes = {1280, 720};
-  mainWindow = windowing.createWindow(OsWindow::CreateInfo{
-    .resolution = initialRes,
-  });
 
   renderer.reset(new Renderer(initialRes));
 
-  auto instExts = windowing.getRequiredVulkanInstanceExtensions();
-  renderer->initVulkan(instExts);
+  if (headless.enabled)
+  {
+    renderer->initVulkan({}, true);
+    renderer->initHeadlessFrameDelivery();
+  }
+  else
+  {
+    windowing = std::make_unique<OsWindowingManager>();
+    mainWindow = windowing->createWindow(OsWindow::CreateInfo{
+      .resolution = initialRes,
+    });
+
+    auto instExts = windowing->getRequiredVulkanInstanceExtensions();
+    renderer->initVulkan(instExts);
 
-  auto surface = mainWindow->createVkSurface(etna::get_context().getInstance());
+    auto surface = mainWindow->createVkSurface(etna::get_context().getInstance());
 
-  renderer->initFrameDelivery(std::move(surface), [this]() { return mainWindow->getResolution(); });
+    renderer->initFrameDelivery(
+      std::move(surface), [this]() { return mainWindow->getResolution(); });
+  }
 
   mainCam.lookAt({0, 10, 10}, {0, 0, 0}, {0, 1, 0});
 
@@ -26,18 +38,42 @@ App::App()
 
 void App::run()
 {
-  double lastTime = windowing.getTime();
+  if (headless.enabled)
+  {
+    runHeadless();
+    return;
+  }
+
+  double lastTime = windowing->getTime();
   while (!mainWindow->isBeingClosed())
   {
-    const double currTime = windowing.getTime();
+    const double currTime = windowing->getTime();
     const float diffTime = static_cast<float>(currTime - lastTime);
     lastTime = currTime;
 
-    windowing.poll();
+    windowing->poll();
 
     processInput(diffTime);
 
-    drawFrame();
+    drawFrame(static_cast<float>(currTime));
+
+    FrameMark;
+  }
+}
+
+void App::runHeadless()
+{
+  // A fixed time step makes every run render exactly the same images
+  constexpr float frameTime = 1.0f / 60.0f;
+
+  std::filesystem::create_directories(headless.outputDir);
+
+  for (std::uint32_t frame = 0; frame < headless.frameCount; ++frame)
+  {
+    if (auto path = headless.capturePath(frame))
+      renderer->captureNextFrame(std::move(*path));
+
+    drawFrame(static_cast<float>(frame) * frameTime);
 
     FrameMark;
   }
@@ -65,13 +101,13 @@ void App::processInput(float dt)
   renderer->debugInput(mainWindow->keyboard);
 }
 
-void App::drawFrame()
+void App::drawFrame(float current_time)
 {
   ZoneScoped;
 
   renderer->update(FramePacket{
     .mainCam = mainCam,
-    .currentTime = static_cast<float>(windowing.getTime()),
+    .currentTime = current_time,
   });
   renderer->drawFrame();
 }
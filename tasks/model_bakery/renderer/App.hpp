@@ -2,6 +2,7 @@
 
 #include "wsi/OsWindowingManager.hpp"
 #include "scene/Camera.hpp"
+#include "render_utils/HeadlessTarget.hpp"
 
 #include "Renderer.hpp"
 
@@ -9,19 +10,23 @@
 class App
 {
 public:
-  App();
+  explicit App(HeadlessOptions options = {});
 
   void run();
 
 private:
+  void runHeadless();
   void processInput(float dt);
-  void drawFrame();
+  void drawFrame(float current_time);
 
   void moveCam(Camera& cam, const Keyboard& kb, float dt);
   void rotateCam(Camera& cam, const Mouse& ms, float dt);
 
 private:
-  OsWindowingManager windowing;
+  HeadlessOptions headless;
+
+  // Both are null in headless mode
+  std::unique_ptr<OsWindowingManager> windowing;
   std::unique_ptr<OsWindow> mainWindow;
 
   float camMoveSpeed = 1;
@@ -12,7 +12,7 @@ Renderer::Renderer(glm::uvec2 res)
 {
 }
 
-void Renderer::initVulkan(std::span<const char*> instance_extensions)
+void Renderer::initVulkan(std::span<const char*> instance_extensions, bool headless)
 {
   std::vector<const char*> instanceExtensions;
 
@@ -21,7 +21,9 @@ void Renderer::initVulkan(std::span<const char*> instance_extensions)
 
   std::vector<const char*> deviceExtensions;
 
-  deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  // Not even available on some CPU implementations, and not needed without a window
+  if (!headless)
+    deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
   etna::initialize(etna::InitParams{
     .applicationName = "model_bakery_renderer",
@@ -53,11 +55,24 @@ void Renderer::initFrameDelivery(vk::UniqueSurfaceKHR a_surface, ResolutionProvi
 
   resolution = {w, h};
 
+  initWorldRenderer(window->getCurrentFormat());
+}
+
+void Renderer::initHeadlessFrameDelivery()
+{
+  commandManager = etna::get_context().createPerFrameCmdMgr();
+  headlessTarget = std::make_unique<HeadlessTarget>(vk::Extent2D{resolution.x, resolution.y});
+
+  initWorldRenderer(HeadlessTarget::FORMAT);
+}
+
+void Renderer::initWorldRenderer(vk::Format target_format)
+{
   worldRenderer = std::make_unique<WorldRenderer>();
 
   worldRenderer->allocateResources(resolution);
   worldRenderer->loadShaders();
-  worldRenderer->setupPipelines(window->getCurrentFormat());
+  worldRenderer->setupPipelines(target_format);
 }
 
 void Renderer::loadScene(std::filesystem::path path)
@@ -97,33 +112,41 @@ void Renderer::drawFrame()
 
   etna::begin_frame();
 
+  if (window)
+    drawFrameToWindow(currentCmdBuf);
+  else
+    drawFrameHeadless(currentCmdBuf);
+}
+
+void Renderer::drawFrameToWindow(vk::CommandBuffer cmd_buf)
+{
   auto nextSwapchainImage = window->acquireNext();
 
   if (nextSwapchainImage)
   {
     auto [image, view, availableSem] = *nextSwapchainImage;
 
-    ETNA_CHECK_VK_RESULT(currentCmdBuf.begin(vk::CommandBufferBeginInfo{}));
+    ETNA_CHECK_VK_RESULT(cmd_buf.begin(vk::CommandBufferBeginInfo{}));
     {
-      ETNA_PROFILE_GPU(currentCmdBuf, renderFrame);
+      ETNA_PROFILE_GPU(cmd_buf, renderFrame);
 
-      worldRenderer->renderWorld(currentCmdBuf, image, view);
+      worldRenderer->renderWorld(cmd_buf, image, view);
 
       etna::set_state(
-        currentCmdBuf,
+        cmd_buf,
         image,
         vk::PipelineStageFlagBits2::eColorAttachmentOutput,
         {},
         vk::ImageLayout::ePresentSrcKHR,
         vk::ImageAspectFlagBits::eColor);
 
-      etna::flush_barriers(currentCmdBuf);
+      etna::flush_barriers(cmd_buf);
 
-      ETNA_READ_BACK_GPU_PROFILING(currentCmdBuf);
+      ETNA_READ_BACK_GPU_PROFILING(cmd_buf);
     }
-    ETNA_CHECK_VK_RESULT(currentCmdBuf.end());
+    ETNA_CHECK_VK_RESULT(cmd_buf.end());
 
-    auto renderingDone = commandManager->submit(std::move(currentCmdBuf), std::move(availableSem));
+    auto renderingDone = commandManager->submit(std::move(cmd_buf), std::move(availableSem));
 
     const bool presented = window->present(std::move(renderingDone), view);
 
@@ -143,6 +166,32 @@ void Renderer::drawFrame()
   etna::end_frame();
 }
 
+void Renderer::drawFrameHeadless(vk::CommandBuffer cmd_buf)
+{
+  ETNA_CHECK_VK_RESULT(cmd_buf.begin(vk::CommandBufferBeginInfo{}));
+  {
+    ETNA_PROFILE_GPU(cmd_buf, renderFrame);
+
+    const auto& target = headlessTarget->getImage();
+    worldRenderer->renderWorld(cmd_buf, target.get(), target.getView({}));
+
+    headlessTarget->recordCapture(cmd_buf);
+
+    ETNA_READ_BACK_GPU_PROFILING(cmd_buf);
+  }
+  ETNA_CHECK_VK_RESULT(cmd_buf.end());
+
+  headlessTarget->submit(*commandManager, cmd_buf);
+
+  etna::end_frame();
+}
+
+void Renderer::captureNextFrame(std::filesystem::path path)
+{
+  ETNA_VERIFYF(headlessTarget, "Frame capture is only supported in headless mode");
+  headlessTarget->captureNextFrame(std::move(path));
+}
+
 Renderer::~Renderer()
 {
   ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
@@ -6,6 +6,7 @@
 #include <function2/function2.hpp>
 
 #include "wsi/Keyboard.hpp"
+#include "render_utils/HeadlessTarget.hpp"
 
 #include "FramePacket.hpp"
 #include "WorldRenderer.hpp"
@@ -19,8 +20,10 @@ public:
   explicit Renderer(glm::uvec2 resolution);
   ~Renderer();
 
-  void initVulkan(std::span<const char*> instance_extensions);
+  void initVulkan(std::span<const char*> instance_extensions, bool headless = false);
   void initFrameDelivery(vk::UniqueSurfaceKHR surface, ResolutionProvider res_provider);
+  // Renders into an offscreen image instead of a swapchain, no window required
+  void initHeadlessFrameDelivery();
   void recreateSwapchain(glm::uvec2 res);
   void loadScene(std::filesystem::path path);
 
@@ -28,10 +31,20 @@ public:
   void update(const FramePacket& packet);
   void drawFrame();
 
+  // Headless only. Writes the next drawn frame into a PNG file.
+  void captureNextFrame(std::filesystem::path path);
+
+private:
+  void initWorldRenderer(vk::Format target_format);
+  void drawFrameToWindow(vk::CommandBuffer cmd_buf);
+  void drawFrameHeadless(vk::CommandBuffer cmd_buf);
+
 private:
   ResolutionProvider resolutionProvider;
 
   std::unique_ptr<etna::Window> window;
+  // Replaces the window in headless mode
+  std::unique_ptr<HeadlessTarget> headlessTarget;
   std::unique_ptr<etna::PerFrameCmdMgr> commandManager;
 
   glm::uvec2 resolution;
@@ -1,10 +1,18 @@
 #include "App.hpp"
 
 
-int main()
+int main(int argc, char** argv)
 {
+  auto options = HeadlessOptions::parse(argc, argv);
+  if (!options)
   {
-    App app;
+    spdlog::info(
+      "Usage: model_bakery_renderer [--headless [--frames N] [--capture FRAME]... [--output DIR]]");
+    return 1;
+  }
+
+  {
+    App app(std::move(*options));
     app.run();
   }
 